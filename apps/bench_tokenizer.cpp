@@ -0,0 +1,67 @@
+
+#include <iostream>
+#include <string>
+
+#include <giolib/static_block.h>
+#include <giolib/main.h>
+
+#include "utils/utils.h"
+#include "mm/tokenizer.h"
+#include "mm/scanner.h"
+
+template< typename Tokenizer >
+static size_t count_tokens(Tokenizer &tokenizer) {
+    size_t count = 0;
+    while (!tokenizer.next_view().second.empty()) {
+        count++;
+    }
+    return count;
+}
+
+int bench_tokenizer_main(int argc, char *argv[]) {
+    if (argc != 2 && argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " FILENAME [REPS]" << std::endl;
+        return 1;
+    }
+    boost::filesystem::path filename(argv[1]);
+    int reps = argc == 3 ? std::stoi(argv[2]) : 5;
+
+    size_t expected = 0;
+    {
+        std::cout << "FileTokenizer::next()" << std::endl;
+        auto t = tic();
+        for (int i = 0; i < reps; i++) {
+            FileTokenizer ft(filename);
+            expected = 0;
+            while (!ft.next().second.empty()) {
+                expected++;
+            }
+        }
+        toc(t, reps);
+        std::cout << "Found " << expected << " tokens" << std::endl;
+    }
+
+    for (auto scanner : { MMScanner::SCALAR, MMScanner::SSE2, MMScanner::AVX2 }) {
+        if (!set_mm_scanner(scanner)) {
+            std::cout << "Scanner " << mm_scanner_name(scanner) << " is not supported on this CPU" << std::endl;
+            continue;
+        }
+        std::cout << "MappedFileTokenizer::next_view() with " << mm_scanner_name(scanner) << " scanner" << std::endl;
+        size_t count = 0;
+        auto t = tic();
+        for (int i = 0; i < reps; i++) {
+            MappedFileTokenizer mft(filename);
+            count = count_tokens(mft);
+        }
+        toc(t, reps);
+        if (count != expected) {
+            std::cout << "Found " << count << " tokens instead of " << expected << "!" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+gio_static_block {
+    gio::register_main_function("bench_tokenizer", bench_tokenizer_main);
+}
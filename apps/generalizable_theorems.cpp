@@ -122,10 +122,10 @@ void find_generalizable_theorems() {
     auto &tb = data.tb;
     temp_stacked_allocator tsa(tb);
 
-    for (const Assertion &ass : lib.get_assertions()) {
+    for (const Assertion &ass : lib.gen_assertions()) {
     //while (true) {
         //auto &ass = tb.get_assertion(tb.get_label("cvjust"));
-        if (!ass.is_valid() || !ass.is_theorem() || tb.get_sentence(ass.get_thesis()).at(0) != tb.get_turnstile()) {
+        if (!ass.is_valid() || !ass.is_theorem() || tb.get_sentence_view(ass.get_thesis()).at(0) != tb.get_turnstile()) {
             continue;
         }
         if (ass.is_modif_disc() || ass.is_usage_disc()) {
@@ -148,7 +148,7 @@ void find_generalizable_theorems() {
 #ifdef NDEBUG
                 (void) res;
 #endif
-            } else if (tb.get_assertion(label).is_valid() && tb.get_sentence(label).at(0) == tb.get_turnstile()) {
+            } else if (tb.get_assertion(label).is_valid() && tb.get_sentence_view(label).at(0) == tb.get_turnstile()) {
                 //cout << " \"" << tb.resolve_label(label) << "\",";
                 bool res = reactor.process_label(label);
                 assert(res);
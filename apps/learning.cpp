@@ -133,12 +133,9 @@ int proofs_stats_main(int argc, char *argv[]) {
     auto &lib = data.lib;
     //auto &tb = data.tb;
 
-    TextProgressBar tpb(100, (double) lib.get_assertions().size());
+    TextProgressBar tpb(100, (double) lib.get_labels_num());
     std::vector< std::pair< LabTok, ProofStat > > proofs_stats;
-    for (const Assertion &ass : lib.get_assertions()) {
-        if (!ass.is_valid()) {
-            continue;
-        }
+    for (const Assertion &ass : lib.gen_assertions()) {
         if (!ass.is_theorem()) {
             continue;
         }
@@ -266,8 +263,8 @@ int gen_random_theorems_main(int argc, char *argv[]) {
     LabTok target_label{};
 
     std::vector< const Assertion* > useful_asses;
-    for (const auto &ass : lib.get_assertions()) {
-        if (ass.is_valid() && lib.get_sentence(ass.get_thesis()).at(0) == tb.get_turnstile()) {
+    for (const Assertion &ass : lib.gen_assertions()) {
+        if (lib.get_sentence_view(ass.get_thesis()).at(0) == tb.get_turnstile()) {
             /*if (ass.get_thesis() >= target_label) {
                 break;
             }*/
@@ -281,7 +278,7 @@ int gen_random_theorems_main(int argc, char *argv[]) {
         }
     }
     std::sort(useful_asses.begin(), useful_asses.end(), [&lib](const auto &x, const auto &y) {
-        return x->get_ess_hyps().size() < y->get_ess_hyps().size() || (x->get_ess_hyps().size() == y->get_ess_hyps().size() && lib.get_sentence(x->get_thesis()).size() > lib.get_sentence(y->get_thesis()).size());
+        return x->get_ess_hyps().size() < y->get_ess_hyps().size() || (x->get_ess_hyps().size() == y->get_ess_hyps().size() && lib.get_sentence_view(x->get_thesis()).size() > lib.get_sentence_view(y->get_thesis()).size());
     });
     std::cout << "There are " << useful_asses.size() << " useful assertions" << std::endl;
 
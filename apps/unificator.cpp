@@ -44,10 +44,10 @@ void unification_loop() {
             const Assertion &ass = lib.get_assertion(label);
             std::cout << " * " << lib.resolve_label(label) << ":";
             for (auto &hyp : ass.get_ess_hyps()) {
-                auto &hyp_sent = lib.get_sentence(hyp);
+                const auto &hyp_sent = lib.get_sentence(hyp);
                 std::cout << " & " << tb.print_sentence(hyp_sent, SentencePrinter::STYLE_ANSI_COLORS_SET_MM);
             }
-            auto &thesis_sent = lib.get_sentence(ass.get_thesis());
+            const auto &thesis_sent = lib.get_sentence(ass.get_thesis());
             std::cout << " => " << tb.print_sentence(thesis_sent, SentencePrinter::STYLE_ANSI_COLORS_SET_MM) << std::endl;
         }
     }
@@ -11,15 +11,16 @@
 #include <giolib/proc_stats.h>
 
 #include "utils/utils.h"
+#include "utils/parallel.h"
 #include "mm/reader.h"
 #include "mm/proof.h"
 
-bool verify_database(boost::filesystem::path filename, bool advanced_tests) {
+bool verify_database(boost::filesystem::path filename, bool advanced_tests, size_t jobs) {
     bool success = true;
     try {
         std::cout << "Memory usage when starting: " << size_to_string(gio::get_used_memory()) << std::endl;
-        FileTokenizer ft(filename);
-        Reader p(ft, true, true);
+        MappedFileTokenizer ft(filename);
+        Reader p(ft, true, true, jobs);
         std::cout << "Reading library and executing all proofs..." << std::endl;
         p.run();
         LibraryImpl lib = p.get_library();
@@ -27,38 +28,23 @@ bool verify_database(boost::filesystem::path filename, bool advanced_tests) {
         std::cout << "Memory usage after loading: " << size_to_string(gio::get_used_memory()) << std::endl;
 
         if (advanced_tests) {
-            std::cout << "Compressing all proofs and executing again..." << std::endl;
-            for (auto &ass : lib.get_assertions()) {
-                if (ass.is_valid() && ass.is_theorem()) {
-                    CompressedProof compressed = ass.get_proof_operator(lib)->compress();
-                    compressed.get_executor< Sentence >(lib, ass)->execute();
-                }
-            }
-
             std::cout << "Decompressing all proofs and executing again..." << std::endl;
-            for (auto &ass : lib.get_assertions()) {
-                if (ass.is_valid() && ass.is_theorem()) {
-                    UncompressedProof uncompressed = ass.get_proof_operator(lib)->uncompress();
-                    uncompressed.get_executor< Sentence >(lib, ass)->execute();
-                }
-            }
-
-            std::cout << "Compressing and decompressing all proofs and executing again..." << std::endl;
-            for (auto &ass : lib.get_assertions()) {
-                if (ass.is_valid() && ass.is_theorem()) {
-                    CompressedProof compressed = ass.get_proof_operator(lib)->compress();
-                    UncompressedProof uncompressed = compressed.get_operator(lib, ass)->uncompress();
-                    uncompressed.get_executor< Sentence >(lib, ass)->execute();
-                }
-            }
-
-            std::cout << "Decompressing and compressing all proofs and executing again..." << std::endl;
-            for (auto &ass : lib.get_assertions()) {
+            parallel_for(lib.get_labels_num() + 1, [&](size_t i) {
+                const auto &ass = lib.get_assertion(LabTok(static_cast< LabTok::val_type >(i)));
                 if (ass.is_valid() && ass.is_theorem()) {
                     UncompressedProof uncompressed = ass.get_proof_operator(lib)->uncompress();
-                    CompressedProof compressed = uncompressed.get_operator(lib, ass)->compress();
-                    compressed.get_executor< Sentence >(lib, ass)->execute();
+                    uncompressed.verify(lib, ass);
                 }
+            }, jobs);
+
+            std::cout << "Recompressing all proofs with each strategy and executing again..." << std::endl;
+            for (const auto strategy : { ProofOperator::CS_NO_BACKREFS, ProofOperator::CS_BACKREFS_ON_IDENTICAL_TREE, ProofOperator::CS_BACKREFS_ON_IDENTICAL_SENTENCE }) {
+                auto proofs = recompress_proofs(lib, strategy, jobs);
+                parallel_for(proofs.size(), [&](size_t i) {
+                    if (proofs[i] != nullptr) {
+                        proofs[i]->verify(lib, lib.get_assertion(LabTok(static_cast< LabTok::val_type >(i))));
+                    }
+                }, jobs);
             }
         } else {
             std::cout << "Skipping advanced tests" << std::endl;
@@ -116,7 +102,7 @@ static std::vector< std::pair < std::string, bool > > get_tests() {
     return tests;
 }
 
-void test_all_verifications() {
+void test_all_verifications(size_t jobs) {
     auto tests = get_tests();
     int problems = 0;
     for (auto test_pair : tests) {
@@ -124,7 +110,7 @@ void test_all_verifications() {
         bool expect_success = test_pair.second;
         std::cout << "Testing file " << filename << " from " << test_basename << ", which is expected to " << (expect_success ? "pass" : "fail" ) << "..." << std::endl;
 
-        bool success = verify_database(test_basename / filename, expect_success);
+        bool success = verify_database(test_basename / filename, expect_success, jobs);
         if (success) {
             if (expect_success) {
                 std::cout << "Good, it worked!" << std::endl;
@@ -146,35 +132,70 @@ void test_all_verifications() {
     std::cout << "Found " << problems << " problems" << std::endl;
 }
 
-int test_one_main(int argc, char *argv[]) {
-    if (argc != 2) {
+/* Parse arguments of the form [--jobs N] [FILENAME]; jobs is left untouched
+ * if the option is not given. */
+static bool parse_verify_args(int argc, char *argv[], size_t &jobs, std::string &filename, bool want_filename) {
+    bool has_filename = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "--jobs" || arg == "-j") {
+            if (i + 1 == argc) {
+                std::cerr << "Option " << arg << " requires an argument" << std::endl;
+                return false;
+            }
+            try {
+                jobs = std::stoul(argv[++i]);
+            } catch (const std::logic_error&) {
+                std::cerr << "Invalid number of jobs: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (want_filename && !has_filename) {
+            filename = arg;
+            has_filename = true;
+        } else {
+            std::cerr << "Unexpected argument: " << arg << std::endl;
+            return false;
+        }
+    }
+    if (want_filename && !has_filename) {
         std::cerr << "Provide file name as argument, please" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int test_one_main(int argc, char *argv[]) {
+    size_t jobs = default_jobs_num();
+    std::string filename;
+    if (!parse_verify_args(argc, argv, jobs, filename, true)) {
         return 1;
     }
-    std::string filename(argv[1]);
-    return verify_database(filename, true) ? 0 : 1;
+    return verify_database(filename, true, jobs) ? 0 : 1;
 }
 gio_static_block {
     gio::register_main_function("verify_adv", test_one_main);
 }
 
 int test_simple_one_main(int argc, char *argv[]) {
-    if (argc != 2) {
-        std::cerr << "Provide file name as argument, please" << std::endl;
+    size_t jobs = default_jobs_num();
+    std::string filename;
+    if (!parse_verify_args(argc, argv, jobs, filename, true)) {
         return 1;
     }
-    std::string filename(argv[1]);
-    return verify_database(filename, false) ? 0 : 1;
+    return verify_database(filename, false, jobs) ? 0 : 1;
 }
 gio_static_block {
     gio::register_main_function("verify", test_simple_one_main);
 }
 
 int test_all_main(int argc, char *argv[]) {
-    (void) argc;
-    (void) argv;
+    size_t jobs = default_jobs_num();
+    std::string filename;
+    if (!parse_verify_args(argc, argv, jobs, filename, false)) {
+        return 1;
+    }
 
-    test_all_verifications();
+    test_all_verifications(jobs);
 
     return 0;
 }
@@ -182,3 +203,43 @@ gio_static_block {
     gio::register_main_function("verify_all", test_all_main);
 }
 
+/* Read a database and print all its proofs, compressed again with the
+ * strategy that saves identical sentences, one per line. */
+int recompress_main(int argc, char *argv[]) {
+    size_t jobs = default_jobs_num();
+    std::string filename;
+    if (!parse_verify_args(argc, argv, jobs, filename, true)) {
+        return 1;
+    }
+
+    try {
+        MappedFileTokenizer ft(filename);
+        Reader p(ft, true, true, jobs);
+        p.run();
+        LibraryImpl lib = p.get_library();
+        auto proofs = recompress_proofs(lib, ProofOperator::CS_BACKREFS_ON_IDENTICAL_SENTENCE, jobs);
+        for (size_t i = 0; i < proofs.size(); i++) {
+            if (proofs[i] == nullptr) {
+                continue;
+            }
+            std::cout << lib.resolve_label(LabTok(static_cast< LabTok::val_type >(i))) << " $= (";
+            for (const auto &ref : proofs[i]->get_refs()) {
+                std::cout << " " << lib.resolve_label(ref);
+            }
+            std::cout << " ) ";
+            CompressedEncoder enc;
+            for (const auto &code : proofs[i]->get_codes()) {
+                std::cout << enc.push_code(code);
+            }
+            std::cout << " $." << std::endl;
+        }
+    } catch (const ProofException< Sentence > &e) {
+        std::cerr << "An exception with message '" << e.get_reason() << "' was thrown!" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
+gio_static_block {
+    gio::register_main_function("recompress", recompress_main);
+}
@@ -0,0 +1,130 @@
+
+#include "asstable.h"
+
+#include <algorithm>
+
+#include <giolib/assert.h>
+
+AssertionTable::AssertionTable() : lib(nullptr), hyps_begin(1, 0), dists_begin(1, 0)
+{
+}
+
+AssertionTable::AssertionTable(const ExtendedLibrary &lib) : lib(&lib), hyps_begin(1, 0), dists_begin(1, 0)
+{
+    this->rows.resize(lib.get_labels_num() + 1, npos);
+    for (const Assertion &ass : lib.gen_assertions()) {
+        Row row = static_cast< Row >(this->theses.size());
+        this->rows[ass.get_thesis().val()] = row;
+        this->theses.push_back(ass.get_thesis());
+        this->numbers.push_back(ass.get_number());
+        this->flags.push_back(static_cast< uint8_t >((ass.is_theorem() ? THEOREM : 0) | (ass.has_proof() ? HAS_PROOF : 0) |
+                                                     (ass.is_modif_disc() ? MODIF_DISC : 0) | (ass.is_usage_disc() ? USAGE_DISC : 0)));
+
+        // Hypotheses are copied in order: float and essential ones keep the
+        // library's order, while optional ones come sorted from their std::set
+        this->hyps.insert(this->hyps.end(), ass.get_float_hyps().begin(), ass.get_float_hyps().end());
+        this->hyps.insert(this->hyps.end(), ass.get_ess_hyps().begin(), ass.get_ess_hyps().end());
+        this->hyps.insert(this->hyps.end(), ass.get_opt_hyps().begin(), ass.get_opt_hyps().end());
+        this->float_hyps_num.push_back(static_cast< uint32_t >(ass.get_float_hyps().size()));
+        this->ess_hyps_num.push_back(static_cast< uint32_t >(ass.get_ess_hyps().size()));
+        gio::assert_or_throw< std::overflow_error >(this->hyps.size() <= std::numeric_limits< uint32_t >::max(), "too many hypotheses for the assertion table");
+        this->hyps_begin.push_back(static_cast< uint32_t >(this->hyps.size()));
+
+        this->dists.insert(this->dists.end(), ass.get_mand_dists().begin(), ass.get_mand_dists().end());
+        this->dists.insert(this->dists.end(), ass.get_opt_dists().begin(), ass.get_opt_dists().end());
+        this->mand_dists_num.push_back(static_cast< uint32_t >(ass.get_mand_dists().size()));
+        gio::assert_or_throw< std::overflow_error >(this->dists.size() <= std::numeric_limits< uint32_t >::max(), "too many distinct variable constraints for the assertion table");
+        this->dists_begin.push_back(static_cast< uint32_t >(this->dists.size()));
+    }
+}
+
+size_t AssertionTable::size() const
+{
+    return this->theses.size();
+}
+
+AssertionTable::Row AssertionTable::get_row(LabTok label) const
+{
+    if (label.val() >= this->rows.size()) {
+        return npos;
+    }
+    return this->rows[label.val()];
+}
+
+LabTok AssertionTable::get_thesis(Row row) const
+{
+    return this->theses[row];
+}
+
+LabTok AssertionTable::get_number(Row row) const
+{
+    return this->numbers[row];
+}
+
+bool AssertionTable::is_theorem(Row row) const
+{
+    return (this->flags[row] & THEOREM) != 0;
+}
+
+bool AssertionTable::has_proof(Row row) const
+{
+    return (this->flags[row] & HAS_PROOF) != 0;
+}
+
+bool AssertionTable::is_modif_disc(Row row) const
+{
+    return (this->flags[row] & MODIF_DISC) != 0;
+}
+
+bool AssertionTable::is_usage_disc(Row row) const
+{
+    return (this->flags[row] & USAGE_DISC) != 0;
+}
+
+AssertionTable::LabSpan AssertionTable::get_float_hyps(Row row) const
+{
+    const LabTok *begin = this->hyps.data() + this->hyps_begin[row];
+    return LabSpan(begin, begin + this->float_hyps_num[row]);
+}
+
+AssertionTable::LabSpan AssertionTable::get_ess_hyps(Row row) const
+{
+    const LabTok *begin = this->hyps.data() + this->hyps_begin[row] + this->float_hyps_num[row];
+    return LabSpan(begin, begin + this->ess_hyps_num[row]);
+}
+
+AssertionTable::LabSpan AssertionTable::get_mand_hyps(Row row) const
+{
+    const LabTok *begin = this->hyps.data() + this->hyps_begin[row];
+    return LabSpan(begin, begin + this->float_hyps_num[row] + this->ess_hyps_num[row]);
+}
+
+AssertionTable::LabSpan AssertionTable::get_opt_hyps(Row row) const
+{
+    const LabTok *begin = this->hyps.data() + this->hyps_begin[row] + this->float_hyps_num[row] + this->ess_hyps_num[row];
+    return LabSpan(begin, this->hyps.data() + this->hyps_begin[row+1]);
+}
+
+AssertionTable::DistSpan AssertionTable::get_mand_dists(Row row) const
+{
+    const auto *begin = this->dists.data() + this->dists_begin[row];
+    return DistSpan(begin, begin + this->mand_dists_num[row]);
+}
+
+AssertionTable::DistSpan AssertionTable::get_opt_dists(Row row) const
+{
+    const auto *begin = this->dists.data() + this->dists_begin[row] + this->mand_dists_num[row];
+    return DistSpan(begin, this->dists.data() + this->dists_begin[row+1]);
+}
+
+bool AssertionTable::has_mand_dist(Row row, SymTok a, SymTok b) const
+{
+    // Pairs are stored ordered, as in StackFrame
+    auto span = this->get_mand_dists(row);
+    return std::binary_search(span.begin(), span.end(), std::pair< SymTok, SymTok >(std::minmax(a, b)));
+}
+
+const std::string &AssertionTable::get_comment(Row row) const
+{
+    return this->lib->get_assertion(this->theses[row]).get_comment();
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/range/iterator_range.hpp>
+
+#include "library.h"
+
+/* A structure-of-arrays copy of the valid assertions of a library, for code
+ * that walks many of them at once. Each assertion is a row of the table, rows
+ * following the order of the library's assertions. Scalar fields are stored
+ * in one vector each, while hypotheses and distinct variable constraints of
+ * all the assertions are packed in two vectors and each row refers to a span
+ * of them. Optional hypotheses and distinct variable constraints are sorted,
+ * so they can be binary searched or merged without building a std::set.
+ * Comments are not copied: get_comment() returns the one stored in the
+ * library, which must outlive the table.
+ */
+class AssertionTable {
+public:
+    typedef uint32_t Row;
+    static constexpr Row npos = std::numeric_limits< Row >::max();
+    typedef boost::iterator_range< const LabTok* > LabSpan;
+    typedef boost::iterator_range< const std::pair< SymTok, SymTok >* > DistSpan;
+
+    AssertionTable();
+    explicit AssertionTable(const ExtendedLibrary &lib);
+
+    size_t size() const;
+    // Return npos if label is not the thesis of a valid assertion
+    Row get_row(LabTok label) const;
+
+    LabTok get_thesis(Row row) const;
+    LabTok get_number(Row row) const;
+    bool is_theorem(Row row) const;
+    bool has_proof(Row row) const;
+    bool is_modif_disc(Row row) const;
+    bool is_usage_disc(Row row) const;
+
+    LabSpan get_float_hyps(Row row) const;
+    LabSpan get_ess_hyps(Row row) const;
+    // Floating hypotheses followed by essential ones, as in Assertion::get_mand_hyp()
+    LabSpan get_mand_hyps(Row row) const;
+    LabSpan get_opt_hyps(Row row) const;
+    DistSpan get_mand_dists(Row row) const;
+    DistSpan get_opt_dists(Row row) const;
+    bool has_mand_dist(Row row, SymTok a, SymTok b) const;
+
+    const std::string &get_comment(Row row) const;
+
+private:
+    enum Flags : uint8_t {
+        THEOREM = 1,
+        HAS_PROOF = 2,
+        MODIF_DISC = 4,
+        USAGE_DISC = 8,
+    };
+
+    const ExtendedLibrary *lib;
+    std::vector< Row > rows;
+    std::vector< LabTok > theses;
+    std::vector< LabTok > numbers;
+    std::vector< uint8_t > flags;
+
+    // For each row, floating, essential and optional hypotheses are stored
+    // one after the other in hyps, starting at hyps_begin[row]
+    std::vector< LabTok > hyps;
+    std::vector< uint32_t > hyps_begin;
+    std::vector< uint32_t > float_hyps_num;
+    std::vector< uint32_t > ess_hyps_num;
+
+    // Likewise for mandatory and optional distinct variable constraints
+    std::vector< std::pair< SymTok, SymTok > > dists;
+    std::vector< uint32_t > dists_begin;
+    std::vector< uint32_t > mand_dists_num;
+};
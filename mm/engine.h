@@ -1,7 +1,15 @@
 #pragma once
 
+#include <algorithm>
+#include <functional>
+#include <limits>
 #include <vector>
 #include <map>
+#include <set>
+#include <unordered_map>
+#include <tuple>
+
+#include <boost/functional/hash.hpp>
 
 #include <giolib/assert.h>
 #include <giolib/containers.h>
@@ -13,6 +21,11 @@
 
 //#define PROOF_VERBOSE_DEBUG
 
+/* A prover drives an engine to push one or more steps on its stack,
+ * returning false (and leaving the engine as it was) on failure */
+template<typename Engine>
+using Prover = std::function< bool(Engine&) >;
+
 template< typename SentType_ >
 struct ProofSentenceTraits;
 
@@ -20,7 +33,7 @@ template< typename SentType_ >
 struct ProofError {
     typedef ProofSentenceTraits< SentType_ > TraitsType;
     typedef typename TraitsType::SentType SentType;
-    typedef typename TraitsType::SubstMapType SubstMapType;
+    typedef typename TraitsType::ErrorSubstMapType SubstMapType;
     typedef typename TraitsType::VarType VarType;
 
     LabTok label;
@@ -68,33 +81,42 @@ struct ProofTree {
 };
 
 
-template< typename SentType_ >
-void propagate_dists(const Assertion &ass, const typename ProofSentenceTraits< SentType_ >::SubstMapType &subst_map, const typename ProofSentenceTraits< SentType_ >::LibType &lib,
-                     std::set< std::pair< typename ProofSentenceTraits< SentType_ >::VarType, typename ProofSentenceTraits< SentType_ >::VarType > > &dists) {
-    const auto &orig_dists = ass.get_mand_dists();
-    for (auto it1 = subst_map.begin(); it1 != subst_map.end(); it1++) {
-        for (auto it2 = subst_map.begin(); it2 != it1; it2++) {
-            auto &var1 = it1->first;
-            auto &var2 = it2->first;
-            auto &subst1 = it1->second;
-            auto &subst2 = it2->second;
-            if (orig_dists.find(std::minmax(ProofSentenceTraits< SentType_ >::var_to_sym(lib, var1), ProofSentenceTraits< SentType_ >::var_to_sym(lib, var2))) != orig_dists.end()) {
-                for (auto tok1 : ProofSentenceTraits< SentType_ >::get_variable_iterator(lib, subst1)) {
-                    if (!ProofSentenceTraits< SentType_ >::is_variable(lib, tok1)) {
-                        continue;
-                    }
-                    for (auto tok2 : ProofSentenceTraits< SentType_ >::get_variable_iterator(lib, subst2)) {
-                        if (!ProofSentenceTraits< SentType_ >::is_variable(lib, tok2)) {
-                            continue;
-                        }
-                        dists.insert(std::minmax(tok1, tok2));
-                    }
+/* Call func(tok1, tok2) for each pair of variables that have to be distinct
+ * because of the mandatory distinct variables constraints of ass, once the
+ * substitution subst_map is applied to them. The same pair may be reported
+ * more than once. */
+template< typename SentType_, typename Func >
+void for_each_propagated_dist(const Assertion &ass, const typename ProofSentenceTraits< SentType_ >::SubstMapType &subst_map, const typename ProofSentenceTraits< SentType_ >::LibType &lib, const Func &func) {
+    // Constraints are usually much fewer than the pairs of substituted variables, so we iterate on them
+    for (const auto &dist : ass.get_mand_dists()) {
+        auto it1 = subst_map.find(ProofSentenceTraits< SentType_ >::sym_to_var(lib, dist.first));
+        auto it2 = subst_map.find(ProofSentenceTraits< SentType_ >::sym_to_var(lib, dist.second));
+        if (it1 == subst_map.end() || it2 == subst_map.end()) {
+            continue;
+        }
+        for (auto tok1 : ProofSentenceTraits< SentType_ >::get_variable_iterator(lib, it1->second)) {
+            if (!ProofSentenceTraits< SentType_ >::is_variable(lib, tok1)) {
+                continue;
+            }
+            for (auto tok2 : ProofSentenceTraits< SentType_ >::get_variable_iterator(lib, it2->second)) {
+                if (!ProofSentenceTraits< SentType_ >::is_variable(lib, tok2)) {
+                    continue;
                 }
+                func(tok1, tok2);
             }
         }
     }
 }
 
+template< typename SentType_ >
+void propagate_dists(const Assertion &ass, const typename ProofSentenceTraits< SentType_ >::SubstMapType &subst_map, const typename ProofSentenceTraits< SentType_ >::LibType &lib,
+                     std::set< std::pair< typename ProofSentenceTraits< SentType_ >::VarType, typename ProofSentenceTraits< SentType_ >::VarType > > &dists) {
+    typedef typename ProofSentenceTraits< SentType_ >::VarType VarType;
+    for_each_propagated_dist< SentType_ >(ass, subst_map, lib, [&dists](VarType tok1, VarType tok2) {
+        dists.insert(std::minmax(tok1, tok2));
+    });
+}
+
 template< typename SentType_ >
 decltype(auto) propagate_dists(const Assertion &ass, const typename ProofSentenceTraits< SentType_ >::SubstMapType &subst_map, const typename ProofSentenceTraits< SentType_ >::LibType &lib) {
     std::set< std::pair< typename ProofSentenceTraits< SentType_ >::VarType, typename ProofSentenceTraits< SentType_ >::VarType > > dists;
@@ -102,8 +124,20 @@ decltype(auto) propagate_dists(const Assertion &ass, const typename ProofSentenc
     return dists;
 }
 
+/* An engine that can push again a step it built before, without building
+ * it again. Only when shares_steps() is true the proof that the engine
+ * builds refers back to the saved step, so that its result is the same as
+ * building the step again. */
+class StepSavingProofEngine {
+public:
+    virtual ~StepSavingProofEngine() = default;
+    virtual bool shares_steps() const = 0;
+    virtual size_t save_step() = 0;
+    virtual void process_saved_step(size_t step_num) = 0;
+};
+
 template< typename SentType_ >
-class ProofEngineBase {
+class ProofEngineBase : public StepSavingProofEngine {
 public:
     typedef ProofSentenceTraits< SentType_ > TraitsType;
     typedef typename TraitsType::SentType SentType;
@@ -113,7 +147,7 @@ public:
     typedef typename TraitsType::AdvLibType AdvLibType;
 
     ProofEngineBase(const LibType &lib, bool gen_proof_tree=false) :
-        lib(lib), gen_proof_tree(gen_proof_tree)
+        lib(lib), gen_proof_tree(gen_proof_tree), allowed_dists(nullptr)
     {
     }
 
@@ -134,11 +168,98 @@ public:
         return *(this->dists_stack.end()-1);
     }
 
+    /* If allowed_dists (a sorted vector, which must outlive the engine) is
+     * given, each distinct variables constraint generated by a step is
+     * immediately checked against it, instead of being accumulated in a set
+     * for each element of the stack; get_dists() then stays empty. This is
+     * what a verifier needs, since it knows in advance the constraints of
+     * the theorem it is checking. Sets are still built when a proof tree is
+     * requested, because each of its nodes carries them. */
+    void set_allowed_dists(const std::vector< std::pair< SymTok, SymTok > > *allowed_dists)
+    {
+        this->allowed_dists = allowed_dists;
+    }
+
+    /* When steps are shared, no uncompressed proof is kept and asking for
+     * it throws: use get_compressed_proof() instead. */
     const std::vector< LabTok > &get_proof_labels() const
     {
+        gio::assert_or_throw< std::logic_error >(!this->sharing(), "steps are shared, so there is no uncompressed proof");
         return this->proof;
     }
 
+    /* If share_steps is set, the engine remembers the steps it has built,
+     * identified by the label applied and the steps it was applied to. When
+     * the same step is built again, its result is reused without matching
+     * and substituting again, and the proof refers back to it instead of
+     * repeating it, so that both execution time and proof size scale with
+     * the number of distinct steps. Must be set while the stack is empty;
+     * it is ignored when generating a proof tree, since that is a tree. */
+    void set_share_steps(bool share_steps)
+    {
+        gio::assert_or_throw< std::logic_error >(this->stack.empty(), "step sharing must be set on an empty engine");
+        this->share_steps = share_steps;
+    }
+
+    /* Encode the proof built with shared steps as the refs and codes of a
+     * compressed proof of ass: steps that are used more than once are saved
+     * the first time and referenced afterwards. Hypotheses are not saved,
+     * since referring to them is as short as a back-reference. */
+    std::pair< std::vector< LabTok >, std::vector< CodeTok > > get_compressed_proof(const Assertion &ass) const
+    {
+        gio::assert_or_throw< std::logic_error >(this->share_steps && !this->gen_proof_tree, "steps are not shared");
+        std::vector< size_t > uses(this->steps.size(), 0);
+        std::unordered_map< LabTok, CodeTok::val_type > label_codes;
+        CodeTok::val_type mand_hyps_num = static_cast< CodeTok::val_type >(ass.get_mand_hyps_num());
+        for (size_t i = 0; i < ass.get_mand_hyps_num(); i++) {
+            label_codes[ass.get_mand_hyp(i)] = static_cast< CodeTok::val_type >(i + 1);
+        }
+        std::vector< LabTok > refs;
+        for (const size_t id : this->shared_proof) {
+            uses[id]++;
+            if (uses[id] == 1) {
+                LabTok label = std::get<0>(this->steps[id].key);
+                auto res = label_codes.insert(std::make_pair(label, static_cast< CodeTok::val_type >(mand_hyps_num + refs.size() + 1)));
+                if (res.second) {
+                    refs.push_back(label);
+                }
+            }
+        }
+        const CodeTok::val_type saved_base = static_cast< CodeTok::val_type >(mand_hyps_num + refs.size() + 1);
+        const size_t not_saved = std::numeric_limits< size_t >::max();
+        std::vector< size_t > saved(this->steps.size(), not_saved);
+        CodeTok::val_type saved_num = 0;
+        std::vector< CodeTok > codes;
+        for (const size_t id : this->shared_proof) {
+            if (saved[id] != not_saved) {
+                codes.push_back(CodeTok(static_cast< CodeTok::val_type >(saved_base + saved[id])));
+                continue;
+            }
+            const auto &key = this->steps[id].key;
+            codes.push_back(CodeTok(label_codes.at(std::get<0>(key))));
+            if (uses[id] > 1 && !std::get<1>(key).empty()) {
+                codes.push_back(CodeTok{});
+                saved[id] = saved_num++;
+            }
+        }
+        return std::make_pair(refs, codes);
+    }
+
+    // Number of items of the proof built with shared steps, where each
+    // reference to a step built before counts as one
+    size_t get_shared_proof_size() const
+    {
+        gio::assert_or_throw< std::logic_error >(this->share_steps && !this->gen_proof_tree, "steps are not shared");
+        return this->shared_proof.size();
+    }
+
+    // Position in the shared proof where the proof of each element of the
+    // stack begins
+    const std::vector< size_t > &get_stack_proof_begin() const
+    {
+        return this->stack_proof_begin;
+    }
+
     const ProofTree< SentType_ > &get_proof_tree() const
     {
         return this->proof_tree;
@@ -149,12 +270,25 @@ public:
         this->debug_output = debug_output;
     }
 
-    size_t save_step() {
+    bool shares_steps() const override {
+        return this->sharing();
+    }
+
+    size_t save_step() override {
         this->saved_steps.push_back(this->stack.back());
+        if (this->sharing()) {
+            this->saved_steps_ids.push_back(this->stack_steps.back());
+        }
         return this->saved_steps.size() - 1;
     }
 
-    void process_saved_step(size_t step_num) {
+    void process_saved_step(size_t step_num) override {
+        if (this->sharing()) {
+            const size_t id = this->saved_steps_ids.at(step_num);
+            this->push_stack(this->steps[id].sent, this->steps[id].dists);
+            this->push_shared_step(id, this->shared_proof.size());
+            return;
+        }
         this->process_sentence(this->saved_steps.at(step_num));
     }
 
@@ -164,6 +298,27 @@ protected:
         gio::assert_or_throw< ProofException< SentType_ > >(this->stack.size() >= child_ass.get_mand_hyps_num(), "Stack too small to pop hypotheses");
         const size_t stack_base = this->stack.size() - child_ass.get_mand_hyps_num();
         //this->dists.clear();
+
+        // If the same step was already built, just take the result; either
+        // way the proof of the step begins where the one of its first
+        // hypothesis does, which must be read before popping the stack
+        StepKey step_key;
+        size_t proof_begin = 0;
+        if (this->sharing()) {
+            step_key = StepKey(label, std::vector< size_t >(this->stack_steps.begin() + stack_base, this->stack_steps.end()));
+            proof_begin = this->stack_base_proof_pos(stack_base);
+            auto it = this->steps_index.find(step_key);
+            if (it != this->steps_index.end()) {
+                const size_t id = it->second;
+                this->stack_resize(stack_base);
+                this->shared_proof.resize(proof_begin);
+                this->push_stack(this->steps[id].sent, this->steps[id].dists);
+                this->push_shared_step(id, proof_begin);
+                return;
+            }
+        }
+
+        const bool track_dists = this->allowed_dists == nullptr || this->gen_proof_tree;
         std::set< std::pair< VarType, VarType > > dists;
 
         // Use the first num_floating hypotheses to build the substitution map
@@ -175,8 +330,10 @@ protected:
             assert(this->dists_stack.at(stack_base + i).empty());
             const SymTok subst_type = TraitsType::floating_to_type(this->lib, hyp);
             const SymTok stack_subst_type = TraitsType::sentence_to_type(this->lib, stack_hyp_sent);
-            ProofError<SentType_> err = { label, stack_hyp_sent, TraitsType::get_sentence(this->lib, hyp), subst_map };
-            gio::assert_or_throw< ProofException< SentType_ > >(subst_type == stack_subst_type, "Floating hypothesis does not match stack", err);
+            if (subst_type != stack_subst_type) {
+                ProofError<SentType_> err = { label, stack_hyp_sent, TraitsType::copy_sentence(this->lib, TraitsType::get_sentence(this->lib, hyp)), TraitsType::copy_subst_map(subst_map) };
+                throw ProofException< SentType_ >("Floating hypothesis does not match stack", err);
+            }
 #ifdef PROOF_VERBOSE_DEBUG
             if (stack_hyp_sent.size() == 1) {
                 cerr << "[" << this->debug_output << "] Matching an empty sentence" << endl;
@@ -193,9 +350,11 @@ protected:
 
         // Then parse the other hypotheses and check them
         for (auto &hyp : child_ass.get_ess_hyps()) {
-            const SentType &hyp_sent = TraitsType::get_sentence(this->lib, hyp);
+            const auto hyp_sent = TraitsType::get_sentence(this->lib, hyp);
             const SentType &stack_hyp_sent = this->stack.at(stack_base + i);
-            std::copy(this->dists_stack.at(stack_base + i).begin(), this->dists_stack.at(stack_base + i).end(), std::inserter(dists, dists.begin()));
+            if (track_dists) {
+                std::copy(this->dists_stack.at(stack_base + i).begin(), this->dists_stack.at(stack_base + i).end(), std::inserter(dists, dists.begin()));
+            }
             TraitsType::check_match(this->lib, label, stack_hyp_sent, hyp_sent, subst_map);
 #ifdef PROOF_VERBOSE_DEBUG
             cerr << "    Hypothesis:     " << print_sentence(hyp_sent, this->lib) << endl << "      matched with: " << print_sentence(stack_hyp_sent, this->lib) << endl;
@@ -204,18 +363,28 @@ protected:
         }
 
         // Keep track of the distinct variables constraints in the substitution map
-        propagate_dists< SentType_ >(child_ass, subst_map, this->lib, dists);
-        gio::assert_or_throw< ProofException< SentType_ > >(gio::has_no_diagonal(dists.begin(), dists.end()), "Distinct variable constraint violated");
+        if (track_dists) {
+            propagate_dists< SentType_ >(child_ass, subst_map, this->lib, dists);
+            gio::assert_or_throw< ProofException< SentType_ > >(gio::has_no_diagonal(dists.begin(), dists.end()), "Distinct variable constraint violated");
+        } else {
+            const auto &allowed = *this->allowed_dists;
+            for_each_propagated_dist< SentType_ >(child_ass, subst_map, this->lib, [this,&allowed](VarType tok1, VarType tok2) {
+                gio::assert_or_throw< ProofException< SentType_ > >(tok1 != tok2, "Distinct variable constraint violated");
+                const std::pair< SymTok, SymTok > dist = std::minmax(TraitsType::var_to_sym(this->lib, tok1), TraitsType::var_to_sym(this->lib, tok2));
+                gio::assert_or_throw< ProofException< SentType_ > >(std::binary_search(allowed.begin(), allowed.end(), dist), "Distinct variables constraints are too wide");
+            });
+        }
 
         // Build the thesis
         LabTok thesis = child_ass.get_thesis();
-        const SentType &thesis_sent = TraitsType::get_sentence(this->lib, thesis);
+        const auto thesis_sent = TraitsType::get_sentence(this->lib, thesis);
         SentType stack_thesis_sent = TraitsType::substitute(this->lib, thesis_sent, subst_map);
 #ifdef PROOF_VERBOSE_DEBUG
         cerr << "    Thesis:         " << print_sentence(thesis_sent, this->lib) << endl << "      becomes:      " << print_sentence(stack_thesis_sent, this->lib) << endl;
 #endif
 
-        // Finally do some popping and pushing
+        // Finally do some popping and pushing; the substitution map may refer
+        // to the popped sentences, so it must not be used after this point
 #ifdef PROOF_VERBOSE_DEBUG
         cerr << "    Popping from stack " << stack.size() - stack_base << " elements" << endl;
 #endif
@@ -223,7 +392,6 @@ protected:
 #ifdef PROOF_VERBOSE_DEBUG
         cerr << "    Pushing on stack: " << print_sentence(stack_thesis_sent, this->lib) << endl;
 #endif
-        this->push_stack(stack_thesis_sent, dists);
         if (this->gen_proof_tree) {
             // Mark as non essential all the hypotheses that are not
             for (auto it = this->tree_stack.begin() + stack_base; it != this->tree_stack.begin() + stack_base + child_ass.get_float_hyps().size(); it++) {
@@ -234,6 +402,12 @@ protected:
             this->proof_tree = { stack_thesis_sent, label, children, dists, true, child_ass.get_number() };
             this->tree_stack.push_back(this->proof_tree);
         }
+        if (this->sharing()) {
+            this->push_stack(std::move(stack_thesis_sent), std::move(dists));
+            this->push_shared_step(this->new_step(std::move(step_key)), proof_begin);
+            return;
+        }
+        this->push_stack(std::move(stack_thesis_sent), std::move(dists));
         this->proof.push_back(label);
     }
 
@@ -244,6 +418,13 @@ protected:
             this->proof_tree = { sent, label, {}, {}, true, {} };
             this->tree_stack.push_back(this->proof_tree);
         }
+        if (this->sharing()) {
+            StepKey step_key(label, {});
+            auto it = this->steps_index.find(step_key);
+            const size_t id = it != this->steps_index.end() ? it->second : this->new_step(std::move(step_key));
+            this->push_shared_step(id, this->shared_proof.size());
+            return;
+        }
         this->proof.push_back(label);
     }
 
@@ -275,14 +456,13 @@ protected:
 #ifdef PROOF_VERBOSE_DEBUG
             cerr << ", which is an hypothesis" << endl;
 #endif
-            const auto &sent = TraitsType::get_sentence(this->lib, label);
-            this->process_sentence(sent, label);
+            this->process_sentence(TraitsType::copy_sentence(this->lib, TraitsType::get_sentence(this->lib, label)), label);
         }
     }
 
     void checkpoint()
     {
-        this->checkpoints.emplace_back(this->stack.size(), this->proof.size(), this->saved_steps.size());
+        this->checkpoints.emplace_back(this->stack.size(), this->proof.size(), this->saved_steps.size(), this->shared_proof.size(), this->steps.size());
     }
 
     void commit()
@@ -294,8 +474,19 @@ protected:
     {
         this->stack.resize(std::get<0>(this->checkpoints.back()));
         this->dists_stack.resize(std::get<0>(this->checkpoints.back()));
+        if (this->sharing()) {
+            this->stack_steps.resize(std::get<0>(this->checkpoints.back()));
+            this->stack_proof_begin.resize(std::get<0>(this->checkpoints.back()));
+        }
         this->proof.resize(std::get<1>(this->checkpoints.back()));
         this->saved_steps.resize(std::get<2>(this->checkpoints.back()));
+        this->saved_steps_ids.resize(std::min(this->saved_steps_ids.size(), this->saved_steps.size()));
+        this->shared_proof.resize(std::get<3>(this->checkpoints.back()));
+        // Steps built after the checkpoint do not appear in the proof any more
+        while (this->steps.size() > std::get<4>(this->checkpoints.back())) {
+            this->steps_index.erase(this->steps.back().key);
+            this->steps.pop_back();
+        }
         this->checkpoints.pop_back();
     }
 
@@ -307,21 +498,63 @@ protected:
     }
 
 private:
-    void push_stack(const SentType &sent, const std::set<std::pair<VarType, VarType> > &dists)
+    // A step is identified by the label and the steps it was applied to
+    typedef std::pair< LabTok, std::vector< size_t > > StepKey;
+    struct SharedStep {
+        StepKey key;
+        SentType sent;
+        std::set< std::pair< VarType, VarType > > dists;
+    };
+
+    bool sharing() const
+    {
+        return this->share_steps && !this->gen_proof_tree;
+    }
+    // Position in the shared proof where the steps from stack_base upwards begin
+    size_t stack_base_proof_pos(size_t stack_base) const
     {
-        this->stack.push_back(sent);
-        this->dists_stack.push_back(dists);
+        return stack_base < this->stack_proof_begin.size() ? this->stack_proof_begin[stack_base] : this->shared_proof.size();
+    }
+    // Register the step on top of the stack
+    size_t new_step(StepKey &&key)
+    {
+        const size_t id = this->steps.size();
+        this->steps_index.insert(std::make_pair(key, id));
+        this->steps.push_back({std::move(key), this->stack.back(), this->dists_stack.back()});
+        return id;
+    }
+    // Record that the step on top of the stack is step id, whose proof
+    // begins at proof_begin; its last item is id itself
+    void push_shared_step(size_t id, size_t proof_begin)
+    {
+        this->stack_steps.push_back(id);
+        this->stack_proof_begin.push_back(proof_begin);
+        this->shared_proof.push_back(id);
+    }
+
+    void push_stack(SentType sent, std::set<std::pair<VarType, VarType> > dists)
+    {
+        this->stack.push_back(std::move(sent));
+        this->dists_stack.push_back(std::move(dists));
     }
     void stack_resize(size_t size)
     {
         this->stack.resize(size);
         this->dists_stack.resize(size);
+        if (this->sharing()) {
+            this->stack_steps.resize(size);
+            this->stack_proof_begin.resize(size);
+        }
         this->check_stack_underflow();
     }
     void pop_stack()
     {
         this->stack.pop_back();
         this->dists_stack.pop_back();
+        if (this->sharing()) {
+            this->stack_steps.pop_back();
+            this->stack_proof_begin.pop_back();
+        }
         this->check_stack_underflow();
     }
     void check_stack_underflow()
@@ -333,6 +566,7 @@ private:
 
     const LibType &lib;
     bool gen_proof_tree;
+    const std::vector< std::pair< SymTok, SymTok > > *allowed_dists;
     std::vector< SentType > stack;
     std::vector< std::set< std::pair< VarType, VarType > > > dists_stack;
     std::vector< SentType > saved_steps;
@@ -341,8 +575,18 @@ private:
     //std::set< std::pair< SymTok, SymTok > > dists;
     std::vector< LabTok > proof;
     //std::vector< std::tuple< size_t, std::set< std::pair< SymTok, SymTok > >, size_t > > checkpoints;
-    std::vector< std::tuple< size_t, size_t, size_t > > checkpoints;
+    std::vector< std::tuple< size_t, size_t, size_t, size_t, size_t > > checkpoints;
     std::string debug_output;
+
+    bool share_steps = false;
+    std::vector< SharedStep > steps;
+    std::unordered_map< StepKey, size_t, boost::hash< StepKey > > steps_index;
+    // For each element of the stack, its step and where its proof begins
+    std::vector< size_t > stack_steps;
+    std::vector< size_t > stack_proof_begin;
+    std::vector< size_t > saved_steps_ids;
+    // The proof as a sequence of steps, each appearing after those it uses
+    std::vector< size_t > shared_proof;
 };
 
 class ProofEngine {
@@ -1,7 +1,7 @@
 
 #include "funds.h"
 
-void collect_variables(const Sentence &sent, const std::function<bool (SymTok)> &is_var, std::set<SymTok> &vars) {
+void collect_variables(SentenceView sent, const std::function<bool (SymTok)> &is_var, std::set<SymTok> &vars) {
     for (const auto tok : sent) {
         if (is_var(tok)) {
             vars.insert(tok);
@@ -9,7 +9,7 @@ void collect_variables(const Sentence &sent, const std::function<bool (SymTok)>
     }
 }
 
-Sentence substitute(const Sentence &orig, const std::unordered_map<SymTok, std::vector<SymTok> > &subst_map, const std::function< bool(SymTok) > &is_var)
+Sentence substitute(SentenceView orig, const std::unordered_map<SymTok, std::vector<SymTok> > &subst_map, const std::function< bool(SymTok) > &is_var)
 {
     std::vector< SymTok > ret;
     for (auto it = orig.begin(); it != orig.end(); it++) {
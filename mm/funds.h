@@ -6,6 +6,8 @@
 #include <cstdint>
 #include <numeric>
 #include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
 
 #include <boost/functional/hash.hpp>
 
@@ -31,7 +33,7 @@ public: \
     T() : val_() {} \
     explicit T(const N val) : val_(val) {} \
     T &operator=(const N &x) { this->val_ = x; return *this; } \
-    T &operator=(const T &x) { this->val_ = x.val_; return *this; } \
+    T &operator=(const T &x) = default; \
     bool operator==(const T &x) const { return this->val_ == x.val_; } \
     bool operator!=(const T &x) const { return this->val_ != x.val_; } \
     bool operator<(const T &x) const { return this->val_ < x.val_; } \
@@ -90,6 +92,36 @@ TOK_TYPEDEF(uint32_t, CodeTok)
 typedef std::vector< SymTok > Sentence;
 typedef std::vector< LabTok > Procedure;
 
+/* A read-only view of a sentence stored somewhere else, such as in the
+ * packed storage of LibraryImpl. */
+class SentenceView {
+public:
+    SentenceView() : data_(nullptr), size_(0) {}
+    SentenceView(const SymTok *data, size_t size) : data_(data), size_(size) {}
+    SentenceView(const Sentence &sent) : data_(sent.data()), size_(sent.size()) {}
+    const SymTok *data() const { return this->data_; }
+    size_t size() const { return this->size_; }
+    bool empty() const { return this->size_ == 0; }
+    const SymTok *begin() const { return this->data_; }
+    const SymTok *end() const { return this->data_ + this->size_; }
+    const SymTok &operator[](size_t i) const { return this->data_[i]; }
+    const SymTok &at(size_t i) const {
+        if (i >= this->size_) {
+            throw std::out_of_range("SentenceView::at");
+        }
+        return this->data_[i];
+    }
+    const SymTok &front() const { return this->data_[0]; }
+    const SymTok &back() const { return this->data_[this->size_-1]; }
+    Sentence to_sentence() const { return Sentence(this->begin(), this->end()); }
+    bool operator==(const SentenceView &x) const { return std::equal(this->begin(), this->end(), x.begin(), x.end()); }
+    bool operator!=(const SentenceView &x) const { return !this->operator==(x); }
+
+private:
+    const SymTok *data_;
+    size_t size_;
+};
+
 // See https://stackoverflow.com/a/27443191
 const CodeTok INVALID_CODE = CodeTok(std::numeric_limits< CodeTok::val_type >::max());
 
@@ -97,8 +129,8 @@ class MMPPParsingError : public std::runtime_error {
     using std::runtime_error::runtime_error;
 };
 
-void collect_variables(const Sentence &sent, const std::function< bool(SymTok) > &is_var, std::set< SymTok > &vars);
-Sentence substitute(const Sentence &orig, const std::unordered_map<SymTok, std::vector<SymTok> > &subst_map, const std::function<bool(SymTok)> &is_var);
+void collect_variables(SentenceView sent, const std::function< bool(SymTok) > &is_var, std::set< SymTok > &vars);
+Sentence substitute(SentenceView orig, const std::unordered_map<SymTok, std::vector<SymTok> > &subst_map, const std::function<bool(SymTok)> &is_var);
 
 inline static bool is_ascii(char c) {
     return c > 32 && c < 127;
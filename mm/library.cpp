@@ -8,6 +8,7 @@
 #include "proof.h"
 #include "utils/utils.h"
 #include "reader.h"
+#include "snapshot.h"
 
 LibraryImpl::LibraryImpl()
 {
@@ -38,7 +39,8 @@ LabTok LibraryImpl::create_label(std::string s)
         throw std::runtime_error("creating an already existing label");
     }
     //cerr << "Resizing from " << this->assertions.size() << " to " << res+1 << endl;
-    this->sentences.resize(res.val()+1);
+    this->detach_snapshot();
+    this->sentences_spans.resize(res.val()+1);
     this->sentence_types.resize(res.val()+1);
     this->assertions.resize(res.val()+1);
     return res;
@@ -86,22 +88,25 @@ const std::unordered_map<LabTok, std::string> &LibraryImpl::get_labels() const
 
 void LibraryImpl::add_sentence(LabTok label, const Sentence &content, SentenceType type) {
     //this->sentences.insert(make_pair(label, content));
-    assert(label.val() < this->sentences.size());
-    this->sentences[label.val()] = content;
+    this->detach_snapshot();
+    assert(label.val() < this->sentences_spans.size());
+    auto &span = this->sentences_spans[label.val()];
+    if (span.second == content.size()) {
+        std::copy(content.begin(), content.end(), this->sentences_tokens.begin() + static_cast< std::ptrdiff_t >(span.first));
+    } else {
+        span = std::make_pair(this->sentences_tokens.size(), content.size());
+        this->sentences_tokens.insert(this->sentences_tokens.end(), content.begin(), content.end());
+    }
     this->sentence_types[label.val()] = type;
 }
 
-const Sentence &LibraryImpl::get_sentence(LabTok label) const {
-    return this->sentences.at(label.val());
-}
-
-const Sentence *LibraryImpl::get_sentence_ptr(LabTok label) const
+SentenceView LibraryImpl::get_sentence_view(LabTok label) const
 {
-    if (label.val() < this->sentences.size()) {
-        return &this->sentences[label.val()];
-    } else {
-        return nullptr;
+    if (this->snapshot != nullptr) {
+        return this->snapshot->get_sentence_view(label);
     }
+    const auto &span = this->sentences_spans.at(label.val());
+    return SentenceView(this->sentences_tokens.data() + span.first, span.second);
 }
 
 SentenceType LibraryImpl::get_sentence_type(LabTok label) const
@@ -111,16 +116,23 @@ SentenceType LibraryImpl::get_sentence_type(LabTok label) const
 
 void LibraryImpl::add_assertion(LabTok label, const Assertion &ass)
 {
+    this->detach_snapshot();
     this->assertions[label.val()] = ass;
 }
 
 const Assertion &LibraryImpl::get_assertion(LabTok label) const
 {
+    if (this->snapshot != nullptr) {
+        return this->snapshot->get_assertion(label);
+    }
     return this->assertions.at(label.val());
 }
 
 const Assertion *LibraryImpl::get_assertion_ptr(LabTok label) const
 {
+    if (this->snapshot != nullptr) {
+        return label.val() < this->snapshot->size() ? &this->snapshot->get_assertion(label) : nullptr;
+    }
     if (label.val() < this->assertions.size()) {
         return &this->assertions[label.val()];
     } else {
@@ -128,19 +140,37 @@ const Assertion *LibraryImpl::get_assertion_ptr(LabTok label) const
     }
 }
 
-const std::vector<Sentence> &LibraryImpl::get_sentences() const
+const std::vector<SentenceType> &LibraryImpl::get_sentence_types() const
 {
-    return this->sentences;
+    return this->sentence_types;
 }
 
-const std::vector<SentenceType> &LibraryImpl::get_sentence_types() const
+void LibraryImpl::detach_snapshot()
 {
-    return this->sentence_types;
+    if (this->snapshot == nullptr) {
+        return;
+    }
+    auto snapshot = std::move(this->snapshot);
+    this->snapshot = nullptr;
+    this->sentences_spans.resize(snapshot->size());
+    for (size_t i = 0; i < snapshot->size(); i++) {
+        auto sent = snapshot->get_sentence_view(LabTok(static_cast< LabTok::val_type >(i)));
+        this->sentences_spans[i] = std::make_pair(this->sentences_tokens.size(), sent.size());
+        this->sentences_tokens.insert(this->sentences_tokens.end(), sent.begin(), sent.end());
+    }
+    this->assertions.clear();
+    this->assertions.reserve(snapshot->size());
+    for (size_t i = 0; i < snapshot->size(); i++) {
+        this->assertions.push_back(snapshot->get_assertion(LabTok(static_cast< LabTok::val_type >(i))));
+    }
 }
 
-const std::vector<Assertion> &LibraryImpl::get_assertions() const
+size_t LibraryImpl::get_slots_num() const
 {
-    return this->assertions;
+    if (this->snapshot != nullptr) {
+        return this->snapshot->size();
+    }
+    return this->sentences_spans.size();
 }
 
 void LibraryImpl::set_constant(SymTok c, bool is_const)
@@ -236,33 +266,36 @@ const ParsingAddendumImpl &LibraryImpl::get_parsing_addendum() const
 
 class AssertionGenerator {
 public:
-    AssertionGenerator(const std::vector< Assertion > &ref) :
-        it(ref.begin()), ref(ref) {
+    AssertionGenerator(const LibraryImpl &lib, size_t slots_num) :
+        lib(lib), slots_num(slots_num) {
     }
     const Assertion *operator()() {
-        while (this->it != this->ref.end()) {
-            auto it2 = this->it;
-            this->it++;
-            if (it2->is_valid()) {
-                return &*it2;
+        while (this->idx < this->slots_num) {
+            const Assertion &ass = this->lib.get_assertion(LabTok(static_cast< LabTok::val_type >(this->idx)));
+            this->idx++;
+            if (ass.is_valid()) {
+                return &ass;
             }
         }
         return nullptr;
     }
 
 private:
-    std::vector< Assertion >::const_iterator it;
-    const std::vector< Assertion > &ref;
+    const LibraryImpl &lib;
+    size_t slots_num;
+    size_t idx = 0;
 };
 
 std::function<const Assertion *()> LibraryImpl::list_assertions() const {
-    return AssertionGenerator(this->assertions);
+    return AssertionGenerator(*this, this->get_slots_num());
 }
 
 Generator<std::reference_wrapper<const Assertion> > LibraryImpl::gen_assertions() const
 {
     return Generator< std::reference_wrapper< const Assertion > >([this](auto &sink) {
-        for (const auto &ass : this->assertions) {
+        const size_t slots_num = this->get_slots_num();
+        for (size_t i = 0; i < slots_num; i++) {
+            const auto &ass = this->get_assertion(LabTok(static_cast< LabTok::val_type >(i)));
             if (ass.is_valid()) {
                 sink(std::cref(ass));
             }
@@ -290,6 +323,11 @@ void LibraryImpl::set_parsing_addendum(const ParsingAddendumImpl &add)
     this->parsing_addendum = add;
 }
 
+Sentence Library::get_sentence(LabTok label) const
+{
+    return this->get_sentence_view(label).to_sentence();
+}
+
 bool Library::is_immutable() const
 {
     return false;
@@ -299,6 +337,16 @@ Library::~Library()
 {
 }
 
+std::vector< Assertion > ExtendedLibrary::get_assertions() const
+{
+    std::vector< Assertion > ret;
+    ret.reserve(this->get_labels_num() + 1);
+    for (LabTok::val_type i = 0; i <= this->get_labels_num(); i++) {
+        ret.push_back(this->get_assertion(LabTok(i)));
+    }
+    return ret;
+}
+
 std::string fix_htmlcss_for_qt(std::string s)
 {
     std::string tmp(s);
@@ -56,6 +56,7 @@ public:
 
 class LibraryAddendumImpl : public ExtendedLibraryAddendum {
     friend class Reader;
+    friend class LibrarySnapshot;
 public:
     virtual const std::string &get_htmldef(SymTok tok) const override
     {
@@ -154,6 +155,7 @@ class ParsingAddendum {
 
 class ParsingAddendumImpl : public ParsingAddendum {
     friend class Reader;
+    friend class LibrarySnapshot;
 public:
     const std::map< SymTok, SymTok > &get_syntax() const override {
         return this->syntax;
@@ -282,7 +284,11 @@ public:
     virtual size_t get_symbols_num() const = 0;
     virtual size_t get_labels_num() const = 0;
     virtual bool is_constant(SymTok c) const = 0;
-    virtual const Sentence &get_sentence(LabTok label) const = 0;
+    /* The view points inside the library, so it is invalidated by the
+     * following changes to the library (for example add_sentence()). */
+    virtual SentenceView get_sentence_view(LabTok label) const = 0;
+    // A copy of the sentence, for callers that need to keep or modify it
+    Sentence get_sentence(LabTok label) const;
     virtual SentenceType get_sentence_type(LabTok label) const = 0;
     virtual const Assertion &get_assertion(LabTok label) const = 0;
     //virtual std::function< const Assertion*() > list_assertions() const = 0;
@@ -296,19 +302,23 @@ public:
 
 class ExtendedLibrary : public Library {
 public:
-    virtual const Sentence *get_sentence_ptr(LabTok label) const = 0;
     virtual const Assertion *get_assertion_ptr(LabTok label) const = 0;
     virtual const std::unordered_map< SymTok, std::string > &get_symbols() const = 0;
     virtual const std::unordered_map<LabTok, std::string> &get_labels() const = 0;
-    virtual const std::vector< Sentence > &get_sentences() const = 0;
     virtual const std::vector< SentenceType > &get_sentence_types() const = 0;
-    virtual const std::vector< Assertion > &get_assertions() const = 0;
+    /* A copy of all the assertions, indexed by label; gen_assertions() and
+     * get_assertion() read them without copying, which is much cheaper when
+     * the library is backed by a snapshot. */
+    std::vector< Assertion > get_assertions() const;
     const ExtendedLibraryAddendum &get_addendum() const = 0;
     virtual LabTok get_max_number() const = 0;
 };
 
+class LibrarySnapshotData;
+
 class LibraryImpl final : public ExtendedLibrary
 {
+    friend class LibrarySnapshot;
 public:
     LibraryImpl();
     SymTok get_symbol(std::string s) const override;
@@ -319,14 +329,11 @@ public:
     size_t get_labels_num() const override;
     const std::unordered_map< SymTok, std::string > &get_symbols() const override;
     const std::unordered_map<LabTok, std::string> &get_labels() const override;
-    const Sentence &get_sentence(LabTok label) const override;
-    const Sentence *get_sentence_ptr(LabTok label) const override;
+    SentenceView get_sentence_view(LabTok label) const override;
     SentenceType get_sentence_type(LabTok label) const override;
     const Assertion &get_assertion(LabTok label) const override;
     const Assertion *get_assertion_ptr(LabTok label) const override;
-    const std::vector< Sentence > &get_sentences() const override;
     const std::vector< SentenceType > &get_sentence_types() const override;
-    const std::vector< Assertion > &get_assertions() const override;
     bool is_constant(SymTok c) const override;
     const StackFrame &get_final_stack_frame() const override;
     const LibraryAddendumImpl &get_addendum() const override;
@@ -339,6 +346,9 @@ public:
     SymTok create_symbol(std::string s);
     SymTok create_or_get_symbol(std::string s);
     LabTok create_label(std::string s);
+    /* A sentence given again for the same label is overwritten in place if
+     * it has the same length, and otherwise packed anew; packed tokens are
+     * never released, so in the latter case the old ones are left behind. */
     void add_sentence(LabTok label, const Sentence &content, SentenceType type);
     void add_assertion(LabTok label, const Assertion &ass);
     void set_constant(SymTok c, bool is_const);
@@ -356,10 +366,23 @@ private:
 
     // vector is more efficient than unordered_map if labels are known to be contiguous and starting from 1; in the general case the unordered_map might be better
     //std::unordered_map< LabTok, std::vector< SymTok > > sentences;
-    std::vector< Sentence > sentences;
+    /* Sentences are packed in a single vector of tokens, each label being
+     * mapped to its offset and length; get_sentence_view() gives direct
+     * access to them, so loading does not allocate a vector for each
+     * sentence. */
+    std::vector< SymTok > sentences_tokens;
+    std::vector< std::pair< size_t, size_t > > sentences_spans;
     std::vector< SentenceType > sentence_types;
     std::vector< Assertion > assertions;
 
+    /* A library loaded from a snapshot serves sentences and assertions
+     * directly from it, instead of filling the members above; the first
+     * change to them copies everything out of the snapshot. */
+    std::shared_ptr< const LibrarySnapshotData > snapshot;
+    void detach_snapshot();
+    // Size of the tables indexed by label (one more than the labels, if any)
+    size_t get_slots_num() const;
+
     StackFrame final_stack_frame;
     LibraryAddendumImpl addendum;
     ParsingAddendumImpl parsing_addendum;
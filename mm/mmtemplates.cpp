@@ -7,6 +7,7 @@ template class std::vector< CodeTok >;
 
 template class LRParser< SymTok, LabTok >;
 template class LRParsingHelper< SymTok, LabTok >;
+template class LRTable< SymTok, LabTok >;
 
 template class UnilateralUnificator< SymTok, LabTok >;
 template class BilateralUnificator< SymTok, LabTok >;
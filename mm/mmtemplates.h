@@ -10,6 +10,7 @@ extern template class std::vector< CodeTok >;
 
 extern template class LRParser< SymTok, LabTok >;
 extern template class LRParsingHelper< SymTok, LabTok >;
+extern template class LRTable< SymTok, LabTok >;
 
 extern template class UnilateralUnificator< SymTok, LabTok >;
 extern template class BilateralUnificator< SymTok, LabTok >;
@@ -8,6 +8,7 @@
 #include <unordered_map>
 
 #include "utils/utils.h"
+#include "utils/parallel.h"
 #include "library.h"
 
 const size_t max_decompression_size = 1024 * 1024;
@@ -26,6 +27,11 @@ std::shared_ptr<ProofOperator> CompressedProof::get_operator(const Library &lib,
     return std::make_shared< CompressedProofOperator >(lib, ass, *this);
 }
 
+void CompressedProof::verify(const Library &lib, const Assertion &ass) const
+{
+    CompressedProofVerifier(lib, ass, *this).verify();
+}
+
 const std::vector<LabTok> &CompressedProof::get_refs() const
 {
     return this->refs;
@@ -41,9 +47,21 @@ const CompressedProof CompressedProofOperator::compress(CompressionStrategy stra
     if (strategy == CS_ANY) {
         return this->proof;
     } else {
-        // If we want to recompress with a specified strategy, then we uncompress and compress again
-        // TODO Implement a direct algorithm
-        return this->uncompress().get_operator(this->lib, this->ass)->compress(strategy);
+        // Rebuild the proof graph from the codes, without expanding them
+        ProofDag dag(this->lib, this->ass);
+        for (const auto &code : this->proof.get_codes()) {
+            if (code == CodeTok{}) {
+                dag.save_step();
+            } else if (code.val() <= this->ass.get_mand_hyps_num()) {
+                dag.push_label(this->ass.get_mand_hyp(code.val()-1));
+            } else if (code.val() <= this->ass.get_mand_hyps_num() + this->proof.get_refs().size()) {
+                dag.push_label(this->proof.get_refs().at(code.val()-this->ass.get_mand_hyps_num()-1));
+            } else {
+                gio::assert_or_throw< ProofException< Sentence > >(code.val() <= this->ass.get_mand_hyps_num() + this->proof.get_refs().size() + dag.get_saved_steps_num(), "Code too big in compressed proof");
+                dag.push_saved_step(code.val()-this->ass.get_mand_hyps_num()-this->proof.get_refs().size()-1);
+            }
+        }
+        return dag.encode(strategy);
     }
 }
 
@@ -146,6 +164,11 @@ std::shared_ptr<ProofOperator> UncompressedProof::get_operator(const Library &li
     return std::make_shared< UncompressedProofOperator >(lib, ass, *this);
 }
 
+void UncompressedProof::verify(const Library &lib, const Assertion &ass) const
+{
+    this->get_executor< Sentence >(lib, ass)->execute();
+}
+
 const std::vector<LabTok> &UncompressedProof::get_labels() const
 {
     return this->labels;
@@ -246,7 +269,11 @@ const CompressedProof UncompressedProofOperator::compress(CompressionStrategy st
         sents.clear();
         compress_unwind_proof_tree_phase2(tree, label_map, refs, sents, dupl_sents, dupl_sents_map, codes, code_idx);
     } else if (strategy == CS_BACKREFS_ON_IDENTICAL_TREE) {
-        throw std::runtime_error("Strategy not implemented yet");
+        ProofDag dag(this->lib, this->ass);
+        for (const auto &label : this->proof.get_labels()) {
+            dag.push_label(label);
+        }
+        return dag.encode(strategy);
     } else {
         throw std::runtime_error("Strategy does not exist");
     }
@@ -286,6 +313,273 @@ bool UncompressedProofOperator::is_trivial() const
     return true;
 }
 
+CompressedProofVerifier::CompressedProofVerifier(const Library &lib, const Assertion &ass, const CompressedProof &proof) :
+    lib(lib), ass(ass), proof(proof)
+{
+    const auto dists = this->ass.get_dists();
+    this->allowed_dists.assign(dists.begin(), dists.end());
+}
+
+void CompressedProofVerifier::verify()
+{
+    const size_t hyps_num = this->ass.get_mand_hyps_num();
+    const auto &refs = this->proof.get_refs();
+    for (const auto &code : this->proof.get_codes()) {
+        if (code == CodeTok{}) {
+            gio::assert_or_throw< ProofException< Sentence > >(!this->stack.empty(), "Saving a step with an empty stack in compressed proof");
+            const auto &entry = this->stack.back();
+            if (entry.slot != no_slot) {
+                this->slot_saved[entry.slot] = true;
+            }
+            this->saved.push_back(entry);
+        } else if (code.val() <= hyps_num) {
+            this->process_label(this->ass.get_mand_hyp(code.val()-1));
+        } else if (code.val() <= hyps_num + refs.size()) {
+            this->process_label(refs[code.val()-hyps_num-1]);
+        } else {
+            const size_t idx = code.val() - hyps_num - refs.size() - 1;
+            gio::assert_or_throw< ProofException< Sentence > >(idx < this->saved.size(), "Code too big in compressed proof");
+            this->stack.push_back(this->saved[idx]);
+        }
+    }
+    gio::assert_or_throw< ProofException< Sentence > >(this->stack.size() == 1, "Proof execution did not end with a single element on the stack");
+    gio::assert_or_throw< ProofException< Sentence > >(this->stack[0].sent == this->lib.get_sentence_view(this->ass.get_thesis()), "Proof does not prove the thesis");
+}
+
+void CompressedProofVerifier::process_label(LabTok label)
+{
+    const Assertion *child_ass = nullptr;
+    try {
+        child_ass = &this->lib.get_assertion(label);
+    } catch (std::out_of_range&) {
+    }
+    if (child_ass != nullptr && child_ass->is_valid()) {
+        this->process_assertion(*child_ass, label);
+    } else {
+        gio::assert_or_throw< ProofException< Sentence > >(find(this->ass.get_float_hyps().begin(), this->ass.get_float_hyps().end(), label) != this->ass.get_float_hyps().end() ||
+                                                           find(this->ass.get_ess_hyps().begin(), this->ass.get_ess_hyps().end(), label) != this->ass.get_ess_hyps().end() ||
+                                                           this->ass.get_opt_hyps().find(label) != this->ass.get_opt_hyps().end(),
+                                                           "Requested label cannot be used by this theorem");
+        this->stack.push_back({ this->lib.get_sentence_view(label), no_slot });
+    }
+}
+
+void CompressedProofVerifier::process_assertion(const Assertion &child_ass, LabTok label)
+{
+    gio::assert_or_throw< ProofException< Sentence > >(this->stack.size() >= child_ass.get_mand_hyps_num(), "Stack too small to pop hypotheses");
+    const size_t stack_base = this->stack.size() - child_ass.get_mand_hyps_num();
+    this->subst_map.clear();
+    size_t i = stack_base;
+    for (const auto hyp : child_ass.get_float_hyps()) {
+        const SentenceView hyp_sent = this->lib.get_sentence_view(hyp);
+        const SentenceView stack_sent = this->stack[i].sent;
+        if (stack_sent.empty() || stack_sent[0] != hyp_sent.at(0)) {
+            throw ProofException< Sentence >("Floating hypothesis does not match stack", { label, stack_sent.to_sentence(), hyp_sent.to_sentence(), TraitsType::copy_subst_map(this->subst_map) });
+        }
+        this->subst_map.insert(std::make_pair(hyp_sent.at(1), stack_sent));
+        i++;
+    }
+    for (const auto hyp : child_ass.get_ess_hyps()) {
+        TraitsType::check_match(this->lib, label, this->stack[i].sent, this->lib.get_sentence_view(hyp), this->subst_map);
+        i++;
+    }
+    for_each_propagated_dist< Sentence >(child_ass, this->subst_map, this->lib, [this](SymTok tok1, SymTok tok2) {
+        gio::assert_or_throw< ProofException< Sentence > >(tok1 != tok2, "Distinct variable constraint violated");
+        gio::assert_or_throw< ProofException< Sentence > >(std::binary_search(this->allowed_dists.begin(), this->allowed_dists.end(), std::pair< SymTok, SymTok >(std::minmax(tok1, tok2))),
+                                                           "Distinct variables constraints are too wide");
+    });
+
+    // The result is written before the hypotheses' slots are released, since the substitution map refers to them
+    const uint32_t slot = this->new_slot();
+    TraitsType::substitute_into(this->lib, this->lib.get_sentence_view(child_ass.get_thesis()), this->subst_map, this->slots[slot]);
+    for (size_t j = stack_base; j < this->stack.size(); j++) {
+        const uint32_t old_slot = this->stack[j].slot;
+        if (old_slot != no_slot && !this->slot_saved[old_slot]) {
+            this->free_slots.push_back(old_slot);
+        }
+    }
+    this->stack.resize(stack_base);
+    this->stack.push_back({ this->slots[slot], slot });
+}
+
+uint32_t CompressedProofVerifier::new_slot()
+{
+    if (!this->free_slots.empty()) {
+        uint32_t slot = this->free_slots.back();
+        this->free_slots.pop_back();
+        return slot;
+    }
+    // Moving the sentences when the pool grows does not invalidate the views to their data
+    this->slots.emplace_back();
+    this->slot_saved.push_back(false);
+    return static_cast< uint32_t >(this->slots.size() - 1);
+}
+
+ProofDag::ProofDag(const Library &lib, const Assertion &ass) :
+    lib(lib), ass(ass)
+{
+}
+
+void ProofDag::push_label(LabTok label)
+{
+    const Assertion &child_ass = this->lib.get_assertion(label);
+    const size_t hyps_num = child_ass.is_valid() ? child_ass.get_mand_hyps_num() : 0;
+    gio::assert_or_throw< ProofException< Sentence > >(this->stack.size() >= hyps_num, "Stack too small to pop hypotheses");
+    Node node(label, std::vector< size_t >(this->stack.end() - static_cast< std::ptrdiff_t >(hyps_num), this->stack.end()));
+    this->stack.resize(this->stack.size() - hyps_num);
+    // Elements of an unordered_map do not move, so keys can be pointed to
+    auto res = this->nodes_index.insert(std::make_pair(std::move(node), this->nodes.size()));
+    if (res.second) {
+        this->nodes.push_back(&res.first->first);
+    }
+    this->stack.push_back(res.first->second);
+}
+
+void ProofDag::save_step()
+{
+    gio::assert_or_throw< ProofException< Sentence > >(!this->stack.empty(), "Cannot save a step from an empty stack");
+    this->saved.push_back(this->stack.back());
+}
+
+void ProofDag::push_saved_step(size_t idx)
+{
+    gio::assert_or_throw< ProofException< Sentence > >(idx < this->saved.size(), "Code too big in compressed proof");
+    this->stack.push_back(this->saved[idx]);
+}
+
+size_t ProofDag::get_saved_steps_num() const
+{
+    return this->saved.size();
+}
+
+std::vector< Sentence > ProofDag::compute_sentences() const
+{
+    typedef ProofSentenceTraits< Sentence > TraitsType;
+    std::vector< Sentence > sents(this->nodes.size());
+    for (size_t id = 0; id < this->nodes.size(); id++) {
+        const Node &node = *this->nodes[id];
+        const Assertion &child_ass = this->lib.get_assertion(node.first);
+        if (!child_ass.is_valid()) {
+            sents[id] = TraitsType::copy_sentence(this->lib, TraitsType::get_sentence(this->lib, node.first));
+            continue;
+        }
+        TraitsType::SubstMapType subst_map;
+        size_t i = 0;
+        for (const auto &hyp : child_ass.get_float_hyps()) {
+            subst_map.insert(std::make_pair(TraitsType::floating_to_var(this->lib, hyp), TraitsType::sentence_to_subst(this->lib, sents[node.second[i]])));
+            i++;
+        }
+        sents[id] = TraitsType::substitute(this->lib, TraitsType::get_sentence(this->lib, child_ass.get_thesis()), subst_map);
+    }
+    return sents;
+}
+
+CompressedProof ProofDag::encode(ProofOperator::CompressionStrategy strategy) const
+{
+    gio::assert_or_throw< ProofException< Sentence > >(this->stack.size() == 1, "Proof execution did not end with a single element on the stack");
+    const size_t root = this->stack.back();
+
+    // Subproofs that are equal according to the strategy get the same key;
+    // without back-references they are never pruned and keys do not matter
+    const bool backrefs = strategy != ProofOperator::CS_NO_BACKREFS;
+    std::vector< size_t > keys(this->nodes.size());
+    if (strategy == ProofOperator::CS_BACKREFS_ON_IDENTICAL_SENTENCE || strategy == ProofOperator::CS_ANY) {
+        std::unordered_map< Sentence, size_t, boost::hash< Sentence > > sent_keys;
+        auto sents = this->compute_sentences();
+        for (size_t id = 0; id < this->nodes.size(); id++) {
+            keys[id] = sent_keys.insert(std::make_pair(std::move(sents[id]), sent_keys.size())).first->second;
+        }
+    } else {
+        for (size_t id = 0; id < this->nodes.size(); id++) {
+            keys[id] = id;
+        }
+    }
+
+    // Same two phases as compress_unwind_proof_tree_phase1() and
+    // compress_unwind_proof_tree_phase2(), but on the graph
+    std::unordered_map< LabTok, CodeTok > label_map;
+    CodeTok code_idx(1);
+    for (size_t i = 0; i < this->ass.get_mand_hyps_num(); i++) {
+        label_map.insert(std::make_pair(this->ass.get_mand_hyp(i), code_idx));
+        code_idx = CodeTok(code_idx.val()+1);
+    }
+    std::vector< LabTok > refs;
+    std::vector< bool > closed(this->nodes.size(), false);
+    std::vector< bool > dupl(this->nodes.size(), false);
+    size_t visited = 0;
+    std::function< void(size_t) > phase1 = [&](size_t id) {
+        const Node &node = *this->nodes[id];
+        const size_t key = keys[id];
+        if (backrefs && !node.second.empty() && closed[key]) {
+            dupl[key] = true;
+            return;
+        }
+        // Without back-references the proof may grow exponentially
+        gio::assert_or_throw< ProofException< Sentence > >(++visited < max_decompression_size, "Decompressed proof is too large");
+        for (const size_t child : node.second) {
+            phase1(child);
+        }
+        if (label_map.find(node.first) == label_map.end()) {
+            label_map.insert(std::make_pair(node.first, code_idx));
+            code_idx = CodeTok(code_idx.val()+1);
+            refs.push_back(node.first);
+        }
+        closed[key] = true;
+    };
+    phase1(root);
+
+    std::fill(closed.begin(), closed.end(), false);
+    std::vector< CodeTok > saved_codes(this->nodes.size(), CodeTok{});
+    std::vector< CodeTok > codes;
+    std::function< void(size_t) > phase2 = [&](size_t id) {
+        const Node &node = *this->nodes[id];
+        const size_t key = keys[id];
+        if (backrefs && !node.second.empty() && closed[key]) {
+            codes.push_back(saved_codes[key]);
+            return;
+        }
+        for (const size_t child : node.second) {
+            phase2(child);
+        }
+        codes.push_back(label_map.at(node.first));
+        if (dupl[key] && saved_codes[key] == CodeTok{}) {
+            saved_codes[key] = code_idx;
+            code_idx = CodeTok(code_idx.val()+1);
+            codes.push_back(CodeTok{});
+        }
+        closed[key] = true;
+    };
+    phase2(root);
+    return CompressedProof(refs, codes);
+}
+
+std::vector< std::shared_ptr< const CompressedProof > > recompress_proofs(const Library &lib, ProofOperator::CompressionStrategy strategy, size_t jobs)
+{
+    std::vector< std::shared_ptr< const CompressedProof > > ret(lib.get_labels_num()+1);
+    parallel_for(ret.size(), [&](size_t i) {
+        const auto &ass = lib.get_assertion(LabTok(static_cast< LabTok::val_type >(i)));
+        if (ass.is_valid() && ass.is_theorem()) {
+            ret[i] = std::make_shared< const CompressedProof >(ass.get_proof_operator(lib)->compress(strategy));
+        }
+    }, jobs);
+    return ret;
+}
+
+CompressedProof compress_shared_proof(const Library &lib, const Assertion &ass, const CreativeProofEngineImpl< Sentence > &engine)
+{
+    gio::assert_or_throw< ProofException< Sentence > >(engine.get_stack().size() == 1, "Proof execution did not end with a single element on the stack");
+    auto comp_data = engine.get_compressed_proof(ass);
+    CompressedProof shared_proof(comp_data.first, comp_data.second);
+    UncompressedProof uncomp_proof = shared_proof.get_operator(lib, ass)->uncompress();
+    auto uncomp_op = uncomp_proof.get_operator(lib, ass);
+    for (const auto &hyp : engine.get_new_hypotheses()) {
+        uncomp_op->set_new_hypothesis(hyp.first, hyp.second);
+    }
+    auto comp_proof = uncomp_op->compress(ProofOperator::CS_BACKREFS_ON_IDENTICAL_SENTENCE);
+    gio::assert_or_throw< ProofException< Sentence > >(uncomp_op->get_stack().size() == 1 && uncomp_op->get_stack().back() == engine.get_stack().back(), "Shared proof does not prove the engine's result");
+    return comp_proof;
+}
+
 size_t ProofOperator::get_hyp_num(const LabTok label) const {
     const Assertion &child_ass = this->lib.get_assertion(label);
     if (child_ass.is_valid()) {
@@ -5,6 +5,9 @@
 #include <limits>
 #include <type_traits>
 #include <memory>
+#include <unordered_map>
+
+#include <boost/functional/hash.hpp>
 
 #include "utils/vectormap.h"
 #include "funds.h"
@@ -50,6 +53,9 @@ public:
 protected:
     ProofExecutor(const Library &lib, const Assertion &ass, bool gen_proof_tree) :
         lib(lib), ass(ass), engine(lib, gen_proof_tree), relax_checks(false) {
+        const auto dists = this->ass.get_dists();
+        this->allowed_dists.assign(dists.begin(), dists.end());
+        this->engine.set_allowed_dists(&this->allowed_dists);
     }
 
     void process_label(const LabTok label)
@@ -79,19 +85,23 @@ protected:
     {
         if (!this->relax_checks) {
             gio::assert_or_throw< ProofException< SentType_ > >(this->get_stack().size() == 1, "Proof execution did not end with a single element on the stack");
-            gio::assert_or_throw< ProofException< SentType_ > >(this->get_stack().at(0) == this->lib.get_sentence(this->ass.get_thesis()), "Proof does not prove the thesis");
-            gio::assert_or_throw< ProofException< SentType_ > >(includes(this->ass.get_dists().begin(), this->ass.get_dists().end(),
-                                                                   this->engine.get_dists().begin(), this->engine.get_dists().end()),
+            gio::assert_or_throw< ProofException< SentType_ > >(SentenceView(this->get_stack().at(0)) == this->lib.get_sentence_view(this->ass.get_thesis()), "Proof does not prove the thesis");
+            // When the engine checks constraints as they are generated, its set is empty
+            const auto &dists = this->engine.get_dists();
+            gio::assert_or_throw< ProofException< SentType_ > >(includes(this->allowed_dists.begin(), this->allowed_dists.end(), dists.begin(), dists.end()),
                                                           "Distinct variables constraints are too wide");
         }
     }
 
     void set_relax_checks(bool x) {
         this->relax_checks = x;
+        this->engine.set_allowed_dists(x ? nullptr : &this->allowed_dists);
     }
 
     const Library &lib;
     const Assertion &ass;
+    // Sorted, as required by the engine
+    std::vector< std::pair< SymTok, SymTok > > allowed_dists;
     SemiCreativeProofEngineImpl< SentType_ > engine;
     bool relax_checks;
 };
@@ -170,6 +180,8 @@ public:
     template< typename SentType_ >
     std::shared_ptr< ProofExecutor< SentType_ > > get_executor(const Library &lib, const Assertion &ass, bool gen_proof_tree=false) const;
     virtual std::shared_ptr< ProofOperator > get_operator(const Library &lib, const Assertion &ass) const = 0;
+    // Check that this is a valid proof of ass, throwing a ProofException< Sentence > otherwise
+    virtual void verify(const Library &lib, const Assertion &ass) const = 0;
     virtual ~Proof();
 };
 
@@ -179,6 +191,7 @@ public:
     template< typename SentType_ >
     std::shared_ptr< ProofExecutor< SentType_ > > get_executor(const Library &lib, const Assertion &ass, bool gen_proof_tree=false) const;
     std::shared_ptr< ProofOperator > get_operator(const Library &lib, const Assertion &ass) const override;
+    void verify(const Library &lib, const Assertion &ass) const override;
     const std::vector< LabTok > &get_refs() const;
     const std::vector< CodeTok > &get_codes() const;
 
@@ -193,12 +206,95 @@ public:
     template< typename SentType_ >
     std::shared_ptr< ProofExecutor< SentType_ > > get_executor(const Library &lib, const Assertion &ass, bool gen_proof_tree=false) const;
     std::shared_ptr< ProofOperator > get_operator(const Library &lib, const Assertion &ass) const override;
+    void verify(const Library &lib, const Assertion &ass) const override;
     const std::vector< LabTok > &get_labels() const;
 
 private:
     const std::vector< LabTok > labels;
 };
 
+/* Verify a compressed proof directly from its codes, without expanding it
+ * and without building the stack of a proof engine. Sentences on the stack
+ * are views: hypotheses point to the library, while the results of the
+ * applied assertions are stored in a pool of slots, whose memory is reused
+ * once a result is popped. Reusing a saved step just pushes the same view
+ * again, so memory is proportional to the size of the compressed proof and
+ * there is no limit on the size of the proof it represents. Distinct
+ * variables constraints are checked as they are generated.
+ */
+class CompressedProofVerifier {
+public:
+    CompressedProofVerifier(const Library &lib, const Assertion &ass, const CompressedProof &proof);
+    void verify();
+
+private:
+    typedef ProofSentenceTraits< Sentence > TraitsType;
+    static constexpr uint32_t no_slot = std::numeric_limits< uint32_t >::max();
+
+    struct StackEntry {
+        SentenceView sent;
+        uint32_t slot;
+    };
+
+    void process_label(LabTok label);
+    void process_assertion(const Assertion &child_ass, LabTok label);
+    uint32_t new_slot();
+
+    const Library &lib;
+    const Assertion &ass;
+    const CompressedProof &proof;
+    std::vector< std::pair< SymTok, SymTok > > allowed_dists;
+    std::vector< StackEntry > stack;
+    std::vector< StackEntry > saved;
+    std::vector< Sentence > slots;
+    std::vector< bool > slot_saved;
+    std::vector< uint32_t > free_slots;
+    TraitsType::SubstMapType subst_map;
+};
+
+/* A proof seen as a directed acyclic graph, where identical subproofs are
+ * represented by the same node; it is built step by step from either kind
+ * of proof, without expanding saved steps, and can be encoded again as a
+ * compressed proof with any strategy. Sentences are computed only when
+ * needed by the strategy, once per node. The proof is not checked, so it
+ * should have been verified before. */
+class ProofDag {
+public:
+    ProofDag(const Library &lib, const Assertion &ass);
+    void push_label(LabTok label);
+    void save_step();
+    void push_saved_step(size_t idx);
+    size_t get_saved_steps_num() const;
+    CompressedProof encode(ProofOperator::CompressionStrategy strategy) const;
+
+private:
+    // A node is identified by the label and the nodes it is applied to
+    typedef std::pair< LabTok, std::vector< size_t > > Node;
+
+    std::vector< Sentence > compute_sentences() const;
+
+    const Library &lib;
+    const Assertion &ass;
+    std::unordered_map< Node, size_t, boost::hash< Node > > nodes_index;
+    // Children always come before their parents
+    std::vector< const Node* > nodes;
+    std::vector< size_t > stack;
+    std::vector< size_t > saved;
+};
+
+/* Encode again all the proofs of lib with the given strategy, working in
+ * parallel on jobs threads (see parallel_for()). The result is indexed by
+ * label and it is nullptr for everything but theorems. */
+std::vector< std::shared_ptr< const CompressedProof > > recompress_proofs(const Library &lib, ProofOperator::CompressionStrategy strategy, size_t jobs = 0);
+
+/* Encode the proof built by an engine that shares its steps as a compressed
+ * proof of ass, with back-references on identical sentences. The shared
+ * proof is expanded and executed again with relaxed checks (ass may have no
+ * thesis and no distinct variables constraints), and it must end with the
+ * same sentence as the engine, so that the proof is not trusted just
+ * because the engine produced it. */
+CompressedProof compress_shared_proof(const Library &lib, const Assertion &ass, const CreativeProofEngineImpl< Sentence > &engine);
+
 class CompressedEncoder {
 public:
     std::string push_code(CodeTok x);
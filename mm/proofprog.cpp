@@ -0,0 +1,173 @@
+
+#include "proofprog.h"
+
+#include <algorithm>
+#include <limits>
+
+void ProofProgram::emit_label(LabTok label)
+{
+    this->code.push_back({OP_LABEL, label.val()});
+}
+
+void ProofProgram::emit_hyp(size_t slot)
+{
+    this->code.push_back({OP_HYP, static_cast< uint32_t >(slot)});
+    this->hyps_num = std::max(this->hyps_num, slot + 1);
+}
+
+size_t ProofProgram::get_pos() const
+{
+    return this->code.size();
+}
+
+size_t ProofProgram::save_step(size_t begin)
+{
+    gio::assert_or_throw< std::invalid_argument >(begin < this->code.size(), "cannot save an empty step");
+    this->saved_steps.push_back(std::make_pair(begin, this->code.size()));
+    return this->saved_steps.size() - 1;
+}
+
+void ProofProgram::emit_saved_step(size_t idx)
+{
+    gio::assert_or_throw< std::invalid_argument >(idx < this->saved_steps.size(), "saved step does not exist");
+    this->code.push_back({OP_LOAD, static_cast< uint32_t >(idx)});
+}
+
+void ProofProgram::emit_program(const ProofProgram &prog)
+{
+    size_t code_offset = this->code.size();
+    size_t saved_offset = this->saved_steps.size();
+    size_t subprogs_offset = this->subprogs.size();
+    for (auto instr : prog.code) {
+        if (instr.op == OP_LOAD) {
+            instr.arg += static_cast< uint32_t >(saved_offset);
+        } else if (instr.op == OP_SUB) {
+            instr.arg += static_cast< uint32_t >(subprogs_offset);
+        }
+        this->code.push_back(instr);
+    }
+    for (const auto &saved : prog.saved_steps) {
+        this->saved_steps.push_back(std::make_pair(saved.first + code_offset, saved.second + code_offset));
+    }
+    this->subprogs.insert(this->subprogs.end(), prog.subprogs.begin(), prog.subprogs.end());
+    this->hyps_num = std::max(this->hyps_num, prog.hyps_num);
+}
+
+void ProofProgram::emit_subprogram(const std::shared_ptr< const ProofProgram > &prog)
+{
+    gio::assert_or_throw< std::invalid_argument >(prog->hyps_num == 0, "sub-programs cannot have hypothesis slots");
+    this->code.push_back({OP_SUB, static_cast< uint32_t >(this->subprogs.size())});
+    this->subprogs.push_back(prog);
+}
+
+void ProofProgram::emit_program(const ProofProgram &prog, const std::vector< std::shared_ptr< const ProofProgram > > &hyps)
+{
+    gio::assert_or_throw< std::invalid_argument >(hyps.size() >= prog.hyps_num, "too few programs for the hypothesis slots");
+    const size_t not_saved = std::numeric_limits< size_t >::max();
+    std::vector< size_t > hyps_saved(hyps.size(), not_saved);
+    // Instructions move, so saved steps are translated as they are met
+    std::vector< size_t > new_pos(prog.code.size());
+    std::vector< size_t > new_saved(prog.saved_steps.size());
+    size_t next_saved = 0;
+    for (size_t pos = 0; pos < prog.code.size(); pos++) {
+        new_pos[pos] = this->code.size();
+        const Instr &instr = prog.code[pos];
+        switch (instr.op) {
+        case OP_LABEL:
+            this->code.push_back(instr);
+            break;
+        case OP_LOAD:
+            this->emit_saved_step(new_saved[instr.arg]);
+            break;
+        case OP_HYP: {
+            const ProofProgram &hyp = *hyps[instr.arg];
+            if (hyp.code.size() == 1 && hyp.code[0].op == OP_LABEL) {
+                this->code.push_back(hyp.code[0]);
+            } else if (hyps_saved[instr.arg] != not_saved) {
+                this->emit_saved_step(hyps_saved[instr.arg]);
+            } else {
+                const size_t begin = this->code.size();
+                this->emit_subprogram(hyps[instr.arg]);
+                hyps_saved[instr.arg] = this->save_step(begin);
+            }
+            break;
+        }
+        case OP_SUB:
+            this->code.push_back({OP_SUB, static_cast< uint32_t >(this->subprogs.size())});
+            this->subprogs.push_back(prog.subprogs[instr.arg]);
+            break;
+        }
+        while (next_saved < prog.saved_steps.size() && prog.saved_steps[next_saved].second == pos + 1) {
+            new_saved[next_saved] = this->save_step(new_pos[prog.saved_steps[next_saved].first]);
+            next_saved++;
+        }
+    }
+}
+
+void ProofProgram::truncate(size_t pos)
+{
+    this->code.resize(std::min(pos, this->code.size()));
+    while (!this->saved_steps.empty() && this->saved_steps.back().second > this->code.size()) {
+        this->saved_steps.pop_back();
+    }
+    this->hyps_num = 0;
+    size_t subprogs_num = 0;
+    for (const auto &instr : this->code) {
+        if (instr.op == OP_HYP) {
+            this->hyps_num = std::max(this->hyps_num, static_cast< size_t >(instr.arg) + 1);
+        } else if (instr.op == OP_SUB) {
+            subprogs_num = static_cast< size_t >(instr.arg) + 1;
+        }
+    }
+    this->subprogs.resize(subprogs_num);
+}
+
+const std::vector< ProofProgram::Instr > &ProofProgram::get_code() const
+{
+    return this->code;
+}
+
+size_t ProofProgram::get_saved_steps_num() const
+{
+    return this->saved_steps.size();
+}
+
+size_t ProofProgram::get_hyps_num() const
+{
+    return this->hyps_num;
+}
+
+std::vector< LabTok > ProofProgram::get_labels() const
+{
+    std::vector< LabTok > ret;
+    this->append_labels(ret);
+    return ret;
+}
+
+void ProofProgram::append_labels(std::vector< LabTok > &labels) const
+{
+    std::vector< std::pair< size_t, size_t > > frames;
+    size_t pos = 0;
+    size_t end = this->code.size();
+    while (true) {
+        if (pos == end) {
+            if (frames.empty()) {
+                break;
+            }
+            std::tie(pos, end) = frames.back();
+            frames.pop_back();
+            continue;
+        }
+        const Instr &instr = this->code[pos++];
+        if (instr.op == OP_LABEL) {
+            labels.push_back(LabTok(instr.arg));
+        } else if (instr.op == OP_LOAD) {
+            frames.push_back(std::make_pair(pos, end));
+            std::tie(pos, end) = this->saved_steps[instr.arg];
+        } else if (instr.op == OP_SUB) {
+            this->subprogs[instr.arg]->append_labels(labels);
+        } else {
+            throw std::invalid_argument("proof program has hypothesis slots");
+        }
+    }
+}
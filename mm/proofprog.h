@@ -0,0 +1,228 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <giolib/assert.h>
+
+#include "engine.h"
+#include "sentengine.h"
+
+// Called with the engine errors that make a replay fail
+typedef std::function< void(const ProofException< Sentence >&) > ProofExceptionHandler;
+
+/* A proof program is the flat list of operations that a prover performs on a
+ * proof engine: pushing labels, pushing again a step that was built earlier,
+ * running the hypothesis prover in a given slot and running another program.
+ * Programs are built directly, or composed from the programs of other
+ * provers (see ProgramProver), and are then replayed on any
+ * CheckpointedProofEngine without going through a tree of closures.
+ * Composed programs refer to the programs they are made of instead of
+ * copying them, so that nesting provers costs the same at every level. */
+class ProofProgram {
+public:
+    enum Opcode : uint8_t {
+        // Push a label; arg is the label
+        OP_LABEL,
+        // Push again saved step number arg
+        OP_LOAD,
+        // Run the prover in hypothesis slot arg
+        OP_HYP,
+        // Run sub-program number arg
+        OP_SUB,
+    };
+
+    struct Instr {
+        Opcode op;
+        uint32_t arg;
+
+        bool operator==(const Instr &x) const {
+            return this->op == x.op && this->arg == x.arg;
+        }
+    };
+
+    void emit_label(LabTok label);
+    void emit_hyp(size_t slot);
+    // Saved steps are recorded as the instructions that produced them, so
+    // that they can be replayed on engines that cannot save steps
+    size_t get_pos() const;
+    size_t save_step(size_t begin);
+    void emit_saved_step(size_t idx);
+    // Append another program, whose hypothesis slots are kept as they are
+    void emit_program(const ProofProgram &prog);
+    /* Run another program, which must have no hypothesis slots; it is
+     * shared, not copied. */
+    void emit_subprogram(const std::shared_ptr< const ProofProgram > &prog);
+    /* Append another program, replacing each of its hypothesis slots with
+     * the program given for it, which runs as a sub-program unless it is a
+     * single label; a slot that is used more than once is emitted the first
+     * time and then pushed again as a saved step. */
+    void emit_program(const ProofProgram &prog, const std::vector< std::shared_ptr< const ProofProgram > > &hyps);
+    void truncate(size_t pos);
+
+    const std::vector< Instr > &get_code() const;
+    size_t get_saved_steps_num() const;
+    size_t get_hyps_num() const;
+    std::vector< LabTok > get_labels() const;
+
+    /* Run the program on engine, calling run_hyp(slot) for hypothesis
+     * slots. Nothing is rolled back: if run_hyp() returns false, execution
+     * stops and false is returned, while engine errors are propagated.
+     * Saved steps are saved in the engine and pushed again from there when
+     * it shares steps; otherwise their instructions are run again. */
+    template< typename Engine, typename HypFunc, typename std::enable_if< std::is_base_of< ProofEngine, Engine >::value >::type* = nullptr >
+    bool execute(Engine &engine, const HypFunc &run_hyp) const {
+        auto saving = dynamic_cast< StepSavingProofEngine* >(&engine);
+        if (saving != nullptr && saving->shares_steps()) {
+            return this->execute_saving(engine, *saving, run_hyp);
+        }
+
+        // Saved steps are replayed in place, keeping the positions to
+        // return to on an explicit stack
+        std::vector< std::pair< size_t, size_t > > frames;
+        size_t pos = 0;
+        size_t end = this->code.size();
+        while (true) {
+            if (pos == end) {
+                if (frames.empty()) {
+                    return true;
+                }
+                std::tie(pos, end) = frames.back();
+                frames.pop_back();
+                continue;
+            }
+            const Instr &instr = this->code[pos++];
+            switch (instr.op) {
+            case OP_LABEL:
+                engine.process_label(LabTok(instr.arg));
+                break;
+            case OP_LOAD:
+                frames.push_back(std::make_pair(pos, end));
+                std::tie(pos, end) = this->saved_steps[instr.arg];
+                break;
+            case OP_HYP:
+                if (!run_hyp(static_cast< size_t >(instr.arg))) {
+                    return false;
+                }
+                break;
+            case OP_SUB:
+                if (!this->execute_subprogram(engine, instr.arg)) {
+                    return false;
+                }
+                break;
+            }
+        }
+    }
+
+    /* Run the program as a prover: the engine is rolled back if it fails,
+     * and the engine errors that caused the failure, if any, are passed to
+     * on_exception. */
+    template< typename Engine, typename std::enable_if< std::is_base_of< CheckpointedProofEngine, Engine >::value >::type* = nullptr >
+    bool replay(Engine &engine, const std::vector< Prover< Engine > > &hyps_provers = {}, const ProofExceptionHandler &on_exception = nullptr) const {
+        gio::assert_or_throw< std::invalid_argument >(hyps_provers.size() >= this->hyps_num, "too few hypothesis provers for the proof program");
+        engine.checkpoint();
+        bool res;
+        try {
+            res = this->execute(engine, [&](size_t slot) { return hyps_provers[slot](engine); });
+        } catch (const ProofException< Sentence > &e) {
+            if (on_exception) {
+                on_exception(e);
+            }
+            res = false;
+        }
+        if (res) {
+            engine.commit();
+        } else {
+            engine.rollback();
+        }
+        return res;
+    }
+
+    /* The returned prover shares the program, so copying it is cheap */
+    template< typename Engine, typename std::enable_if< std::is_base_of< CheckpointedProofEngine, Engine >::value >::type* = nullptr >
+    Prover< Engine > to_prover(const std::vector< Prover< Engine > > &hyps_provers = {}, const ProofExceptionHandler &on_exception = nullptr) const;
+
+private:
+    template< typename Engine, typename HypFunc >
+    bool execute_saving(Engine &engine, StepSavingProofEngine &saving, const HypFunc &run_hyp) const {
+        // Each saved step is saved in the engine right after its last
+        // instruction, which is the order in which they are listed
+        std::vector< size_t > engine_steps(this->saved_steps.size());
+        size_t next_saved = 0;
+        for (size_t pos = 0; pos < this->code.size(); pos++) {
+            const Instr &instr = this->code[pos];
+            switch (instr.op) {
+            case OP_LABEL:
+                engine.process_label(LabTok(instr.arg));
+                break;
+            case OP_LOAD:
+                saving.process_saved_step(engine_steps[instr.arg]);
+                break;
+            case OP_HYP:
+                if (!run_hyp(static_cast< size_t >(instr.arg))) {
+                    return false;
+                }
+                break;
+            case OP_SUB:
+                if (!this->execute_subprogram(engine, instr.arg)) {
+                    return false;
+                }
+                break;
+            }
+            while (next_saved < this->saved_steps.size() && this->saved_steps[next_saved].second == pos + 1) {
+                engine_steps[next_saved++] = saving.save_step();
+            }
+        }
+        return true;
+    }
+
+    template< typename Engine >
+    bool execute_subprogram(Engine &engine, size_t idx) const {
+        // Sub-programs have no hypothesis slots
+        return this->subprogs[idx]->execute(engine, [](size_t) { return false; });
+    }
+
+    void append_labels(std::vector< LabTok > &labels) const;
+
+    std::vector< Instr > code;
+    // Ranges of code, listed by nondecreasing end
+    std::vector< std::pair< size_t, size_t > > saved_steps;
+    // Listed in the order in which code refers to them
+    std::vector< std::shared_ptr< const ProofProgram > > subprogs;
+    size_t hyps_num = 0;
+};
+
+/* A prover that replays a program without hypothesis slots. Provers of
+ * this kind are recognized by get_program(), so that the provers built on
+ * top of them can be composed as a single program, instead of as closures
+ * calling each other. */
+template< typename Engine >
+struct ProgramProver {
+    std::shared_ptr< const ProofProgram > prog;
+    ProofExceptionHandler on_exception;
+
+    bool operator()(Engine &engine) const {
+        return this->prog->replay(engine, {}, this->on_exception);
+    }
+};
+
+// Return the program of a prover built by ProgramProver, or nullptr
+template< typename Engine >
+std::shared_ptr< const ProofProgram > get_program(const Prover< Engine > &prover) {
+    const auto *prog_prover = prover.template target< ProgramProver< Engine > >();
+    return prog_prover != nullptr ? prog_prover->prog : nullptr;
+}
+
+template< typename Engine, typename std::enable_if< std::is_base_of< CheckpointedProofEngine, Engine >::value >::type* >
+Prover< Engine > ProofProgram::to_prover(const std::vector< Prover< Engine > > &hyps_provers, const ProofExceptionHandler &on_exception) const {
+    auto prog = std::make_shared< const ProofProgram >(*this);
+    if (hyps_provers.empty()) {
+        return ProgramProver< Engine >{prog, on_exception};
+    }
+    return [prog,hyps_provers,on_exception](Engine &engine) {
+        return prog->replay(engine, hyps_provers, on_exception);
+    };
+}
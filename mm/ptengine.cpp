@@ -15,12 +15,12 @@ ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >::VarType ProofSentenceTraits<
      * than once (see for example wcel.cA and cA in set.mm), so we do
      * a round of normalization with get_var_sym_to_lab.
      */
-    return lib.get_var_sym_to_lab(lib.get_sentence(label).at(1));
+    return lib.get_var_sym_to_lab(lib.get_sentence_view(label).at(1));
 }
 
 SymTok ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >::floating_to_type(const LibType &lib, LabTok label)
 {
-    return lib.get_sentence(label).at(0);
+    return lib.get_sentence_view(label).at(0);
 }
 
 SymTok ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >::sentence_to_type(const LibType &lib, const ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >::SentType &sent)
@@ -29,16 +29,29 @@ SymTok ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >::sentence_to_type(cons
     return sent.second.get_root().get_node().type;
 }
 
-const ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >::SentType ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >::get_sentence(const LibType &lib, LabTok label)
+const ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >::LibSentType ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >::get_sentence(const LibType &lib, LabTok label)
 {
-    return std::make_pair(lib.get_sentence(label).at(0), lib.get_parsed_sent2(label));
+    return std::make_pair(lib.get_sentence_view(label).at(0), lib.get_parsed_sent2(label));
+}
+
+ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >::SentType ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >::copy_sentence(const LibType &lib, const LibSentType &sent)
+{
+    (void) lib;
+    return sent;
 }
 
 void ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >::check_match(const LibType &lib, LabTok label, const ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >::SentType &stack, const ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >::SentType &templ, const ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >::SubstMapType &subst_map)
 {
-    ProofError< ParsingTree2<SymTok, LabTok> > err = { label, stack, templ, subst_map };
-    gio::assert_or_throw<ProofException<ParsingTree2<SymTok, LabTok>>>(templ.first == stack.first, "Essential hypothesis' type does not match stack", err);
-    gio::assert_or_throw< ProofException< ParsingTree2< SymTok, LabTok > > >(substitute2(templ.second, lib.get_standard_is_var(), subst_map) == stack.second, "Essential hypothesis does not match stack", err);
+    // The error is only built when needed, since it copies everything
+    auto err = [&]() -> ProofError< ParsingTree2<SymTok, LabTok> > {
+        return { label, stack, templ, subst_map };
+    };
+    if (templ.first != stack.first) {
+        throw ProofException<ParsingTree2<SymTok, LabTok>>("Essential hypothesis' type does not match stack", err());
+    }
+    if (substitute2(templ.second, lib.get_standard_is_var(), subst_map) != stack.second) {
+        throw ProofException< ParsingTree2< SymTok, LabTok > >("Essential hypothesis does not match stack", err());
+    }
 }
 
 ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >::SentType ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >::substitute(const LibType &lib, const ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >::SentType &templ, const ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >::SubstMapType &subst_map)
@@ -63,6 +76,11 @@ ParsingTree2<SymTok, LabTok> ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >:
     return sent.second;
 }
 
+ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >::ErrorSubstMapType ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >::copy_subst_map(const SubstMapType &subst_map)
+{
+    return subst_map;
+}
+
 ProofSentenceTraits<ParsingTree2<SymTok, LabTok> >::PTGenerator::PTGenerator(const ParsingTree2<SymTok, LabTok> &sent) : sent(sent) {}
 
 
@@ -11,7 +11,9 @@
 template<>
 struct ProofSentenceTraits< ParsingTree2< SymTok, LabTok > > final {
     typedef std::pair<SymTok, ParsingTree2< SymTok, LabTok >> SentType;
+    typedef SentType LibSentType;
     typedef SubstMap2< SymTok, LabTok > SubstMapType;
+    typedef SubstMapType ErrorSubstMapType;
     typedef LabTok VarType;
     typedef LibraryToolbox LibType;
     typedef LibraryToolbox AdvLibType;
@@ -42,12 +44,14 @@ struct ProofSentenceTraits< ParsingTree2< SymTok, LabTok > > final {
     static VarType floating_to_var(const LibType &lib, LabTok label);
     static SymTok floating_to_type(const LibType &lib, LabTok label);
     static SymTok sentence_to_type(const LibType &lib, const SentType &sent);
-    static const SentType get_sentence(const LibType &lib, LabTok label);
+    static const LibSentType get_sentence(const LibType &lib, LabTok label);
+    static SentType copy_sentence(const LibType &lib, const LibSentType &sent);
     static void check_match(const LibType &lib, LabTok label, const SentType &stack, const SentType &templ, const SubstMapType &subst_map);
     static SentType substitute(const LibType &lib, const SentType &templ, const SubstMapType &subst_map);
     static PTGenerator get_variable_iterator(const LibType &lib, const ParsingTree2<SymTok, LabTok> &sent);
     static bool is_variable(const LibType &lib, VarType var);
     static ParsingTree2<SymTok, LabTok> sentence_to_subst(const LibType &lib, const SentType &sent);
+    static ErrorSubstMapType copy_subst_map(const SubstMapType &subst_map);
 };
 
 extern template class VectorMap< SymTok, ParsingTree2< SymTok, LabTok > >;
@@ -9,18 +9,33 @@
 
 #include "reader.h"
 #include "utils/utils.h"
+#include "utils/parallel.h"
 #include "proof.h"
 
 void Reader::run () {
+    try {
+        this->read_statements();
+    } catch (...) {
+        // Errors are reported in file order, so a deferred proof that
+        // fails takes precedence over a later error in reading
+        this->execute_deferred_proofs();
+        throw;
+    }
+
+    // Now the library is complete and will not change anymore, so proofs can be executed concurrently
+    this->execute_deferred_proofs();
+}
+
+void Reader::read_statements() {
     //cout << "Running the reader" << endl;
     //auto t = tic();
-    std::pair< bool, std::string > token_pair;
+    std::pair< bool, std::string_view > token_pair;
     this->label = 0;
     assert(this->stack.empty());
     this->stack.emplace_back();
     while ((token_pair = this->next_token()).second != "") {
         bool &comment = token_pair.first;
-        std::string &token = token_pair.second;
+        std::string_view &token = token_pair.second;
         if (comment) {
             this->process_comment(token);
             continue;
@@ -42,7 +57,7 @@ void Reader::run () {
             // Collect tokens in statement
             while ((token_pair = this->next_token()).second != "$.") {
                 bool &comment = token_pair.first;
-                std::string &token = token_pair.second;
+                std::string_view &token = token_pair.second;
                 if (comment) {
                     this->process_comment(token);
                     continue;
@@ -50,7 +65,11 @@ void Reader::run () {
                 if (token == "") {
                     throw MMPPParsingError("File ended in a statement");
                 }
-                this->toks.push_back(token);
+                if (this->tg->has_persistent_views()) {
+                    this->toks.push_back(token);
+                } else {
+                    this->toks.push_back(this->toks_storage.emplace_back(token));
+                }
             }
 
             // Process statement
@@ -82,8 +101,9 @@ void Reader::run () {
             }
             this->label = 0;
             this->toks.clear();
+            this->toks_storage.clear();
         } else {
-            this->label = this->lib.create_label(token);
+            this->label = this->lib.create_label(std::string(token));
             gio::assert_or_throw< MMPPParsingError >(this->label != LabTok{}, "Repeated label detected");
             //cout << "Found label " << token << endl;
         }
@@ -107,9 +127,9 @@ const LibraryImpl &Reader::get_library() const {
     return this->lib;
 }
 
-std::pair<bool, std::string> Reader::next_token()
+std::pair<bool, std::string_view> Reader::next_token()
 {
-    return this->tg->next();
+    return this->tg->next_view();
 }
 
 const StackFrame &Reader::get_final_frame() const
@@ -122,7 +142,7 @@ void Reader::parse_c()
     gio::assert_or_throw< MMPPParsingError >(this->label == LabTok{}, "Undue label in $c statement");
     gio::assert_or_throw< MMPPParsingError >(this->stack.size() == 1, "Found $c statement when not in top-level scope");
     for (auto stok : this->toks) {
-        SymTok tok = this->lib.create_symbol(stok);
+        SymTok tok = this->lib.create_symbol(std::string(stok));
         gio::assert_or_throw< MMPPParsingError >(!this->check_const(tok), "Symbol already bound in $c statement");
         gio::assert_or_throw< MMPPParsingError >(!this->check_var(tok), "Symbol already bound in $c statement");
         this->consts.insert(tok);
@@ -134,7 +154,7 @@ void Reader::parse_v()
 {
     gio::assert_or_throw< MMPPParsingError >(this->label == LabTok{}, "Undue label in $v statement");
     for (auto stok : this->toks) {
-        SymTok tok = this->lib.create_or_get_symbol(stok);
+        SymTok tok = this->lib.create_or_get_symbol(std::string(stok));
         gio::assert_or_throw< MMPPParsingError >(!this->check_const(tok), "Symbol already bound in $v statement");
         gio::assert_or_throw< MMPPParsingError >(!this->check_var(tok), "Symbol already bound in $v statement");
         this->lib.set_constant(tok, false);
@@ -146,8 +166,8 @@ void Reader::parse_f()
 {
     gio::assert_or_throw< MMPPParsingError >(this->label != LabTok{}, "Missing label in $f statement");
     gio::assert_or_throw< MMPPParsingError >(this->toks.size() == 2, "Found $f statement with wrong length");
-    SymTok const_tok = this->lib.get_symbol(this->toks[0]);
-    SymTok var_tok = this->lib.get_symbol(this->toks[1]);
+    SymTok const_tok = this->lib.get_symbol(std::string(this->toks[0]));
+    SymTok var_tok = this->lib.get_symbol(std::string(this->toks[1]));
     gio::assert_or_throw< MMPPParsingError >(const_tok != SymTok{}, "First member of a $f statement is not defined");
     gio::assert_or_throw< MMPPParsingError >(var_tok != SymTok{}, "Second member of a $f statement is not defined");
     gio::assert_or_throw< MMPPParsingError >(this->check_const(const_tok), "First member of a $f statement is not a constant");
@@ -163,7 +183,7 @@ void Reader::parse_e()
     gio::assert_or_throw< MMPPParsingError >(this->toks.size() >= 1, "Empty $e statement");
     std::vector< SymTok > tmp;
     for (auto &stok : this->toks) {
-        SymTok tok = this->lib.get_symbol(stok);
+        SymTok tok = this->lib.get_symbol(std::string(stok));
         gio::assert_or_throw< MMPPParsingError >(tok != SymTok{}, "Symbol in $e statement is not defined");
         assert(this->check_const(tok) || this->check_var(tok));
         tmp.push_back(tok);
@@ -177,10 +197,10 @@ void Reader::parse_d()
 {
     gio::assert_or_throw< MMPPParsingError >(this->label == LabTok{}, "Undue label in $d statement");
     for (auto it = this->toks.begin(); it != this->toks.end(); it++) {
-        SymTok tok1 = this->lib.get_symbol(*it);
+        SymTok tok1 = this->lib.get_symbol(std::string(*it));
         gio::assert_or_throw< MMPPParsingError >(this->check_var(tok1), "Symbol in $d statement is not a variable");
         for (auto it2 = it+1; it2 != this->toks.end(); it2++) {
-            SymTok tok2 = this->lib.get_symbol(*it2);
+            SymTok tok2 = this->lib.get_symbol(std::string(*it2));
             gio::assert_or_throw< MMPPParsingError >(this->check_var(tok2), "Symbol in $d statement is not a variable");
             gio::assert_or_throw< MMPPParsingError >(tok1 != tok2, "Repeated symbol in $d statement");
             this->stack.back().dists.insert(std::minmax(tok1, tok2));
@@ -188,7 +208,7 @@ void Reader::parse_d()
     }
 }
 
-void Reader::collect_vars_from_sentence(std::set<SymTok> &vars, const std::vector<SymTok> &sent) const {
+void Reader::collect_vars_from_sentence(std::set<SymTok> &vars, SentenceView sent) const {
     return collect_variables(sent, [this](auto tok) { return this->check_var(tok); }, vars);
 }
 
@@ -196,8 +216,8 @@ void Reader::collect_vars_from_proof(std::set<SymTok> &vars, const std::vector<L
 {
     for (auto &tok : proof) {
         if (this->check_type(tok)) {
-            gio::assert_or_throw< MMPPParsingError >(this->lib.get_sentence(tok).size() == 2, "Type has wrong size");
-            vars.insert(this->lib.get_sentence(tok).at(1));
+            gio::assert_or_throw< MMPPParsingError >(this->lib.get_sentence_view(tok).size() == 2, "Type has wrong size");
+            vars.insert(this->lib.get_sentence_view(tok).at(1));
         }
     }
 }
@@ -207,7 +227,7 @@ std::set< SymTok > Reader::collect_mand_vars(const std::vector<SymTok> &sent) co
     this->collect_vars_from_sentence(vars, sent);
     for (auto &frame : this->stack) {
         for (auto &hyp : frame.hyps) {
-            this->collect_vars_from_sentence(vars, this->lib.get_sentence(hyp));
+            this->collect_vars_from_sentence(vars, this->lib.get_sentence_view(hyp));
         }
     }
     return vars;
@@ -229,7 +249,7 @@ std::pair< std::vector< LabTok >, std::vector< LabTok > > Reader::collect_mand_h
     // Floating hypotheses
     for (auto &frame : this->stack) {
         for (auto &type : frame.types) {
-            const auto &sent = this->lib.get_sentence(type);
+            const auto sent = this->lib.get_sentence_view(type);
             if (vars.find(sent[1]) != vars.end()) {
                 float_hyps.push_back(type);
             }
@@ -251,7 +271,7 @@ std::set<LabTok> Reader::collect_opt_hyps(std::set<SymTok> opt_vars) const
     std::set< LabTok > ret;
     for (auto &frame : this->stack) {
         for (auto &type : frame.types) {
-            const auto &sent = this->lib.get_sentence(type);
+            const auto sent = this->lib.get_sentence_view(type);
             if (opt_vars.find(sent[1]) != opt_vars.end()) {
                 ret.insert(type);
             }
@@ -295,7 +315,7 @@ void Reader::parse_a()
     gio::assert_or_throw< MMPPParsingError >(this->toks.size() >= 1, "Empty $a statement");
     std::vector< SymTok > tmp;
     for (auto &stok : this->toks) {
-        SymTok tok = this->lib.get_symbol(stok);
+        SymTok tok = this->lib.get_symbol(std::string(stok));
         gio::assert_or_throw< MMPPParsingError >(tok != SymTok{}, "Symbol in $a statement is not defined");
         assert(this->check_const(tok) || this->check_var(tok));
         tmp.push_back(tok);
@@ -334,7 +354,7 @@ void Reader::parse_p()
                 in_proof = true;
                 continue;
             }
-            SymTok tok = this->lib.get_symbol(stok);
+            SymTok tok = this->lib.get_symbol(std::string(stok));
             gio::assert_or_throw< MMPPParsingError >(tok != SymTok{}, "Symbol in $p statement is not defined");
             assert(this->check_const(tok) || this->check_var(tok));
             tmp.push_back(tok);
@@ -357,7 +377,7 @@ void Reader::parse_p()
                     compressed_proof = 2;
                     continue;
                 } else {
-                    LabTok tok = this->lib.get_label(stok);
+                    LabTok tok = this->lib.get_label(std::string(stok));
                     gio::assert_or_throw< MMPPParsingError >(tok != LabTok{}, "Label in compressed proof in $p statement is not defined");
                     proof_refs.push_back(tok);
                 }
@@ -371,7 +391,7 @@ void Reader::parse_p()
                 }
             }
             if (compressed_proof == -1) {
-                LabTok tok = this->lib.get_label(stok);
+                LabTok tok = this->lib.get_label(std::string(stok));
                 gio::assert_or_throw< MMPPParsingError >(tok != LabTok{}, "Symbol in uncompressed proof in $p statement is not defined");
                 proof_labels.push_back(tok);
             }
@@ -410,18 +430,37 @@ void Reader::parse_p()
         auto po = ass.get_proof_operator(this->lib);
         gio::assert_or_throw< MMPPParsingError >(po->check_syntax(), "Syntax check failed for proof of $p statement");
         if (this->execute_proofs) {
-            auto pe = ass.get_proof_executor< Sentence >(this->lib);
-            pe->set_debug_output("executing " + lib.resolve_label(this->label));
-            pe->execute();
+            if (this->jobs == 1) {
+                proof->verify(this->lib, ass);
+            } else {
+                this->deferred_proofs.push_back(this->label);
+            }
         }
     }
     this->lib.add_assertion(this->label, ass);
 }
 
-void Reader::process_comment(const std::string &comment)
+/* Executing a proof only reads the library, and check_syntax() has already ensured
+ * that each proof only references statements that precede it, so the outcome does
+ * not change if proofs are executed after the whole file was read. When more than
+ * one proof is wrong, parallel_for() guarantees that the reported exception is
+ * the one of the first wrong proof in file order, as it happens when proofs are
+ * executed inline.
+ */
+void Reader::execute_deferred_proofs()
+{
+    parallel_for(this->deferred_proofs.size(), [this](size_t i) {
+        LabTok label = this->deferred_proofs[i];
+        const Assertion &ass = this->lib.get_assertion(label);
+        ass.get_proof()->verify(this->lib, ass);
+    }, this->jobs);
+    this->deferred_proofs.clear();
+}
+
+void Reader::process_comment(std::string_view comment)
 {
     if (this->store_comments) {
-        this->last_comment = comment;
+        this->last_comment = std::string(comment);
     }
     bool found_dollar = false;
     size_t i = 0;
@@ -751,8 +790,8 @@ bool Reader::check_type(LabTok tok) const
     return false;
 }
 
-Reader::Reader(TokenGenerator &tg, bool execute_proofs, bool store_comments) :
-    tg(&tg), execute_proofs(execute_proofs), store_comments(store_comments),
+Reader::Reader(TokenGenerator &tg, bool execute_proofs, bool store_comments, size_t jobs) :
+    tg(&tg), execute_proofs(execute_proofs), store_comments(store_comments), jobs(jobs),
     number(1)
 {
 }
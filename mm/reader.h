@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include <deque>
 #include <string>
 #include <set>
 #include <unordered_map>
@@ -13,12 +14,18 @@
 
 class Reader {
 public:
-    Reader(TokenGenerator &tg, bool execute_proofs=true, bool store_comments=false);
+    /* If execute_proofs is true and jobs is not one, proofs are not executed
+     * while reading; they are collected and executed at the end of run() on
+     * jobs threads (zero means one for each hardware thread). Errors are
+     * still reported in file order: if reading fails, the proofs collected
+     * so far are executed before the reading error is thrown. */
+    Reader(TokenGenerator &tg, bool execute_proofs=true, bool store_comments=false, size_t jobs=1);
     void run();
     const LibraryImpl &get_library() const;
 
 private:
-    std::pair< bool, std::string > next_token();
+    void read_statements();
+    std::pair< bool, std::string_view > next_token();
     void parse_c();
     void parse_v();
     void parse_f();
@@ -26,7 +33,7 @@ private:
     void parse_d();
     void parse_a();
     void parse_p();
-    void process_comment(const std::string &comment);
+    void process_comment(std::string_view comment);
     std::vector<std::vector<std::pair<bool, std::string> > > parse_comment(const std::string &comment);
     void parse_t_comment(const std::string &comment);
     void parse_t_code(const std::vector<std::vector<std::pair<bool, std::string> > > &code);
@@ -38,22 +45,28 @@ private:
     bool check_type(LabTok tok) const;
     std::set<SymTok> collect_mand_vars(const std::vector<SymTok> &sent) const;
     std::set< SymTok > collect_opt_vars(const std::vector< LabTok > &proof, const std::set< SymTok > &mand_vars) const;
-    void collect_vars_from_sentence(std::set<SymTok> &vars, const std::vector<SymTok> &sent) const;
+    void collect_vars_from_sentence(std::set<SymTok> &vars, SentenceView sent) const;
     void collect_vars_from_proof(std::set<SymTok> &vars, const std::vector< LabTok > &proof) const;
     std::pair< std::vector< LabTok >, std::vector<LabTok> > collect_mand_hyps(std::set<SymTok> vars) const;
     std::set<LabTok> collect_opt_hyps(std::set<SymTok> opt_vars) const;
     std::set<std::pair<SymTok, SymTok> > collect_mand_dists(std::set<SymTok> vars) const;
     std::set<std::pair<SymTok, SymTok> > collect_opt_dists(std::set<SymTok> opt_vars, std::set<SymTok> mand_vars) const;
     const StackFrame &get_final_frame() const;
+    void execute_deferred_proofs();
 
     TokenGenerator *tg;
     bool execute_proofs;
     bool store_comments;
+    size_t jobs;
+    std::vector< LabTok > deferred_proofs;
     LibraryImpl lib;
     LabTok label;
     LabTok number;
     std::string last_comment;
-    std::vector< std::string > toks;
+    // The tokens of the current statement; they point into toks_storage
+    // when the token generator does not keep its views valid
+    std::vector< std::string_view > toks;
+    std::deque< std::string > toks_storage;
     std::string t_comment;
     std::string j_comment;
 
@@ -0,0 +1,217 @@
+#include "scanner.h"
+
+#include <atomic>
+
+#include "funds.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MM_SCANNER_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+size_t scan_mm_valid_scalar(const char *data, size_t pos, size_t size) {
+    while (pos < size && is_mm_valid(data[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+size_t scan_mm_whitespace_scalar(const char *data, size_t pos, size_t size) {
+    while (pos < size && is_mm_whitespace(data[pos])) {
+        pos++;
+    }
+    return pos;
+}
+
+#ifdef MM_SCANNER_X86
+
+/* Characters are compared as signed bytes, so anything above 127 is
+ * negative and is correctly rejected by the lower bound check. */
+
+__attribute__((target("sse2")))
+inline unsigned valid_mask_sse2(__m128i v) {
+    __m128i res = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(32)), _mm_cmplt_epi8(v, _mm_set1_epi8(127)));
+    res = _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('$')), res);
+    return static_cast< unsigned >(_mm_movemask_epi8(res));
+}
+
+__attribute__((target("sse2")))
+inline unsigned whitespace_mask_sse2(__m128i v) {
+    __m128i res = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    res = _mm_or_si128(res, _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    res = _mm_or_si128(res, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+    res = _mm_or_si128(res, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+    res = _mm_or_si128(res, _mm_cmpeq_epi8(v, _mm_set1_epi8('\f')));
+    return static_cast< unsigned >(_mm_movemask_epi8(res));
+}
+
+__attribute__((target("avx2")))
+inline unsigned valid_mask_avx2(__m256i v) {
+    __m256i res = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(32)), _mm256_cmpgt_epi8(_mm256_set1_epi8(127), v));
+    res = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('$')), res);
+    return static_cast< unsigned >(_mm256_movemask_epi8(res));
+}
+
+__attribute__((target("avx2")))
+inline unsigned whitespace_mask_avx2(__m256i v) {
+    __m256i res = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+    res = _mm256_or_si256(res, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+    res = _mm256_or_si256(res, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+    res = _mm256_or_si256(res, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+    res = _mm256_or_si256(res, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\f')));
+    return static_cast< unsigned >(_mm256_movemask_epi8(res));
+}
+
+/* Full blocks are classified at once, and the position of the first
+ * character outside the class is found from the movemask. The tail shorter
+ * than a block is left to the narrower implementation. */
+
+__attribute__((target("sse2")))
+size_t scan_mm_valid_sse2(const char *data, size_t pos, size_t size) {
+    while (pos + 16 <= size) {
+        unsigned mask = ~valid_mask_sse2(_mm_loadu_si128(reinterpret_cast< const __m128i* >(data + pos))) & 0xffff;
+        if (mask != 0) {
+            return pos + static_cast< size_t >(__builtin_ctz(mask));
+        }
+        pos += 16;
+    }
+    return scan_mm_valid_scalar(data, pos, size);
+}
+
+__attribute__((target("sse2")))
+size_t scan_mm_whitespace_sse2(const char *data, size_t pos, size_t size) {
+    while (pos + 16 <= size) {
+        unsigned mask = ~whitespace_mask_sse2(_mm_loadu_si128(reinterpret_cast< const __m128i* >(data + pos))) & 0xffff;
+        if (mask != 0) {
+            return pos + static_cast< size_t >(__builtin_ctz(mask));
+        }
+        pos += 16;
+    }
+    return scan_mm_whitespace_scalar(data, pos, size);
+}
+
+__attribute__((target("avx2")))
+size_t scan_mm_valid_avx2(const char *data, size_t pos, size_t size) {
+    while (pos + 32 <= size) {
+        unsigned mask = ~valid_mask_avx2(_mm256_loadu_si256(reinterpret_cast< const __m256i* >(data + pos)));
+        if (mask != 0) {
+            return pos + static_cast< size_t >(__builtin_ctz(mask));
+        }
+        pos += 32;
+    }
+    return scan_mm_valid_sse2(data, pos, size);
+}
+
+__attribute__((target("avx2")))
+size_t scan_mm_whitespace_avx2(const char *data, size_t pos, size_t size) {
+    while (pos + 32 <= size) {
+        unsigned mask = ~whitespace_mask_avx2(_mm256_loadu_si256(reinterpret_cast< const __m256i* >(data + pos)));
+        if (mask != 0) {
+            return pos + static_cast< size_t >(__builtin_ctz(mask));
+        }
+        pos += 32;
+    }
+    return scan_mm_whitespace_sse2(data, pos, size);
+}
+
+#endif
+
+typedef size_t (*ScanFunc)(const char*, size_t, size_t);
+
+struct ScannerImpl {
+    ScanFunc valid;
+    ScanFunc whitespace;
+};
+
+ScannerImpl get_impl(MMScanner scanner) {
+    switch (scanner) {
+#ifdef MM_SCANNER_X86
+    case MMScanner::AVX2:
+        return { scan_mm_valid_avx2, scan_mm_whitespace_avx2 };
+    case MMScanner::SSE2:
+        return { scan_mm_valid_sse2, scan_mm_whitespace_sse2 };
+#endif
+    default:
+        return { scan_mm_valid_scalar, scan_mm_whitespace_scalar };
+    }
+}
+
+MMScanner best_scanner() {
+    if (is_mm_scanner_supported(MMScanner::AVX2)) {
+        return MMScanner::AVX2;
+    }
+    if (is_mm_scanner_supported(MMScanner::SSE2)) {
+        return MMScanner::SSE2;
+    }
+    return MMScanner::SCALAR;
+}
+
+std::atomic< MMScanner > &current_scanner() {
+    static std::atomic< MMScanner > scanner(best_scanner());
+    return scanner;
+}
+
+std::atomic< ScanFunc > &current_valid() {
+    static std::atomic< ScanFunc > func(get_impl(current_scanner()).valid);
+    return func;
+}
+
+std::atomic< ScanFunc > &current_whitespace() {
+    static std::atomic< ScanFunc > func(get_impl(current_scanner()).whitespace);
+    return func;
+}
+
+}
+
+size_t scan_mm_valid(const char *data, size_t pos, size_t size) {
+    return current_valid().load(std::memory_order_relaxed)(data, pos, size);
+}
+
+size_t scan_mm_whitespace(const char *data, size_t pos, size_t size) {
+    return current_whitespace().load(std::memory_order_relaxed)(data, pos, size);
+}
+
+bool is_mm_scanner_supported(MMScanner scanner) {
+    switch (scanner) {
+    case MMScanner::SCALAR:
+        return true;
+#ifdef MM_SCANNER_X86
+    case MMScanner::SSE2:
+        return __builtin_cpu_supports("sse2");
+    case MMScanner::AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+MMScanner get_mm_scanner() {
+    return current_scanner();
+}
+
+bool set_mm_scanner(MMScanner scanner) {
+    if (!is_mm_scanner_supported(scanner)) {
+        return false;
+    }
+    auto impl = get_impl(scanner);
+    current_scanner() = scanner;
+    current_valid() = impl.valid;
+    current_whitespace() = impl.whitespace;
+    return true;
+}
+
+const char *mm_scanner_name(MMScanner scanner) {
+    switch (scanner) {
+    case MMScanner::SCALAR:
+        return "scalar";
+    case MMScanner::SSE2:
+        return "SSE2";
+    case MMScanner::AVX2:
+        return "AVX2";
+    default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+
+/* Bulk character classification for the Metamath tokenizer. Each function
+ * returns the first position in [pos, size) whose character does not
+ * belong to the given class, or size if there is none. The classes are
+ * the same as is_mm_valid() and is_mm_whitespace() in funds.h.
+ *
+ * Several implementations are available: a scalar one, which works
+ * everywhere, and SSE2 and AVX2 ones, which classify 16 or 32 bytes at a
+ * time. The best one supported by the running CPU is selected the first
+ * time the scanner is used; set_mm_scanner() can force a different one
+ * (for example to benchmark them against each other).
+ */
+
+enum class MMScanner {
+    SCALAR,
+    SSE2,
+    AVX2,
+};
+
+size_t scan_mm_valid(const char *data, size_t pos, size_t size);
+size_t scan_mm_whitespace(const char *data, size_t pos, size_t size);
+
+bool is_mm_scanner_supported(MMScanner scanner);
+MMScanner get_mm_scanner();
+// Return false (and do nothing) if the scanner is not supported
+bool set_mm_scanner(MMScanner scanner);
+const char *mm_scanner_name(MMScanner scanner);
@@ -1,6 +1,8 @@
 
 #include "sentengine.h"
 
+#include <algorithm>
+#include <iterator>
 #include <vector>
 
 #include "library.h"
@@ -8,34 +10,35 @@
 #include "toolbox.h"
 
 template< typename Map >
-static Sentence do_subst(const Sentence &sent, const Map &subst_map, const Library &lib) {
+static void do_subst(SentenceView sent, const Map &subst_map, const Library &lib, Sentence &new_sent) {
     (void) lib;
 
-    Sentence new_sent;
+    // The first pass looks up each symbol and computes the final size, so
+    // that the result is allocated once; the substitutions it finds are
+    // remembered for the second pass, which just copies
+    thread_local std::vector< const SentenceView* > substs;
+    substs.clear();
     size_t new_size = 0;
-    for (auto it = sent.begin(); it != sent.end(); it++) {
-        const SymTok &tok = *it;
-        auto it2 = subst_map.find(tok);
-        if (it2 == subst_map.end()) {
+    for (const SymTok tok : sent) {
+        auto it = subst_map.find(tok);
+        if (it == subst_map.end()) {
+            substs.push_back(nullptr);
             new_size += 1;
         } else {
-            const std::vector< SymTok > &subst = it2->second;
-            new_size += subst.size() - 1;
+            substs.push_back(&it->second);
+            new_size += it->second.size() - 1;
         }
     }
+    new_sent.clear();
     new_sent.reserve(new_size);
-    for (auto it = sent.begin(); it != sent.end(); it++) {
-        const SymTok &tok = *it;
-        auto it2 = subst_map.find(tok);
-        if (it2 == subst_map.end()) {
-            //assert(lib.is_constant(tok));
-            new_sent.push_back(tok);
+    for (size_t i = 0; i < sent.size(); i++) {
+        if (substs[i] == nullptr) {
+            //assert(lib.is_constant(sent[i]));
+            new_sent.push_back(sent[i]);
         } else {
-            const std::vector< SymTok > &subst = it2->second;
-            new_sent.insert(new_sent.end(), subst.begin() + 1, subst.end());
+            new_sent.insert(new_sent.end(), substs[i]->begin() + 1, substs[i]->end());
         }
     }
-    return new_sent;
 }
 
 ProofSentenceTraits<Sentence>::VarType ProofSentenceTraits<Sentence>::sym_to_var(const LibType &lib, SymTok sym) {
@@ -49,12 +52,12 @@ SymTok ProofSentenceTraits<Sentence>::var_to_sym(const LibType &lib, VarType var
 }
 
 ProofSentenceTraits<Sentence>::VarType ProofSentenceTraits<Sentence>::floating_to_var(const LibType &lib, LabTok label) {
-    return lib.get_sentence(label).at(1);
+    return lib.get_sentence_view(label).at(1);
 }
 
 SymTok ProofSentenceTraits<Sentence>::floating_to_type(const LibType &lib, LabTok label)
 {
-    return lib.get_sentence(label).at(0);
+    return lib.get_sentence_view(label).at(0);
 }
 
 SymTok ProofSentenceTraits<Sentence>::sentence_to_type(const LibType &lib, const ProofSentenceTraits<Sentence>::SentType &sent)
@@ -63,37 +66,61 @@ SymTok ProofSentenceTraits<Sentence>::sentence_to_type(const LibType &lib, const
     return sent.at(0);
 }
 
-const ProofSentenceTraits<Sentence>::SentType &ProofSentenceTraits<Sentence>::get_sentence(const LibType &lib, LabTok label)
+ProofSentenceTraits<Sentence>::LibSentType ProofSentenceTraits<Sentence>::get_sentence(const LibType &lib, LabTok label)
 {
-    return lib.get_sentence(label);
+    return lib.get_sentence_view(label);
 }
 
-void ProofSentenceTraits<Sentence>::check_match(const LibType &lib, LabTok label, const ProofSentenceTraits<Sentence>::SentType &stack, const ProofSentenceTraits<Sentence>::SentType &templ, const ProofSentenceTraits<Sentence>::SubstMapType &subst_map)
+ProofSentenceTraits<Sentence>::SentType ProofSentenceTraits<Sentence>::copy_sentence(const LibType &lib, const LibSentType &sent)
 {
-    ProofError< Sentence > err = { label, stack, templ, subst_map };
+    (void) lib;
+    return sent.to_sentence();
+}
+
+void ProofSentenceTraits<Sentence>::check_match(const LibType &lib, LabTok label, SentenceView stack, SentenceView templ, const ProofSentenceTraits<Sentence>::SubstMapType &subst_map)
+{
+    // The error is only built when needed, since it copies everything
+    auto fail = [&](const std::string &reason) {
+        throw ProofException< Sentence >(reason, { label, stack.to_sentence(), templ.to_sentence(), copy_subst_map(subst_map) });
+    };
     auto stack_it = stack.begin();
     for (auto it = templ.begin(); it != templ.end(); it++) {
         const SymTok &tok = *it;
         if (lib.is_constant(tok)) {
-            gio::assert_or_throw< ProofException< Sentence > >(tok == *stack_it, "Essential hypothesis does not match stack beacuse of wrong constant", err);
+            if (stack_it == stack.end() || tok != *stack_it) {
+                fail("Essential hypothesis does not match stack beacuse of wrong constant");
+            }
             stack_it++;
         } else {
-            const Sentence &subst = subst_map.at(tok);
-            assert(distance(stack_it, stack.end()) >= 0);
-            gio::assert_or_throw< ProofException< Sentence > >(subst.size() - 1 <= (size_t) distance(stack_it, stack.end()), "Essential hypothesis does not match stack because stack is shorter", err);
-            gio::assert_or_throw< ProofException< Sentence > >(equal(subst.begin() + 1, subst.end(), stack_it), "Essential hypothesis does not match stack because of wrong variable substitution", err);
+            const SentenceView subst = subst_map.at(tok);
+            assert(std::distance(stack_it, stack.end()) >= 0);
+            if (subst.size() - 1 > (size_t) std::distance(stack_it, stack.end())) {
+                fail("Essential hypothesis does not match stack because stack is shorter");
+            }
+            if (!std::equal(subst.begin() + 1, subst.end(), stack_it)) {
+                fail("Essential hypothesis does not match stack because of wrong variable substitution");
+            }
             stack_it += subst.size() - 1;
         }
     }
-    gio::assert_or_throw< ProofException< Sentence > >(stack_it == stack.end(), "Essential hypothesis does not match stack because stack is longer", err);
+    if (stack_it != stack.end()) {
+        fail("Essential hypothesis does not match stack because stack is longer");
+    }
 }
 
-ProofSentenceTraits<Sentence>::SentType ProofSentenceTraits<Sentence>::substitute(const LibType &lib, const ProofSentenceTraits<Sentence>::SentType &templ, const ProofSentenceTraits<Sentence>::SubstMapType &subst_map)
+ProofSentenceTraits<Sentence>::SentType ProofSentenceTraits<Sentence>::substitute(const LibType &lib, SentenceView templ, const ProofSentenceTraits<Sentence>::SubstMapType &subst_map)
 {
-    return do_subst(templ, subst_map, lib);
+    Sentence ret;
+    do_subst(templ, subst_map, lib, ret);
+    return ret;
 }
 
-ProofSentenceTraits<Sentence>::SentGenerator ProofSentenceTraits<Sentence>::get_variable_iterator(const LibType &lib, const ProofSentenceTraits<Sentence>::SentType &sent)
+void ProofSentenceTraits<Sentence>::substitute_into(const LibType &lib, SentenceView templ, const ProofSentenceTraits<Sentence>::SubstMapType &subst_map, ProofSentenceTraits<Sentence>::SentType &out)
+{
+    do_subst(templ, subst_map, lib, out);
+}
+
+ProofSentenceTraits<Sentence>::SentGenerator ProofSentenceTraits<Sentence>::get_variable_iterator(const LibType &lib, SentenceView sent)
 {
     return SentGenerator(lib, sent);
 }
@@ -103,26 +130,36 @@ bool ProofSentenceTraits<Sentence>::is_variable(const LibType &lib, ProofSentenc
     return !lib.is_constant(var);
 }
 
-Sentence ProofSentenceTraits<Sentence>::sentence_to_subst(const LibType &lib, const SentType &sent)
+SentenceView ProofSentenceTraits<Sentence>::sentence_to_subst(const LibType &lib, const SentType &sent)
 {
     (void) lib;
     return sent;
 }
 
-ProofSentenceTraits<Sentence>::SentGenerator::SentGenerator(const Library &lib, const Sentence &sent) : sentence(sent) {
+ProofSentenceTraits<Sentence>::ErrorSubstMapType ProofSentenceTraits<Sentence>::copy_subst_map(const SubstMapType &subst_map)
+{
+    ErrorSubstMapType ret;
+    for (const auto &it : subst_map) {
+        ret.insert(std::make_pair(it.first, it.second.to_sentence()));
+    }
+    return ret;
+}
+
+ProofSentenceTraits<Sentence>::SentGenerator::SentGenerator(const Library &lib, SentenceView sent) : sentence(sent) {
     (void) lib;
 }
 
-Sentence::const_iterator ProofSentenceTraits<Sentence>::SentGenerator::begin() const
+const SymTok *ProofSentenceTraits<Sentence>::SentGenerator::begin() const
 {
     return this->sentence.begin();
 }
 
-Sentence::const_iterator ProofSentenceTraits<Sentence>::SentGenerator::end() const
+const SymTok *ProofSentenceTraits<Sentence>::SentGenerator::end() const
 {
     return this->sentence.end();
 }
 
+template class VectorMap< SymTok, SentenceView >;
 template class VectorMap< SymTok, Sentence >;
 
 template struct ProofError< Sentence >;
@@ -10,21 +10,27 @@
 template<>
 struct ProofSentenceTraits< Sentence > final {
     typedef Sentence SentType;
-    typedef VectorMap< SymTok, Sentence > SubstMapType;
+    // Sentences of the library are not copied, but referred to by views
+    typedef SentenceView LibSentType;
+    /* Substitutions refer to the sentences on the stack instead of copying
+     * them, so a substitution map is only valid until those are popped;
+     * errors, which outlive the engine, carry an owning copy. */
+    typedef VectorMap< SymTok, SentenceView > SubstMapType;
     //typedef std::unordered_map< SymTok, Sentence > SubstMapType;
+    typedef VectorMap< SymTok, Sentence > ErrorSubstMapType;
     typedef SymTok VarType;
     typedef Library LibType;
     typedef LibraryToolbox AdvLibType;
 
     class SentGenerator {
     public:
-        SentGenerator(const Library &lib, const Sentence &sent);
-        Sentence::const_iterator begin() const;
-        Sentence::const_iterator end() const;
+        SentGenerator(const Library &lib, SentenceView sent);
+        const SymTok *begin() const;
+        const SymTok *end() const;
 
     private:
         //const Library &lib;
-        const Sentence &sentence;
+        SentenceView sentence;
     };
 
     static VarType sym_to_var(const LibType &lib, SymTok sym);
@@ -32,14 +38,19 @@ struct ProofSentenceTraits< Sentence > final {
     static VarType floating_to_var(const LibType &lib, LabTok label);
     static SymTok floating_to_type(const LibType &lib, LabTok label);
     static SymTok sentence_to_type(const LibType &lib, const SentType &sent);
-    static const SentType &get_sentence(const LibType &lib, LabTok label);
-    static void check_match(const LibType &lib, LabTok label, const SentType &stack, const SentType &templ, const SubstMapType &subst_map);
-    static SentType substitute(const LibType &lib, const SentType &templ, const SubstMapType &subst_map);
-    static SentGenerator get_variable_iterator(const LibType &lib, const SentType &sent);
+    static LibSentType get_sentence(const LibType &lib, LabTok label);
+    static SentType copy_sentence(const LibType &lib, const LibSentType &sent);
+    static void check_match(const LibType &lib, LabTok label, SentenceView stack, SentenceView templ, const SubstMapType &subst_map);
+    static SentType substitute(const LibType &lib, SentenceView templ, const SubstMapType &subst_map);
+    // Like substitute(), but reusing the memory of out
+    static void substitute_into(const LibType &lib, SentenceView templ, const SubstMapType &subst_map, SentType &out);
+    static SentGenerator get_variable_iterator(const LibType &lib, SentenceView sent);
     static bool is_variable(const LibType &lib, VarType var);
-    static Sentence sentence_to_subst(const LibType &lib, const SentType &sent);
+    static SentenceView sentence_to_subst(const LibType &lib, const SentType &sent);
+    static ErrorSubstMapType copy_subst_map(const SubstMapType &subst_map);
 };
 
+extern template class VectorMap< SymTok, SentenceView >;
 extern template class VectorMap< SymTok, Sentence >;
 
 extern template struct ProofError< Sentence >;
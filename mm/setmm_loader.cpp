@@ -3,19 +3,18 @@
 
 #include <giolib/proc_stats.h>
 
-#include "mm/reader.h"
+#include "mm/snapshot.h"
 #include "utils/utils.h"
 
 SetMmImpl::SetMmImpl(const boost::filesystem::path &filename, const boost::filesystem::path &cache_filename)
 {
     std::cout << "Reading database from file " << filename << " using cache in file " << cache_filename << std::endl;
     TextProgressBar tpb;
-    FileTokenizer ft(filename, &tpb);
-    Reader p(ft, false, true);
-    p.run();
+    auto snapshot_filename = filename;
+    snapshot_filename += ".snapshot";
+    this->lib = new LibraryImpl(read_library_with_snapshot(filename, snapshot_filename, &tpb));
     tpb.finished();
-    this->lib = new LibraryImpl(p.get_library());
-    std::shared_ptr< ToolboxCache > cache = std::make_shared< FileToolboxCache >(cache_filename);
+    std::shared_ptr< ToolboxCache > cache = std::make_shared< SnapshotToolboxCache >(cache_filename);
     std::cout << "Memory usage after loading the library: " << size_to_string(gio::get_used_memory()) << std::endl;
     this->tb = new LibraryToolbox(*this->lib, "|-", cache);
     std::cout << "Memory usage after creating the toolbox: " << size_to_string(gio::get_used_memory()) << std::endl;
@@ -0,0 +1,550 @@
+#include "snapshot.h"
+
+#include <array>
+#include <iostream>
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include "reader.h"
+#include "proof.h"
+#include "utils/utils.h"
+
+static const char snapshot_magic[8] = { 'M', 'M', 'P', 'P', 'S', 'N', 'A', 'P' };
+static const size_t snapshot_alignment = 8;
+
+SnapshotWriter::SnapshotWriter(const std::string &digest)
+{
+    this->write_bytes(snapshot_magic, sizeof(snapshot_magic));
+    this->write< uint32_t >(snapshot_version);
+    this->write_string(digest);
+}
+
+void SnapshotWriter::begin_section(const std::string &name)
+{
+    if (!this->sections.empty()) {
+        std::get< 2 >(this->sections.back()) = this->buf.size();
+    }
+    this->sections.push_back(std::make_tuple(name, this->buf.size(), 0));
+}
+
+void SnapshotBuffer::write_bytes(const void *data, size_t len)
+{
+    const char *ptr = static_cast< const char* >(data);
+    this->buf.insert(this->buf.end(), ptr, ptr + len);
+    this->buf.resize((this->buf.size() + snapshot_alignment - 1) / snapshot_alignment * snapshot_alignment);
+}
+
+void SnapshotBuffer::write_string(std::string_view s)
+{
+    this->write_array(s.data(), s.size());
+}
+
+void SnapshotBuffer::write_strings(const std::vector<std::string> &v)
+{
+    SnapshotJaggedArrayBuilder< char > builder;
+    for (const auto &s : v) {
+        builder.push_row(s.begin(), s.end());
+    }
+    this->write_jagged(builder);
+}
+
+std::string_view SnapshotBuffer::get_data() const
+{
+    return std::string_view(this->buf.data(), this->buf.size());
+}
+
+void SnapshotWriter::copy_section(const std::string &name, std::string_view data)
+{
+    assert(data.size() % snapshot_alignment == 0);
+    this->begin_section(name);
+    this->write_bytes(data.data(), data.size());
+}
+
+/* The snapshot is first written to a temporary file and then moved in
+ * place, so that other processes never map a partially written file. The
+ * temporary file has a unique name, so that processes writing the same
+ * snapshot at the same time do not write to the same file.
+ */
+bool SnapshotWriter::store(const boost::filesystem::path &filename) const
+{
+    SnapshotBuffer toc;
+    for (size_t i = 0; i < this->sections.size(); i++) {
+        const auto &section = this->sections[i];
+        uint64_t end = i + 1 == this->sections.size() ? this->buf.size() : std::get< 2 >(section);
+        toc.write_string(std::get< 0 >(section));
+        toc.write< uint64_t >(std::get< 1 >(section));
+        toc.write< uint64_t >(end);
+    }
+    toc.write< uint64_t >(this->sections.size());
+    toc.write< uint64_t >(this->buf.size());
+
+    const auto tmp_filename = filename.parent_path() / boost::filesystem::unique_path("%%%%-%%%%.tmp");
+    {
+        boost::filesystem::ofstream fout(tmp_filename, std::ios_base::binary);
+        if (fout.fail()) {
+            return false;
+        }
+        fout.write(this->buf.data(), static_cast< std::streamsize >(this->buf.size()));
+        fout.write(toc.get_data().data(), static_cast< std::streamsize >(toc.get_data().size()));
+        if (fout.fail()) {
+            return false;
+        }
+    }
+    boost::system::error_code ec;
+    boost::filesystem::rename(tmp_filename, filename, ec);
+    if (ec) {
+        boost::filesystem::remove(tmp_filename, ec);
+        return false;
+    }
+    return true;
+}
+
+SnapshotCursor::SnapshotCursor(const char *begin, const char *end) : cur(begin), end(end)
+{
+}
+
+const char *SnapshotCursor::read_bytes(size_t len)
+{
+    size_t padded = (len + snapshot_alignment - 1) / snapshot_alignment * snapshot_alignment;
+    gio::assert_or_throw< std::runtime_error >(padded >= len && padded <= static_cast< size_t >(this->end - this->cur), "Truncated snapshot section");
+    const char *ret = this->cur;
+    this->cur += padded;
+    return ret;
+}
+
+std::string_view SnapshotCursor::read_string()
+{
+    auto arr = this->read_array< char >();
+    return std::string_view(arr.data(), arr.size());
+}
+
+std::vector<std::string> SnapshotCursor::read_strings()
+{
+    auto jagged = this->read_jagged< char >();
+    std::vector< std::string > ret;
+    ret.reserve(jagged.size());
+    for (size_t i = 0; i < jagged.size(); i++) {
+        ret.emplace_back(jagged[i].begin(), jagged[i].end());
+    }
+    return ret;
+}
+
+bool SnapshotCursor::at_end() const
+{
+    return this->cur == this->end;
+}
+
+bool SnapshotReader::open(const boost::filesystem::path &filename)
+{
+    this->close();
+    boost::system::error_code ec;
+    auto size = boost::filesystem::file_size(filename, ec);
+    if (ec || size < sizeof(snapshot_magic) + 2 * sizeof(uint64_t)) {
+        return false;
+    }
+    try {
+        this->file = std::make_shared< boost::iostreams::mapped_file_source >(filename.string());
+    } catch (const std::ios_base::failure&) {
+        this->file = nullptr;
+        return false;
+    }
+    const char *data = this->file->data();
+    try {
+        SnapshotCursor header(data, data + this->file->size());
+        if (std::memcmp(header.read< std::array< char, 8 > >().data(), snapshot_magic, sizeof(snapshot_magic)) != 0) {
+            return false;
+        }
+        if (header.read< uint32_t >() != snapshot_version) {
+            return false;
+        }
+        this->digest = std::string(header.read_string());
+
+        SnapshotCursor trailer(data + this->file->size() - 2 * sizeof(uint64_t), data + this->file->size());
+        auto sections_num = trailer.read< uint64_t >();
+        auto toc_begin = trailer.read< uint64_t >();
+        gio::assert_or_throw< std::runtime_error >(toc_begin <= this->file->size(), "Malformed snapshot table of contents");
+        SnapshotCursor toc(data + toc_begin, data + this->file->size());
+        for (uint64_t i = 0; i < sections_num; i++) {
+            std::string name(toc.read_string());
+            auto begin = toc.read< uint64_t >();
+            auto end = toc.read< uint64_t >();
+            gio::assert_or_throw< std::runtime_error >(begin <= end && end <= toc_begin, "Malformed snapshot table of contents");
+            this->sections[name] = std::make_pair(begin, end);
+        }
+    } catch (const std::runtime_error&) {
+        this->sections.clear();
+        return false;
+    }
+    return true;
+}
+
+void SnapshotReader::close()
+{
+    this->sections.clear();
+    this->digest.clear();
+    // The file is unmapped when the last handle returned by get_mapping() goes away
+    this->file = nullptr;
+}
+
+const std::string &SnapshotReader::get_digest() const
+{
+    return this->digest;
+}
+
+bool SnapshotReader::has_section(const std::string &name) const
+{
+    return this->sections.find(name) != this->sections.end();
+}
+
+SnapshotCursor SnapshotReader::get_section(const std::string &name) const
+{
+    auto it = this->sections.find(name);
+    gio::assert_or_throw< std::runtime_error >(it != this->sections.end(), "Missing snapshot section " + name);
+    return SnapshotCursor(this->file->data() + it->second.first, this->file->data() + it->second.second);
+}
+
+std::string_view SnapshotReader::get_section_data(const std::string &name) const
+{
+    auto it = this->sections.find(name);
+    gio::assert_or_throw< std::runtime_error >(it != this->sections.end(), "Missing snapshot section " + name);
+    return std::string_view(this->file->data() + it->second.first, it->second.second - it->second.first);
+}
+
+std::shared_ptr< const void > SnapshotReader::get_mapping() const
+{
+    return this->file;
+}
+
+template< typename TokType >
+static std::vector< std::string > string_cache_to_vector(const std::unordered_map< TokType, std::string > &cache) {
+    std::vector< std::string > ret(cache.size());
+    for (const auto &x : cache) {
+        assert(x.first.val() >= 1 && x.first.val() <= ret.size());
+        ret[x.first.val() - 1] = x.second;
+    }
+    return ret;
+}
+
+static void write_dists(SnapshotJaggedArrayBuilder< SymTok > &builder, const std::set< std::pair< SymTok, SymTok > > &dists) {
+    for (const auto &dist : dists) {
+        builder.push_value(dist.first);
+        builder.push_value(dist.second);
+    }
+    builder.end_row();
+}
+
+static std::set< std::pair< SymTok, SymTok > > read_dists(const SnapshotArray< SymTok > &arr) {
+    std::set< std::pair< SymTok, SymTok > > ret;
+    gio::assert_or_throw< std::runtime_error >(arr.size() % 2 == 0, "Malformed snapshot distinct variables");
+    for (size_t i = 0; i < arr.size(); i += 2) {
+        ret.insert(ret.end(), std::make_pair(arr[i], arr[i+1]));
+    }
+    return ret;
+}
+
+enum AssertionSnapshotFlags : uint8_t {
+    ASS_VALID = 1,
+    ASS_THEOREM = 2,
+    ASS_HAS_PROOF = 4,
+    ASS_COMPRESSED_PROOF = 8,
+    ASS_UNCOMPRESSED_PROOF = 16,
+};
+
+/* Everything is stored by columns, so that most of the library is made of
+ * a few large arrays. */
+void LibrarySnapshot::store(SnapshotWriter &writer, const LibraryImpl &lib)
+{
+    writer.begin_section("library");
+    writer.write_strings(string_cache_to_vector(lib.syms.get_cache()));
+    writer.write_strings(string_cache_to_vector(lib.labels.get_cache()));
+    std::vector< uint8_t > consts(lib.consts.begin(), lib.consts.end());
+    writer.write_vector(consts);
+
+    const size_t slots_num = lib.get_slots_num();
+    SnapshotJaggedArrayBuilder< SymTok > sentences;
+    for (size_t i = 0; i < slots_num; i++) {
+        auto sent = lib.get_sentence_view(LabTok(static_cast< LabTok::val_type >(i)));
+        sentences.push_row(sent.begin(), sent.end());
+    }
+    writer.write_jagged(sentences);
+    writer.write_vector(lib.sentence_types);
+
+    std::vector< uint8_t > flags;
+    std::vector< LabTok > theses;
+    std::vector< LabTok > numbers;
+    SnapshotJaggedArrayBuilder< LabTok > float_hyps, ess_hyps, opt_hyps, proof_labels;
+    SnapshotJaggedArrayBuilder< SymTok > mand_dists, opt_dists;
+    SnapshotJaggedArrayBuilder< CodeTok > proof_codes;
+    std::vector< std::string > comments;
+    for (size_t i = 0; i < slots_num; i++) {
+        const auto &ass = lib.get_assertion(LabTok(static_cast< LabTok::val_type >(i)));
+        uint8_t flag = 0;
+        if (ass.is_valid()) {
+            flag |= ASS_VALID;
+            flag |= ass.is_theorem() ? ASS_THEOREM : 0;
+            flag |= ass.has_proof() ? ASS_HAS_PROOF : 0;
+        }
+        auto proof = ass.get_proof();
+        if (auto compressed = std::dynamic_pointer_cast< const CompressedProof >(proof)) {
+            flag |= ASS_COMPRESSED_PROOF;
+            proof_labels.push_row(compressed->get_refs().begin(), compressed->get_refs().end());
+            proof_codes.push_row(compressed->get_codes().begin(), compressed->get_codes().end());
+        } else if (auto uncompressed = std::dynamic_pointer_cast< const UncompressedProof >(proof)) {
+            flag |= ASS_UNCOMPRESSED_PROOF;
+            proof_labels.push_row(uncompressed->get_labels().begin(), uncompressed->get_labels().end());
+            proof_codes.end_row();
+        } else {
+            proof_labels.end_row();
+            proof_codes.end_row();
+        }
+        flags.push_back(flag);
+        theses.push_back(ass.get_thesis());
+        numbers.push_back(ass.get_number());
+        float_hyps.push_row(ass.get_float_hyps().begin(), ass.get_float_hyps().end());
+        ess_hyps.push_row(ass.get_ess_hyps().begin(), ass.get_ess_hyps().end());
+        opt_hyps.push_row(ass.get_opt_hyps().begin(), ass.get_opt_hyps().end());
+        write_dists(mand_dists, ass.get_mand_dists());
+        write_dists(opt_dists, ass.get_opt_dists());
+        comments.push_back(ass.get_comment());
+    }
+    writer.write_vector(flags);
+    writer.write_vector(theses);
+    writer.write_vector(numbers);
+    writer.write_jagged(float_hyps);
+    writer.write_jagged(ess_hyps);
+    writer.write_jagged(opt_hyps);
+    writer.write_jagged(mand_dists);
+    writer.write_jagged(opt_dists);
+    writer.write_strings(comments);
+    writer.write_jagged(proof_labels);
+    writer.write_jagged(proof_codes);
+
+    const auto &frame = lib.final_stack_frame;
+    writer.write_vector(std::vector< SymTok >(frame.vars.begin(), frame.vars.end()));
+    SnapshotJaggedArrayBuilder< SymTok > frame_dists;
+    write_dists(frame_dists, frame.dists);
+    writer.write_jagged(frame_dists);
+    writer.write_vector(frame.types);
+    writer.write_vector(frame.hyps);
+
+    const auto &add = lib.addendum;
+    writer.write_strings(add.htmldefs);
+    writer.write_strings(add.althtmldefs);
+    writer.write_strings(add.latexdefs);
+    writer.write_strings({ add.htmlcss, add.htmlfont, add.htmltitle, add.htmlhome, add.htmlbibliography,
+                           add.exthtmltitle, add.exthtmlhome, add.exthtmllabel, add.exthtmlbibliography,
+                           add.htmlvarcolor, add.htmldir, add.althtmldir });
+
+    std::vector< SymTok > syntax;
+    for (const auto &x : lib.parsing_addendum.syntax) {
+        syntax.push_back(x.first);
+        syntax.push_back(x.second);
+    }
+    writer.write_vector(syntax);
+    writer.write_string(lib.parsing_addendum.unambiguous);
+
+    writer.write(lib.max_number);
+}
+
+bool LibrarySnapshot::load(const SnapshotReader &reader, LibraryImpl &lib)
+{
+    if (!reader.has_section("library")) {
+        return false;
+    }
+    try {
+        LibraryImpl res;
+        auto data = std::make_shared< LibrarySnapshotData >();
+        data->mapping = reader.get_mapping();
+        auto cur = reader.get_section("library");
+        for (const auto &sym : cur.read_strings()) {
+            res.syms.create(sym);
+        }
+        for (const auto &label : cur.read_strings()) {
+            res.labels.create(label);
+        }
+        auto consts = cur.read_array< uint8_t >();
+        res.consts.assign(consts.begin(), consts.end());
+
+        data->sentences = cur.read_jagged< SymTok >();
+        res.sentence_types = cur.read_vector< SentenceType >();
+
+        data->flags = cur.read_array< uint8_t >();
+        data->theses = cur.read_array< LabTok >();
+        data->numbers = cur.read_array< LabTok >();
+        data->float_hyps = cur.read_jagged< LabTok >();
+        data->ess_hyps = cur.read_jagged< LabTok >();
+        data->opt_hyps = cur.read_jagged< LabTok >();
+        data->mand_dists = cur.read_jagged< SymTok >();
+        data->opt_dists = cur.read_jagged< SymTok >();
+        data->comments = cur.read_jagged< char >();
+        data->proof_labels = cur.read_jagged< LabTok >();
+        data->proof_codes = cur.read_jagged< CodeTok >();
+        size_t num = data->flags.size();
+        gio::assert_or_throw< std::runtime_error >(data->sentences.size() == num && res.sentence_types.size() == num, "Inconsistent snapshot sentences");
+        gio::assert_or_throw< std::runtime_error >(data->theses.size() == num && data->numbers.size() == num && data->float_hyps.size() == num &&
+                                                   data->ess_hyps.size() == num && data->opt_hyps.size() == num && data->mand_dists.size() == num &&
+                                                   data->opt_dists.size() == num && data->comments.size() == num && data->proof_labels.size() == num &&
+                                                   data->proof_codes.size() == num, "Inconsistent snapshot assertions");
+        data->assertions = std::make_unique< std::atomic< const Assertion* >[] >(num);
+
+        auto &frame = res.final_stack_frame;
+        auto frame_vars = cur.read_array< SymTok >();
+        frame.vars = std::set< SymTok >(frame_vars.begin(), frame_vars.end());
+        auto frame_dists = cur.read_jagged< SymTok >();
+        gio::assert_or_throw< std::runtime_error >(frame_dists.size() == 1, "Malformed snapshot stack frame");
+        frame.dists = read_dists(frame_dists[0]);
+        frame.types = cur.read_vector< LabTok >();
+        frame.types_set = std::set< LabTok >(frame.types.begin(), frame.types.end());
+        frame.hyps = cur.read_vector< LabTok >();
+
+        auto &add = res.addendum;
+        add.htmldefs = cur.read_strings();
+        add.althtmldefs = cur.read_strings();
+        add.latexdefs = cur.read_strings();
+        auto add_strings = cur.read_strings();
+        gio::assert_or_throw< std::runtime_error >(add_strings.size() == 12, "Malformed snapshot addendum");
+        std::tie(add.htmlcss, add.htmlfont, add.htmltitle, add.htmlhome, add.htmlbibliography,
+                 add.exthtmltitle, add.exthtmlhome, add.exthtmllabel, add.exthtmlbibliography,
+                 add.htmlvarcolor, add.htmldir, add.althtmldir) =
+                std::tie(add_strings[0], add_strings[1], add_strings[2], add_strings[3], add_strings[4], add_strings[5],
+                         add_strings[6], add_strings[7], add_strings[8], add_strings[9], add_strings[10], add_strings[11]);
+
+        auto syntax = cur.read_array< SymTok >();
+        gio::assert_or_throw< std::runtime_error >(syntax.size() % 2 == 0, "Malformed snapshot syntax");
+        for (size_t i = 0; i < syntax.size(); i += 2) {
+            res.parsing_addendum.syntax[syntax[i]] = syntax[i+1];
+        }
+        res.parsing_addendum.unambiguous = std::string(cur.read_string());
+
+        res.max_number = cur.read< LabTok >();
+        gio::assert_or_throw< std::runtime_error >(cur.at_end(), "Trailing data in snapshot section");
+
+        res.snapshot = std::move(data);
+        lib = std::move(res);
+    } catch (const std::runtime_error &e) {
+        std::cerr << "Could not load library snapshot: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+LibrarySnapshotData::~LibrarySnapshotData()
+{
+    if (this->assertions != nullptr) {
+        for (size_t i = 0; i < this->size(); i++) {
+            delete this->assertions[i].load();
+        }
+    }
+}
+
+size_t LibrarySnapshotData::size() const
+{
+    return this->flags.size();
+}
+
+SentenceView LibrarySnapshotData::get_sentence_view(LabTok label) const
+{
+    if (label.val() >= this->sentences.size()) {
+        throw std::out_of_range("LibrarySnapshotData::get_sentence_view");
+    }
+    auto sent = this->sentences[label.val()];
+    return SentenceView(sent.data(), sent.size());
+}
+
+Assertion LibrarySnapshotData::build_assertion(size_t i) const
+{
+    if (!(this->flags[i] & ASS_VALID)) {
+        return Assertion();
+    }
+    auto opt_hyps_arr = this->opt_hyps[i];
+    auto comment = this->comments[i];
+    Assertion ass(this->flags[i] & ASS_THEOREM, this->flags[i] & ASS_HAS_PROOF, read_dists(this->mand_dists[i]), read_dists(this->opt_dists[i]),
+                  this->float_hyps[i].to_vector(), this->ess_hyps[i].to_vector(), std::set< LabTok >(opt_hyps_arr.begin(), opt_hyps_arr.end()),
+                  this->theses[i], this->numbers[i], std::string(comment.begin(), comment.end()));
+    if (this->flags[i] & ASS_COMPRESSED_PROOF) {
+        ass.set_proof(std::make_shared< CompressedProof >(this->proof_labels[i].to_vector(), this->proof_codes[i].to_vector()));
+    } else if (this->flags[i] & ASS_UNCOMPRESSED_PROOF) {
+        ass.set_proof(std::make_shared< UncompressedProof >(this->proof_labels[i].to_vector()));
+    }
+    return ass;
+}
+
+const Assertion &LibrarySnapshotData::get_assertion(LabTok label) const
+{
+    if (label.val() >= this->size()) {
+        throw std::out_of_range("LibrarySnapshotData::get_assertion");
+    }
+    auto &slot = this->assertions[label.val()];
+    const Assertion *ass = slot.load();
+    if (ass == nullptr) {
+        auto new_ass = std::make_unique< const Assertion >(this->build_assertion(label.val()));
+        // If another thread got there first, use its copy
+        if (slot.compare_exchange_strong(ass, new_ass.get())) {
+            ass = new_ass.release();
+        }
+    }
+    return *ass;
+}
+
+/* The digest of a database is made of the names, sizes and hashes of all
+ * the files it is made of, in the order in which they are included. */
+static std::string files_digest(const std::vector< boost::filesystem::path > &files) {
+    std::string digest;
+    for (const auto &filename : files) {
+        boost::system::error_code ec;
+        auto size = boost::filesystem::file_size(filename, ec);
+        if (ec) {
+            return "";
+        }
+        HashSink hasher;
+        if (size > 0) {
+            boost::iostreams::mapped_file_source file(filename.string());
+            hasher.write(file.data(), static_cast< std::streamsize >(file.size()));
+        }
+        digest += filename.string();
+        digest += '\0';
+        digest += std::to_string(size);
+        digest += '\0';
+        digest += hasher.get_digest();
+    }
+    return digest;
+}
+
+LibraryImpl read_library_with_snapshot(const boost::filesystem::path &filename, const boost::filesystem::path &snapshot_filename, Reportable *reportable)
+{
+    {
+        SnapshotReader reader;
+        if (reader.open(snapshot_filename) && reader.has_section("files")) {
+            try {
+                auto files_strings = reader.get_section("files").read_strings();
+                std::vector< boost::filesystem::path > files(files_strings.begin(), files_strings.end());
+                if (!files.empty() && files[0] == filename && files_digest(files) == reader.get_digest()) {
+                    LibraryImpl lib;
+                    if (LibrarySnapshot::load(reader, lib)) {
+                        return lib;
+                    }
+                }
+            } catch (const std::exception &e) {
+                std::cerr << "Could not load library snapshot: " << e.what() << std::endl;
+            }
+        }
+    }
+
+    MappedFileTokenizer ft(filename, reportable);
+    Reader p(ft, false, true);
+    p.run();
+    const auto &files = ft.get_files();
+    SnapshotWriter writer(files_digest(files));
+    writer.begin_section("files");
+    std::vector< std::string > files_strings;
+    for (const auto &file : files) {
+        files_strings.push_back(file.string());
+    }
+    writer.write_strings(files_strings);
+    LibrarySnapshot::store(writer, p.get_library());
+    if (!writer.store(snapshot_filename)) {
+        std::cerr << "Could not write library snapshot to " << snapshot_filename << std::endl;
+    }
+    return p.get_library();
+}
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <tuple>
+#include <unordered_map>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <giolib/assert.h>
+
+#include "library.h"
+#include "tokenizer.h"
+
+/* Snapshots are binary files that store data computed from a database,
+ * so that it can be loaded back much faster than it can be recomputed.
+ * A snapshot begins with a header containing a magic string, the format
+ * version and the digest of the data it was computed from. Then there are
+ * a number of named sections, each of which is a sequence of fields
+ * aligned to 8 bytes; a table of contents at the end of the file maps
+ * each name to the position of its section, so that sections can be
+ * written and read independently of each other.
+ *
+ * Arrays of trivially copyable values are stored as they are in memory,
+ * and the file is mapped when it is read, so arrays can be accessed in
+ * place with no deserialization. Since type sizes and endianness are not
+ * normalized, a snapshot is only meant to be read by the same build that
+ * wrote it; bump snapshot_version whenever the layout of some section
+ * changes.
+ */
+
+const uint32_t snapshot_version = 1;
+
+template< typename T >
+class SnapshotArray {
+public:
+    SnapshotArray() : data_(nullptr), size_(0) {}
+    SnapshotArray(const T *data, size_t size) : data_(data), size_(size) {}
+    const T *data() const { return this->data_; }
+    size_t size() const { return this->size_; }
+    bool empty() const { return this->size_ == 0; }
+    const T *begin() const { return this->data_; }
+    const T *end() const { return this->data_ + this->size_; }
+    const T &operator[](size_t i) const { return this->data_[i]; }
+    std::vector< T > to_vector() const { return std::vector< T >(this->begin(), this->end()); }
+
+private:
+    const T *data_;
+    size_t size_;
+};
+
+/* A sequence of rows of variable length, stored as a flat array of
+ * values and an array of row offsets (with one more element than the
+ * number of rows). */
+template< typename T >
+class SnapshotJaggedArray {
+public:
+    SnapshotJaggedArray() = default;
+    SnapshotJaggedArray(SnapshotArray< uint64_t > offsets, SnapshotArray< T > values) : offsets(offsets), values(values) {
+        gio::assert_or_throw< std::runtime_error >(!offsets.empty() && offsets[offsets.size()-1] == values.size(), "Malformed snapshot jagged array");
+    }
+    size_t size() const { return this->offsets.size() - 1; }
+    SnapshotArray< T > operator[](size_t i) const {
+        gio::assert_or_throw< std::runtime_error >(this->offsets[i] <= this->offsets[i+1] && this->offsets[i+1] <= this->values.size(), "Malformed snapshot jagged array");
+        return SnapshotArray< T >(this->values.data() + this->offsets[i], this->offsets[i+1] - this->offsets[i]);
+    }
+    // All the values of all the rows, one after the other
+    SnapshotArray< T > get_values() const { return this->values; }
+
+private:
+    SnapshotArray< uint64_t > offsets;
+    SnapshotArray< T > values;
+};
+
+template< typename T >
+class SnapshotJaggedArrayBuilder {
+public:
+    SnapshotJaggedArrayBuilder() : offsets({ 0 }) {}
+    template< typename It >
+    void push_row(It begin, It end) {
+        this->values.insert(this->values.end(), begin, end);
+        this->offsets.push_back(this->values.size());
+    }
+    void push_value(const T &x) {
+        this->values.push_back(x);
+    }
+    void end_row() {
+        this->offsets.push_back(this->values.size());
+    }
+    const std::vector< uint64_t > &get_offsets() const { return this->offsets; }
+    const std::vector< T > &get_values() const { return this->values; }
+
+private:
+    std::vector< uint64_t > offsets;
+    std::vector< T > values;
+};
+
+/* An in-memory sequence of fields, each padded to 8 bytes, as they are
+ * stored in snapshot sections. */
+class SnapshotBuffer {
+public:
+    template< typename T >
+    void write(const T &x) {
+        static_assert(std::is_trivially_copyable< T >::value, "Only trivially copyable types can be stored in snapshots");
+        this->write_bytes(&x, sizeof(T));
+    }
+    template< typename T >
+    void write_array(const T *data, size_t num) {
+        static_assert(std::is_trivially_copyable< T >::value, "Only trivially copyable types can be stored in snapshots");
+        this->write< uint64_t >(num);
+        this->write_bytes(data, num * sizeof(T));
+    }
+    template< typename T >
+    void write_vector(const std::vector< T > &v) {
+        this->write_array(v.data(), v.size());
+    }
+    template< typename T >
+    void write_jagged(const SnapshotJaggedArrayBuilder< T > &builder) {
+        this->write_vector(builder.get_offsets());
+        this->write_vector(builder.get_values());
+    }
+    void write_string(std::string_view s);
+    void write_strings(const std::vector< std::string > &v);
+    std::string_view get_data() const;
+
+protected:
+    void write_bytes(const void *data, size_t len);
+
+    std::vector< char > buf;
+};
+
+class SnapshotWriter : public SnapshotBuffer {
+public:
+    explicit SnapshotWriter(const std::string &digest);
+    void begin_section(const std::string &name);
+    // Copy a whole section, for example built in a SnapshotBuffer or
+    // returned by SnapshotReader::get_section_data(), without decoding it
+    void copy_section(const std::string &name, std::string_view data);
+    bool store(const boost::filesystem::path &filename) const;
+
+private:
+    std::vector< std::tuple< std::string, uint64_t, uint64_t > > sections;
+};
+
+class SnapshotCursor {
+public:
+    SnapshotCursor(const char *begin, const char *end);
+    template< typename T >
+    T read() {
+        static_assert(std::is_trivially_copyable< T >::value, "Only trivially copyable types can be stored in snapshots");
+        T ret;
+        std::memcpy(&ret, this->read_bytes(sizeof(T)), sizeof(T));
+        return ret;
+    }
+    template< typename T >
+    SnapshotArray< T > read_array() {
+        static_assert(std::is_trivially_copyable< T >::value, "Only trivially copyable types can be stored in snapshots");
+        auto num = this->read< uint64_t >();
+        gio::assert_or_throw< std::runtime_error >(num <= static_cast< size_t >(this->end - this->cur) / std::max< size_t >(sizeof(T), 1), "Truncated snapshot section");
+        return SnapshotArray< T >(reinterpret_cast< const T* >(this->read_bytes(num * sizeof(T))), num);
+    }
+    template< typename T >
+    std::vector< T > read_vector() {
+        return this->read_array< T >().to_vector();
+    }
+    template< typename T >
+    SnapshotJaggedArray< T > read_jagged() {
+        auto offsets = this->read_array< uint64_t >();
+        auto values = this->read_array< T >();
+        return SnapshotJaggedArray< T >(offsets, values);
+    }
+    std::string_view read_string();
+    std::vector< std::string > read_strings();
+    bool at_end() const;
+
+private:
+    const char *read_bytes(size_t len);
+
+    const char *cur;
+    const char *end;
+};
+
+class SnapshotReader {
+public:
+    /* Return false if the file does not exist or is not a snapshot of the
+     * current version. */
+    bool open(const boost::filesystem::path &filename);
+    void close();
+    const std::string &get_digest() const;
+    bool has_section(const std::string &name) const;
+    SnapshotCursor get_section(const std::string &name) const;
+    std::string_view get_section_data(const std::string &name) const;
+    /* Arrays read from the snapshot point inside the mapped file; holding
+     * the returned handle keeps them valid even after close(). */
+    std::shared_ptr< const void > get_mapping() const;
+
+private:
+    std::shared_ptr< boost::iostreams::mapped_file_source > file;
+    std::string digest;
+    std::unordered_map< std::string, std::pair< uint64_t, uint64_t > > sections;
+};
+
+/* The sentences and assertions of a library loaded from a snapshot, read
+ * in place from the mapped file. Each Assertion object is built the first
+ * time it is requested and then kept; all methods can be called
+ * concurrently. */
+class LibrarySnapshotData {
+public:
+    LibrarySnapshotData() = default;
+    LibrarySnapshotData(const LibrarySnapshotData &x) = delete;
+    LibrarySnapshotData &operator=(const LibrarySnapshotData &x) = delete;
+    ~LibrarySnapshotData();
+
+    // Labels are numbered from 1, so this is one more than the number of labels
+    size_t size() const;
+    SentenceView get_sentence_view(LabTok label) const;
+    const Assertion &get_assertion(LabTok label) const;
+
+private:
+    friend class LibrarySnapshot;
+
+    Assertion build_assertion(size_t i) const;
+
+    std::shared_ptr< const void > mapping;
+    SnapshotJaggedArray< SymTok > sentences;
+    SnapshotArray< uint8_t > flags;
+    SnapshotArray< LabTok > theses;
+    SnapshotArray< LabTok > numbers;
+    SnapshotJaggedArray< LabTok > float_hyps;
+    SnapshotJaggedArray< LabTok > ess_hyps;
+    SnapshotJaggedArray< LabTok > opt_hyps;
+    SnapshotJaggedArray< SymTok > mand_dists;
+    SnapshotJaggedArray< SymTok > opt_dists;
+    SnapshotJaggedArray< char > comments;
+    SnapshotJaggedArray< LabTok > proof_labels;
+    SnapshotJaggedArray< CodeTok > proof_codes;
+
+    mutable std::unique_ptr< std::atomic< const Assertion* >[] > assertions;
+};
+
+/* Store and load all the content of a LibraryImpl in the "library"
+ * section of a snapshot. A loaded library keeps its sentences and
+ * assertions in the snapshot (see LibrarySnapshotData) until it is first
+ * modified. */
+class LibrarySnapshot {
+public:
+    static void store(SnapshotWriter &writer, const LibraryImpl &lib);
+    static bool load(const SnapshotReader &reader, LibraryImpl &lib);
+};
+
+/* Read a database without executing proofs, as the loaders do. If
+ * snapshot_filename contains a snapshot of the same database (including
+ * the files it includes), the library is loaded from there; otherwise the
+ * database is read and the snapshot is (re)written.
+ */
+LibraryImpl read_library_with_snapshot(const boost::filesystem::path &filename, const boost::filesystem::path &snapshot_filename, Reportable *reportable = nullptr);
@@ -1,5 +1,12 @@
 
 #include "tokenizer.h"
+#include "scanner.h"
+
+#include <cstring>
+
+#include <boost/filesystem/operations.hpp>
+
+#include <giolib/assert.h>
 
 std::vector< std::string > tokenize(const std::string &in) {
 
@@ -178,6 +185,166 @@ FileTokenizer::~FileTokenizer()
     delete this->cascade;
 }
 
+std::pair<bool, std::string_view> TokenGenerator::next_view()
+{
+    auto res = this->next();
+    this->last_token = std::move(res.second);
+    return std::make_pair(res.first, std::string_view(this->last_token));
+}
+
+bool TokenGenerator::has_persistent_views() const
+{
+    return false;
+}
+
 TokenGenerator::~TokenGenerator()
 {
 }
+
+MappedFileTokenizer::MappedFileTokenizer(const boost::filesystem::path &filename, Reportable *reportable) :
+    base_path(filename.parent_path()), files(std::make_shared< std::vector< boost::filesystem::path > >()), reportable(reportable)
+{
+    this->map_file(filename);
+    if (this->reportable != nullptr && !this->data.empty()) {
+        this->reportable->set_total(static_cast< double >(this->data.size()));
+    }
+}
+
+MappedFileTokenizer::MappedFileTokenizer(const boost::filesystem::path &filename, const boost::filesystem::path &base_path, std::shared_ptr< std::vector< boost::filesystem::path > > files) :
+    base_path(base_path), files(files), reportable(nullptr)
+{
+    this->map_file(filename);
+}
+
+void MappedFileTokenizer::map_file(const boost::filesystem::path &filename)
+{
+    this->files->push_back(filename);
+    boost::system::error_code ec;
+    auto size = boost::filesystem::file_size(filename, ec);
+    gio::assert_or_throw< MMPPParsingError >(!ec, "Cannot open file " + filename.string());
+    // Empty files cannot be mapped
+    if (size == 0) {
+        return;
+    }
+    try {
+        this->file.open(filename.string());
+    } catch (const std::ios_base::failure&) {
+        throw MMPPParsingError("Cannot map file " + filename.string());
+    }
+    this->data = std::string_view(this->file.data(), this->file.size());
+}
+
+const std::vector<boost::filesystem::path> &MappedFileTokenizer::get_files() const
+{
+    return *this->files;
+}
+
+void MappedFileTokenizer::report()
+{
+    if (this->reportable != nullptr && this->pos - this->last_report >= report_chunk) {
+        this->last_report = this->pos;
+        this->reportable->report(static_cast< double >(this->pos));
+    }
+}
+
+std::pair<bool, std::string> MappedFileTokenizer::next()
+{
+    auto res = this->next_view();
+    return std::make_pair(res.first, std::string(res.second));
+}
+
+bool MappedFileTokenizer::has_persistent_views() const
+{
+    return true;
+}
+
+/* The accepted syntax and the error messages are the same as FileTokenizer::next(),
+ * but tokens are delimited in the mapped buffer (using the bulk classifiers in
+ * scanner.h) instead of being copied character by character. The content of a
+ * comment is exactly the span between its delimiters, so it does not need to be
+ * copied either.
+ */
+std::pair<bool, std::string_view> MappedFileTokenizer::next_view()
+{
+    const char *const data = this->data.data();
+    const size_t size = this->data.size();
+    while (true) {
+        if (this->cascade != nullptr) {
+            auto next_pair = this->cascade->next_view();
+            if (!next_pair.second.empty()) {
+                return next_pair;
+            } else {
+                this->finished.push_back(std::move(this->cascade));
+            }
+        }
+        this->report();
+
+        this->pos = scan_mm_whitespace(data, this->pos, size);
+        if (this->pos == size) {
+            if (this->reportable != nullptr) {
+                this->reportable->report(static_cast< double >(size));
+            }
+            return std::make_pair(false, std::string_view());
+        }
+
+        size_t begin = this->pos;
+        char c = data[this->pos++];
+        if (c == '$') {
+            // This can be a regular token or the beginning of a comment
+            gio::assert_or_throw< MMPPParsingError >(this->pos < size, "Interrupted dollar sequence");
+            c = data[this->pos++];
+            if (c == '(' || c == '[') {
+                bool comment = c == '(';
+                size_t content_begin = this->pos;
+                while (true) {
+                    const char *dollar = static_cast< const char* >(memchr(data + this->pos, '$', size - this->pos));
+                    gio::assert_or_throw< MMPPParsingError >(dollar != nullptr && dollar + 1 != data + size, "File ended in comment or in file inclusion");
+                    this->pos = static_cast< size_t >(dollar - data) + 1;
+                    c = data[this->pos];
+                    if ((comment && c == '(') || (!comment && c == '[')) {
+                        throw MMPPParsingError("Comment and file inclusion opening forbidden in comments and file inclusions");
+                    } else if ((comment && c == ')') || (!comment && c == ']')) {
+                        std::string_view content(data + content_begin, this->pos - 1 - content_begin);
+                        this->pos++;
+                        if (comment) {
+                            if (content.empty()) {
+                                break;
+                            } else {
+                                return std::make_pair(true, content);
+                            }
+                        } else {
+                            std::string filename = trimmed(std::string(content));
+                            this->cascade.reset(new MappedFileTokenizer(this->base_path / filename, this->base_path, this->files));
+                            break;
+                        }
+                    }
+                    // Otherwise the dollar is part of the content; if the following
+                    // character is another dollar, it will be examined by memchr again
+                }
+                continue;
+            } else if (c == ')') {
+                throw MMPPParsingError("Comment closed while not in comment");
+            } else if (c == ']') {
+                throw MMPPParsingError("File inclusion closed while not in comment");
+            } else if (is_mm_whitespace(c)) {
+                throw MMPPParsingError("Interrupted dollar sequence");
+            } else if (c != '$' && !is_mm_valid(c)) {
+                throw MMPPParsingError("Forbidden input character");
+            }
+        } else if (!is_mm_valid(c)) {
+            throw MMPPParsingError("Forbidden input character");
+        }
+
+        // Consume the rest of the token
+        this->pos = scan_mm_valid(data, this->pos, size);
+        if (this->pos < size) {
+            c = data[this->pos];
+            if (c == '$') {
+                throw MMPPParsingError("Dollars cannot appear in the middle of a token");
+            } else if (!is_mm_whitespace(c)) {
+                throw MMPPParsingError("Forbidden input character");
+            }
+        }
+        return std::make_pair(false, std::string_view(data + begin, this->pos - begin));
+    }
+}
@@ -2,9 +2,12 @@
 
 #include <vector>
 #include <utility>
+#include <memory>
+#include <string_view>
 
 #include <boost/filesystem/path.hpp>
 #include <boost/filesystem/fstream.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
 
 #include "utils/utils.h"
 #include "funds.h"
@@ -19,7 +22,19 @@ std::vector< std::string > tokenize(const std::string &in);
 class TokenGenerator {
 public:
     virtual std::pair< bool, std::string > next() = 0;
+    /* Same as next(), but the token is returned as a view. The view is
+     * only guaranteed to remain valid until the next call to next() or
+     * next_view(); the default implementation keeps a copy of the last
+     * token returned by next(), while generators that have their whole
+     * input in memory can avoid copies altogether. */
+    virtual std::pair< bool, std::string_view > next_view();
+    /* Whether the views returned by next_view() remain valid for the whole
+     * life of the generator, instead of just until the next call. */
+    virtual bool has_persistent_views() const;
     virtual ~TokenGenerator();
+
+private:
+    std::string last_token;
 };
 
 class FileTokenizer : public TokenGenerator {
@@ -43,3 +58,37 @@ private:
     size_t pos = 0;
     Reportable *reportable;
 };
+
+/* A TokenGenerator that maps the whole file in memory and scans it in
+ * place: tokens and comments are returned by next_view() as views into the
+ * mapped buffer, which remain valid as long as the tokenizer is alive.
+ * Progress is notified to the Reportable once every report_chunk bytes.
+ * Included files ($[ ... $]) are mapped in turn by a cascaded tokenizer.
+ */
+class MappedFileTokenizer : public TokenGenerator {
+public:
+    MappedFileTokenizer(const boost::filesystem::path &filename, Reportable *reportable = NULL);
+    std::pair< bool, std::string > next();
+    std::pair< bool, std::string_view > next_view();
+    bool has_persistent_views() const;
+    // The files that were mapped so far, in order, beginning with the main one
+    const std::vector< boost::filesystem::path > &get_files() const;
+
+    static const size_t report_chunk = 1024 * 1024;
+
+private:
+    MappedFileTokenizer(const boost::filesystem::path &filename, const boost::filesystem::path &base_path, std::shared_ptr< std::vector< boost::filesystem::path > > files);
+    void map_file(const boost::filesystem::path &filename);
+    void report();
+
+    boost::iostreams::mapped_file_source file;
+    std::string_view data;
+    boost::filesystem::path base_path;
+    std::shared_ptr< std::vector< boost::filesystem::path > > files;
+    std::unique_ptr< MappedFileTokenizer > cascade;
+    // Exhausted included files are kept mapped, so that their views remain valid
+    std::vector< std::unique_ptr< MappedFileTokenizer > > finished;
+    size_t pos = 0;
+    size_t last_report = 0;
+    Reportable *reportable;
+};
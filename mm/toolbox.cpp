@@ -10,6 +10,7 @@
 #include "parsing/earley.h"
 #include "reader.h"
 #include "mm/proof.h"
+#include "utils/parallel.h"
 
 std::ostream &operator<<(std::ostream &os, const SentencePrinter &sp)
 {
@@ -83,7 +84,7 @@ std::ostream &operator<<(std::ostream &os, const ProofPrinter &sp)
     if (labels) {
         bool first = true;
         for (const auto &label : *labels) {
-            if (sp.only_assertions && !(sp.tb.get_assertion(label).is_valid() && sp.tb.get_sentence(label).at(0) == sp.tb.get_turnstile())) {
+            if (sp.only_assertions && !(sp.tb.get_assertion(label).is_valid() && sp.tb.get_sentence_view(label).at(0) == sp.tb.get_turnstile())) {
                 continue;
             }
             if (first) {
@@ -190,17 +191,20 @@ void LibraryToolbox::reconstruct_sentence_internal(const ParsingTree<SymTok, Lab
 
 void LibraryToolbox::compute_vars()
 {
-    this->sentence_vars.emplace_back();
-    for (const ParsingTree2< SymTok, LabTok > &pt : this->gen_parsed_sents2()) {
-        std::set< LabTok > vars;
-        collect_variables2(pt, this->get_standard_is_var(), vars);
-        this->sentence_vars.push_back(vars);
+    if (this->cache != nullptr && this->cache->get_vars(this->cache_digest, this->sentence_vars, this->assertion_unconst_vars, this->assertion_const_vars)) {
+        return;
     }
-    for (const auto &ass : this->lib.get_assertions()) {
+    this->sentence_vars.resize(this->parsed_sents2.size());
+    parallel_for(this->parsed_sents2.size() - 1, [this](size_t i) {
+        collect_variables2(this->parsed_sents2[i+1], this->get_standard_is_var(), this->sentence_vars[i+1]);
+    });
+    const size_t slots_num = this->lib.get_labels_num() + 1;
+    this->assertion_const_vars.resize(slots_num);
+    this->assertion_unconst_vars.resize(slots_num);
+    parallel_for(slots_num, [this](size_t i) {
+        const auto &ass = this->lib.get_assertion(LabTok(static_cast< LabTok::val_type >(i)));
         if (!ass.is_valid()) {
-            this->assertion_const_vars.emplace_back();
-            this->assertion_unconst_vars.emplace_back();
-            continue;
+            return;
         }
         const auto &thesis_vars = this->sentence_vars[ass.get_thesis().val()];
         std::set< LabTok > hyps_vars;
@@ -208,10 +212,13 @@ void LibraryToolbox::compute_vars()
             const auto &hyp_vars = this->sentence_vars[hyp_tok.val()];
             hyps_vars.insert(hyp_vars.begin(), hyp_vars.end());
         }
-        this->assertion_const_vars.push_back(thesis_vars);
-        this->assertion_unconst_vars.emplace_back();
-        auto &unconst_vars = this->assertion_unconst_vars.back();
+        this->assertion_const_vars[i] = thesis_vars;
+        auto &unconst_vars = this->assertion_unconst_vars[i];
         set_difference(hyps_vars.begin(), hyps_vars.end(), thesis_vars.begin(), thesis_vars.end(), inserter(unconst_vars, unconst_vars.begin()));
+    });
+    if (this->cache != nullptr) {
+        this->cache->set_vars(this->cache_digest, this->sentence_vars, this->assertion_unconst_vars, this->assertion_const_vars);
+        this->cache_modified = true;
     }
 }
 
@@ -232,13 +239,18 @@ const std::vector< std::set< LabTok > > &LibraryToolbox::get_assertion_const_var
 
 void LibraryToolbox::compute_labels_to_theses()
 {
+    if (this->cache != nullptr && this->cache->get_labels_to_theses(this->cache_digest, this->root_labels_to_theses, this->imp_ant_labels_to_theses, this->imp_con_labels_to_theses)) {
+        return;
+    }
     LabTok imp_label = this->get_imp_label();
     bool imp_found = (imp_label != LabTok{});
-    for (const Assertion &ass : this->lib.get_assertions()) {
-        if (!ass.is_valid() || this->get_sentence(ass.get_thesis()).at(0) != this->get_turnstile()) {
+    const auto &table = this->get_assertions_table();
+    for (AssertionTable::Row row = 0; row < table.size(); row++) {
+        const LabTok thesis = table.get_thesis(row);
+        if (this->lib.get_sentence_view(thesis).at(0) != this->get_turnstile()) {
             continue;
         }
-        const auto &pt = this->get_parsed_sent(ass.get_thesis());
+        const auto &pt = this->get_parsed_sent(thesis);
         LabTok root_label = pt.label;
         if (this->get_standard_is_var()(root_label)) {
             root_label = {};
@@ -253,12 +265,16 @@ void LibraryToolbox::compute_labels_to_theses()
             if (this->get_standard_is_var()(con_label)) {
                 con_label = 0;
             }
-            this->imp_ant_labels_to_theses[ant_label].push_back(ass.get_thesis());
-            this->imp_con_labels_to_theses[con_label].push_back(ass.get_thesis());
+            this->imp_ant_labels_to_theses[ant_label].push_back(thesis);
+            this->imp_con_labels_to_theses[con_label].push_back(thesis);
         } else {
-            this->root_labels_to_theses[root_label].push_back(ass.get_thesis());
+            this->root_labels_to_theses[root_label].push_back(thesis);
         }
     }
+    if (this->cache != nullptr) {
+        this->cache->set_labels_to_theses(this->cache_digest, this->root_labels_to_theses, this->imp_ant_labels_to_theses, this->imp_con_labels_to_theses);
+        this->cache_modified = true;
+    }
 }
 
 const std::unordered_map<LabTok, std::vector<LabTok> > &LibraryToolbox::get_root_labels_to_theses() const
@@ -276,6 +292,23 @@ const std::unordered_map<LabTok, std::vector<LabTok> > &LibraryToolbox::get_imp_
     return this->imp_con_labels_to_theses;
 }
 
+void LibraryToolbox::compute_assertions_index()
+{
+    this->assertions_index = std::make_unique< DiscriminationTree< SymTok, LabTok, LabTok > >(this->get_standard_is_var());
+    const auto &table = this->get_assertions_table();
+    for (AssertionTable::Row row = 0; row < table.size(); row++) {
+        if (table.is_usage_disc(row)) {
+            continue;
+        }
+        this->assertions_index->insert(this->get_parsed_sent2(table.get_thesis(row)), table.get_thesis(row));
+    }
+}
+
+const DiscriminationTree< SymTok, LabTok, LabTok > &LibraryToolbox::get_assertions_index() const
+{
+    return *this->assertions_index;
+}
+
 // FIXME Deduplicate with refresh_parsing_tree()
 std::pair<std::vector<ParsingTree<SymTok, LabTok> >, ParsingTree<SymTok, LabTok> > LibraryToolbox::refresh_assertion(const Assertion &ass, temp_allocator &ta) const
 {
@@ -360,7 +393,7 @@ std::pair< SubstMap<SymTok, LabTok>, std::set< LabTok > > LibraryToolbox::build_
     SubstMap< SymTok, LabTok > subst;
     std::set< LabTok > new_vars;
     for (const auto &var : vars) {
-        SymTok type_sym = this->get_sentence(var).at(0);
+        SymTok type_sym = this->get_sentence_view(var).at(0);
         LabTok new_lab;
         std::tie(new_lab, std::ignore) = ta.new_temp_var(type_sym);
         new_vars.insert(new_lab);
@@ -376,7 +409,7 @@ SimpleSubstMap2<SymTok, LabTok> LibraryToolbox::build_refreshing_subst_map2(cons
 {
     SimpleSubstMap2< SymTok, LabTok > subst;
     for (const auto &var : vars) {
-        SymTok type_sym = this->get_sentence(var).at(0);
+        SymTok type_sym = this->get_sentence_view(var).at(0);
         LabTok new_lab;
         std::tie(new_lab, std::ignore) = ta.new_temp_var(type_sym);
         subst[var] = new_lab;
@@ -442,11 +475,11 @@ bool LibraryToolbox::is_constant(SymTok c) const
     return this->lib.is_constant(c);
 }
 
-const Sentence &LibraryToolbox::get_sentence(LabTok label) const
+SentenceView LibraryToolbox::get_sentence_view(LabTok label) const
 {
-    const Sentence *sent = this->lib.get_sentence_ptr(label);
-    if (sent != nullptr) {
-        return *sent;
+    // Temporary labels are numbered after the ones of the library
+    if (label.val() <= this->lib.get_labels_num()) {
+        return this->lib.get_sentence_view(label);
     }
     return this->temp_generator->get_sentence(label);
 }
@@ -571,11 +604,11 @@ static std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<Sy
         do {
             std::vector< SymTok > templ;
             for (size_t i = 0; i < hypotheses.size(); i++) {
-                auto &hyp = self->get_sentence(ass.get_ess_hyps()[perm[i]]);
+                const auto hyp = self->get_sentence_view(ass.get_ess_hyps()[perm[i]]);
                 std::copy(hyp.begin(), hyp.end(), back_inserter(templ));
                 templ.push_back({});
             }
-            auto &th = self->get_sentence(ass.get_thesis());
+            const auto th = self->get_sentence_view(ass.get_thesis());
             copy(th.begin(), th.end(), back_inserter(templ));
             auto unifications = unify_old(sent, templ, *self);
             if (!unifications.empty()) {
@@ -584,7 +617,7 @@ static std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<Sy
                     // TODO - Here we immediately drop the type information, which probably mean that later we have to compute it again
                     bool wrong_unification = false;
                     for (auto &float_hyp : ass.get_float_hyps()) {
-                        const Sentence &float_hyp_sent = self->get_sentence(float_hyp);
+                        const SentenceView float_hyp_sent = self->get_sentence_view(float_hyp);
                         Sentence type_sent;
                         type_sent.push_back(float_hyp_sent.at(0));
                         auto &type_main_sent = unification.at(float_hyp_sent.at(1));
@@ -614,98 +647,147 @@ static std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<Sy
 }
 #endif
 
-static std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<SymTok, Sentence> > > unify_assertion_internal(const LibraryToolbox *self, const std::vector< std::pair< SymTok, ParsingTree<SymTok, LabTok > > > &pt_hyps, const std::pair< SymTok, ParsingTree< SymTok, LabTok > > &pt_thesis,
-                                                                                                                             bool just_first, bool up_to_hyps_perms, const std::set< std::pair< SymTok, SymTok > > &antidists) {
+// Only the assertions in candidates, whose thesis may match, are considered
+static std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<SymTok, Sentence> > > unify_assertion_candidates(const LibraryToolbox *self, const std::vector< std::pair< SymTok, ParsingTree2< SymTok, LabTok > > > &pt_hyps, const std::pair< SymTok, ParsingTree2< SymTok, LabTok > > &pt_thesis,
+                                                                                                                               std::vector< LabTok > candidates, bool just_first, bool up_to_hyps_perms, const std::set< std::pair< SymTok, SymTok > > &antidists) {
     std::vector<std::tuple< LabTok, std::vector< size_t >, std::unordered_map<SymTok, std::vector<SymTok> > > > ret;
     const auto &is_var = self->get_standard_is_var();
-    for (const Assertion &ass : self->gen_assertions()) {
-        if (ass.is_usage_disc()) {
-            continue;
-        }
-        if (ass.get_ess_hyps().size() != pt_hyps.size()) {
+    const auto &pt2_thesis = pt_thesis.second;
+    // Try them in the same order in which they appear in the library
+    std::sort(candidates.begin(), candidates.end());
+    const auto &table = self->get_assertions_table();
+    for (const LabTok thesis : candidates) {
+        const auto ess_hyps = table.get_ess_hyps(table.get_row(thesis));
+        if (ess_hyps.size() != pt_hyps.size()) {
             continue;
         }
-        if (pt_thesis.first != self->get_sentence(ass.get_thesis())[0]) {
+        if (pt_thesis.first != self->get_library().get_sentence_view(thesis)[0]) {
             continue;
         }
         UnilateralUnificator< SymTok, LabTok > unif(is_var);
-        auto &templ_pt = self->get_parsed_sent(ass.get_thesis());
-        unif.add_parsing_trees(templ_pt, pt_thesis.second);
+        auto &templ_pt = self->get_parsed_sent2(thesis);
+        unif.add_parsing_trees2(templ_pt, pt2_thesis);
         if (!unif.is_unifiable()) {
             continue;
         }
-        // We have to generate all the hypotheses' permutations; fortunately usually hypotheses are not many
-        // TODO Is there a better algorithm?
-        // The i-th specified hypothesis is matched with the perm[i]-th assertion hypothesis
-        std::vector< size_t > perm;
-        for (size_t i = 0; i < pt_hyps.size(); i++) {
-            perm.push_back(i);
+        // The i-th specified hypothesis is matched with the perm[i]-th assertion hypothesis.
+        // First find which pairs can be matched at all, given the thesis; then search
+        // the assignments depth first, adding one hypothesis at a time to the unificator
+        // and backtracking as soon as it fails. Assignments are visited in lexicographic
+        // order, as std::next_permutation() would do.
+        const size_t hyps_num = pt_hyps.size();
+        std::vector< std::vector< bool > > compat(hyps_num, std::vector< bool >(hyps_num, false));
+        bool matchable = true;
+        for (size_t i = 0; i < hyps_num && matchable; i++) {
+            matchable = false;
+            for (size_t j = 0; j < hyps_num; j++) {
+                const LabTok hyp = ess_hyps[j];
+                if (pt_hyps[i].first != self->get_library().get_sentence_view(hyp)[0]) {
+                    continue;
+                }
+                auto unif2 = unif;
+                unif2.add_parsing_trees2(self->get_parsed_sent2(hyp), pt_hyps[i].second);
+                compat[i][j] = unif2.is_unifiable();
+                matchable = matchable || compat[i][j];
+            }
         }
-        do {
-            auto unif2 = unif;
-            bool res = true;
-            for (size_t i = 0; i < pt_hyps.size(); i++) {
-                res = (pt_hyps[i].first == self->get_sentence(ass.get_ess_hyps()[perm[i]])[0]);
+        if (!matchable) {
+            continue;
+        }
+        std::vector< size_t > perm(hyps_num);
+        std::vector< bool > used(hyps_num, false);
+        // unifs[i] has the thesis and the first i hypotheses
+        std::vector< UnilateralUnificator< SymTok, LabTok > > unifs(hyps_num + 1, unif);
+        // Return true if the search must stop, i.e., if a unification was found
+        // and we are not interested in other permutations
+        std::function< bool(size_t) > search = [&](size_t i) {
+            if (i == hyps_num) {
+                bool res;
+                SubstMap< SymTok, LabTok > subst;
+                tie(res, subst) = unifs[i].unify();
                 if (!res) {
-                    break;
+                    return false;
                 }
-                auto &templ_pt = self->get_parsed_sent(ass.get_ess_hyps()[perm[i]]);
-                unif2.add_parsing_trees(templ_pt, pt_hyps[i].second);
-                res = unif2.is_unifiable();
-                if (!res) {
-                    break;
+                std::unordered_map< SymTok, std::vector< SymTok > > subst2;
+                for (auto &s : subst) {
+                    subst2.insert(make_pair(self->get_sentence_view(s.first).at(1), self->reconstruct_sentence(s.second)));
                 }
+                ProofSentenceTraits< Sentence >::SubstMapType subst3(subst2.begin(), subst2.end());
+                auto dists = propagate_dists< Sentence >(self->get_assertion(thesis), subst3, *self);
+                if (!gio::has_no_diagonal(dists.begin(), dists.end())) {
+                    return false;
+                }
+                if (!gio::is_disjoint(dists.begin(), dists.end(), antidists.begin(), antidists.end())) {
+                    return false;
+                }
+                ret.emplace_back(thesis, perm, subst2);
+                return just_first || !up_to_hyps_perms;
             }
-            if (!res) {
-                continue;
-            }
-            SubstMap< SymTok, LabTok > subst;
-            tie(res, subst) = unif2.unify();
-            if (!res) {
-                continue;
-            }
-            std::unordered_map< SymTok, std::vector< SymTok > > subst2;
-            for (auto &s : subst) {
-                subst2.insert(make_pair(self->get_sentence(s.first).at(1), self->reconstruct_sentence(s.second)));
-            }
-            VectorMap< SymTok, Sentence > subst3(subst2.begin(), subst2.end());
-            auto dists = propagate_dists< Sentence >(ass, subst3, *self);
-            if (!gio::has_no_diagonal(dists.begin(), dists.end())) {
-                continue;
-            }
-            if (!gio::is_disjoint(dists.begin(), dists.end(), antidists.begin(), antidists.end())) {
-                continue;
-            }
-            ret.emplace_back(ass.get_thesis(), perm, subst2);
-            if (just_first) {
-                return ret;
-            }
-            if (!up_to_hyps_perms) {
-                break;
+            for (size_t j = 0; j < hyps_num; j++) {
+                if (used[j] || !compat[i][j]) {
+                    continue;
+                }
+                unifs[i+1] = unifs[i];
+                unifs[i+1].add_parsing_trees2(self->get_parsed_sent2(ess_hyps[j]), pt_hyps[i].second);
+                if (!unifs[i+1].is_unifiable()) {
+                    continue;
+                }
+                used[j] = true;
+                perm[i] = j;
+                if (search(i+1)) {
+                    return true;
+                }
+                used[j] = false;
             }
-        } while (std::next_permutation(perm.begin(), perm.end()));
+            return false;
+        };
+        if (search(0) && just_first) {
+            return ret;
+        }
     }
 
     return ret;
 }
 
-static std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<SymTok, Sentence> > > unify_assertion_internal(const LibraryToolbox *self, const std::vector<Sentence> &hypotheses, const Sentence &thesis, bool just_first, bool up_to_hyps_perms, const std::set< std::pair< SymTok, SymTok > > &antidists)
+static std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<SymTok, Sentence> > > unify_assertion_internal(const LibraryToolbox *self, const std::vector< std::pair< SymTok, ParsingTree<SymTok, LabTok > > > &pt_hyps, const std::pair< SymTok, ParsingTree< SymTok, LabTok > > &pt_thesis,
+                                                                                                                             bool just_first, bool up_to_hyps_perms, const std::set< std::pair< SymTok, SymTok > > &antidists) {
+    std::vector< std::pair< SymTok, ParsingTree2< SymTok, LabTok > > > pt2_hyps;
+    for (const auto &hyp : pt_hyps) {
+        pt2_hyps.push_back(std::make_pair(hyp.first, pt_to_pt2(hyp.second)));
+    }
+    const auto pt2_thesis = std::make_pair(pt_thesis.first, pt_to_pt2(pt_thesis.second));
+    auto candidates = self->get_assertions_index().find_candidates(pt2_thesis.second);
+    return unify_assertion_candidates(self, pt2_hyps, pt2_thesis, std::move(candidates), just_first, up_to_hyps_perms, antidists);
+}
+
+// Return false if some sentence cannot be parsed
+static bool parse_unification_query(const LibraryToolbox *self, const std::vector<Sentence> &hypotheses, const Sentence &thesis,
+                                    std::vector< std::pair< SymTok, ParsingTree2< SymTok, LabTok > > > &pt_hyps, std::pair< SymTok, ParsingTree2< SymTok, LabTok > > &pt_thesis)
 {
-    // Parse inputs
-    std::vector< std::pair< SymTok, ParsingTree< SymTok, LabTok > > > pt_hyps;
     for (auto &hyp : hypotheses) {
         auto pt = self->parse_sentence(hyp.begin()+1, hyp.end(), hyp.front() == self->get_turnstile() ? self->get_turnstile_alias() : hyp.front());
         if (pt.label == LabTok{}) {
-            return {};
+            return false;
         }
-        pt_hyps.push_back(std::make_pair(hyp[0], pt));
+        pt_hyps.push_back(std::make_pair(hyp[0], pt_to_pt2(pt)));
     }
-    auto pt_thesis = std::make_pair(thesis[0], self->parse_sentence(thesis.begin()+1, thesis.end(), thesis.front() == self->get_turnstile() ? self->get_turnstile_alias() : thesis.front()));
-    if (pt_thesis.second.label == LabTok{}) {
-        return {};
+    auto pt = self->parse_sentence(thesis.begin()+1, thesis.end(), thesis.front() == self->get_turnstile() ? self->get_turnstile_alias() : thesis.front());
+    if (pt.label == LabTok{}) {
+        return false;
     }
+    pt_thesis = std::make_pair(thesis[0], pt_to_pt2(pt));
+    return true;
+}
 
-    return unify_assertion_internal(self, pt_hyps, pt_thesis, just_first, up_to_hyps_perms, antidists);
+static std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<SymTok, Sentence> > > unify_assertion_internal(const LibraryToolbox *self, const std::vector<Sentence> &hypotheses, const Sentence &thesis, bool just_first, bool up_to_hyps_perms, const std::set< std::pair< SymTok, SymTok > > &antidists)
+{
+    std::vector< std::pair< SymTok, ParsingTree2< SymTok, LabTok > > > pt_hyps;
+    std::pair< SymTok, ParsingTree2< SymTok, LabTok > > pt_thesis;
+    if (!parse_unification_query(self, hypotheses, thesis, pt_hyps, pt_thesis)) {
+        return {};
+    }
+    auto candidates = self->get_assertions_index().find_candidates(pt_thesis.second);
+    return unify_assertion_candidates(self, pt_hyps, pt_thesis, std::move(candidates), just_first, up_to_hyps_perms, antidists);
 }
 
 std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<SymTok, Sentence> > > LibraryToolbox::unify_assertion(const std::vector<Sentence> &hypotheses, const Sentence &thesis, bool just_first, bool up_to_hyps_perms, const std::set<std::pair<SymTok, SymTok> > &antidists) const
@@ -723,6 +805,52 @@ std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<SymTok, S
     return unify_assertion_internal(this, hypotheses, thesis, just_first, up_to_hyps_perms, antidists);
 }
 
+std::vector<std::vector<std::tuple<LabTok, std::vector<size_t>, std::unordered_map<SymTok, Sentence> > > > LibraryToolbox::unify_assertion_batch(const std::vector<std::pair<std::vector<Sentence>, Sentence> > &queries, bool just_first, bool up_to_hyps_perms, const std::set<std::pair<SymTok, SymTok> > &antidists, size_t jobs) const
+{
+    std::map< std::pair< std::vector< Sentence >, Sentence >, size_t > unique_idxs;
+    std::vector< size_t > query_idxs;
+    std::vector< const std::pair< std::vector< Sentence >, Sentence >* > unique_queries;
+    for (const auto &query : queries) {
+        auto res = unique_idxs.insert(std::make_pair(query, unique_queries.size()));
+        if (res.second) {
+            unique_queries.push_back(&query);
+        }
+        query_idxs.push_back(res.first->second);
+    }
+    // Parse all the queries, then look up the candidates of all of them in
+    // a single walk of the index and finally unify each query with its
+    // candidates
+    std::vector< std::vector< std::pair< SymTok, ParsingTree2< SymTok, LabTok > > > > pt_hyps(unique_queries.size());
+    std::vector< std::pair< SymTok, ParsingTree2< SymTok, LabTok > > > pt_theses(unique_queries.size());
+    std::vector< uint8_t > parsed(unique_queries.size());
+    parallel_for(unique_queries.size(), [&](size_t i) {
+        parsed[i] = parse_unification_query(this, unique_queries[i]->first, unique_queries[i]->second, pt_hyps[i], pt_theses[i]);
+    }, jobs);
+    std::vector< size_t > parsed_idxs;
+    std::vector< const ParsingTree2< SymTok, LabTok >* > parsed_theses;
+    for (size_t i = 0; i < unique_queries.size(); i++) {
+        if (parsed[i]) {
+            parsed_idxs.push_back(i);
+            parsed_theses.push_back(&pt_theses[i].second);
+        }
+    }
+    std::vector< std::vector< LabTok > > candidates(unique_queries.size());
+    this->get_assertions_index().find_candidates_batch(parsed_theses, [&](size_t i, LabTok thesis) {
+        candidates[parsed_idxs[i]].push_back(thesis);
+    });
+    std::vector< std::vector< std::tuple< LabTok, std::vector< size_t >, std::unordered_map< SymTok, Sentence > > > > unique_rets(unique_queries.size());
+    parallel_for(parsed_idxs.size(), [&](size_t j) {
+        const size_t i = parsed_idxs[j];
+        unique_rets[i] = unify_assertion_candidates(this, pt_hyps[i], pt_theses[i], std::move(candidates[i]), just_first, up_to_hyps_perms, antidists);
+    }, jobs);
+    std::vector< std::vector< std::tuple< LabTok, std::vector< size_t >, std::unordered_map< SymTok, Sentence > > > > ret;
+    ret.reserve(queries.size());
+    for (const auto idx : query_idxs) {
+        ret.push_back(unique_rets[idx]);
+    }
+    return ret;
+}
+
 const std::function<bool (LabTok)> &LibraryToolbox::get_standard_is_var() const {
     return this->standard_is_var;
 }
@@ -784,6 +912,13 @@ void LibraryToolbox::dump_proof_exception(const ProofException<Sentence> &e, std
     }
 }
 
+ProofExceptionHandler LibraryToolbox::get_proof_exception_dumper() const
+{
+    return [this](const ProofException< Sentence > &e) {
+        this->dump_proof_exception(e, std::cerr);
+    };
+}
+
 void LibraryToolbox::dump_proof_exception(const ProofException<ParsingTree2<SymTok, LabTok> > &e, std::ostream &out) const
 {
     out << "Applying " << this->resolve_label(e.get_error().label) << " the proof executor signalled an error..." << std::endl;
@@ -800,19 +935,79 @@ void LibraryToolbox::compute_everything()
 {
     //cout << "Computing everything" << endl;
     //auto t = tic();
+    this->compute_assertions_table();
     this->compute_type_correspondance();
     this->compute_is_var_by_type();
     this->compute_assertions_by_type();
     this->compute_derivations();
     this->compute_ders_by_label();
+    this->compute_cache_digest();
     this->compute_parser_initialization();
     this->compute_sentences_parsing();
+    this->compute_assertions_index();
     this->compute_labels_to_theses();
     this->compute_registered_provers();
     this->compute_vars();
+    if (this->cache != nullptr && this->cache_modified) {
+        this->cache->store();
+    }
+    // Drop the cache so that memory can be recovered
+    this->cache = nullptr;
     //toc(t, 1);
 }
 
+void LibraryToolbox::compute_cache_digest()
+{
+    // Hash everything the cached tables are computed from; the LR parser
+    // data and the registered provers have their own digests
+    HashSink hasher;
+    auto hash_bytes = [&hasher](const void *data, size_t len) {
+        hasher.write(static_cast< const char* >(data), static_cast< std::streamsize >(len));
+    };
+    auto hash_value = [&hash_bytes](const auto &x) {
+        hash_bytes(&x, sizeof(x));
+    };
+    auto hash_array = [&hash_bytes, &hash_value](const auto *data, size_t len) {
+        hash_value(len);
+        hash_bytes(data, len * sizeof(*data));
+    };
+    hash_value(this->turnstile);
+    hash_value(this->turnstile_alias);
+    for (SymTok sym : this->gen_symbols()) {
+        const auto name = this->resolve_symbol(sym);
+        hash_array(name.data(), name.size());
+        hash_value(this->is_constant(sym));
+    }
+    for (LabTok label : this->gen_labels()) {
+        const auto name = this->resolve_label(label);
+        hash_array(name.data(), name.size());
+        const auto sent = this->lib.get_sentence_view(label);
+        hash_array(sent.data(), sent.size());
+        hash_value(this->get_sentence_type(label));
+    }
+    for (LabTok label : this->gen_labels()) {
+        const Assertion &ass = this->lib.get_assertion(label);
+        hash_value(ass.is_valid());
+        if (!ass.is_valid()) {
+            continue;
+        }
+        hash_value(ass.get_thesis());
+        hash_value(ass.is_theorem());
+        hash_array(ass.get_float_hyps().data(), ass.get_float_hyps().size());
+        hash_array(ass.get_ess_hyps().data(), ass.get_ess_hyps().size());
+        hash_value(ass.get_mand_dists().size());
+        for (const auto &dist : ass.get_mand_dists()) {
+            hash_value(dist);
+        }
+    }
+    const auto &types = this->get_final_stack_frame().types;
+    hash_array(types.data(), types.size());
+    for (const auto &syntax : this->get_parsing_addendum().get_syntax()) {
+        hash_value(syntax);
+    }
+    this->cache_digest = hasher.get_digest();
+}
+
 /*const std::vector<LabTok> &LibraryToolbox::get_type_labels() const
 {
     return this->type_labels;
@@ -826,7 +1021,7 @@ const std::set<LabTok> &LibraryToolbox::get_type_labels_set() const
 void LibraryToolbox::compute_type_correspondance()
 {
     for (auto &var_lab : this->get_final_stack_frame().types) {
-        const auto &sent = this->get_sentence(var_lab);
+        const auto sent = this->get_sentence_view(var_lab);
         assert(sent.size() == 2);
         const SymTok type_sym = sent[0];
         const SymTok var_sym = sent[1];
@@ -876,9 +1071,9 @@ SymTok LibraryToolbox::get_var_lab_to_type_sym(LabTok lab) const
 void LibraryToolbox::compute_is_var_by_type()
 {
     const auto &types_set = this->get_final_stack_frame().types_set;
-    this->is_var_by_type.resize(this->lib.get_labels_num());
+    this->is_var_by_type.resize(this->lib.get_labels_num() + 1);
     for (LabTok label : this->gen_labels()) {
-        this->is_var_by_type[label.val()] = (types_set.find(label) != types_set.end() && !this->is_constant(this->get_sentence(label).at(1)));
+        this->is_var_by_type[label.val()] = (types_set.find(label) != types_set.end() && !this->is_constant(this->get_sentence_view(label).at(1)));
     }
 }
 
@@ -887,11 +1082,22 @@ const std::vector<bool> &LibraryToolbox::get_is_var_by_type() const
     return this->is_var_by_type;
 }
 
+void LibraryToolbox::compute_assertions_table()
+{
+    this->assertions_table = AssertionTable(this->lib);
+}
+
+const AssertionTable &LibraryToolbox::get_assertions_table() const
+{
+    return this->assertions_table;
+}
+
 void LibraryToolbox::compute_assertions_by_type()
 {
-    for (const Assertion &ass : this->gen_assertions()) {
-        const auto &label = ass.get_thesis();
-        this->assertions_by_type[this->get_sentence(label).at(0)].push_back(label);
+    const auto &table = this->get_assertions_table();
+    for (AssertionTable::Row row = 0; row < table.size(); row++) {
+        const auto label = table.get_thesis(row);
+        this->assertions_by_type[this->lib.get_sentence_view(label).at(0)].push_back(label);
     }
 }
 
@@ -907,21 +1113,22 @@ void LibraryToolbox::compute_derivations()
     // appears more than once and without distinct variables constraints and that does not
     // begin with the turnstile
     for (auto &type_lab : this->get_final_stack_frame().types) {
-        auto &type_sent = this->get_sentence(type_lab);
+        const auto type_sent = this->get_sentence_view(type_lab);
         this->derivations[type_sent.at(0)].push_back(std::make_pair(type_lab, std::vector<SymTok>({type_sent.at(1)})));
     }
     // FIXME Take it from the configuration
-    for (const Assertion &ass : this->gen_assertions()) {
-        if (ass.get_ess_hyps().size() != 0) {
+    const auto &table = this->get_assertions_table();
+    for (AssertionTable::Row row = 0; row < table.size(); row++) {
+        if (!table.get_ess_hyps(row).empty()) {
             continue;
         }
-        if (ass.get_mand_dists().size() != 0) {
+        if (!table.get_mand_dists(row).empty()) {
             continue;
         }
-        if (ass.is_theorem()) {
+        if (table.is_theorem(row)) {
             continue;
         }
-        const auto &sent = this->get_sentence(ass.get_thesis());
+        const auto sent = this->get_sentence_view(table.get_thesis(row));
         if (sent.at(0) == this->turnstile) {
             continue;
         }
@@ -944,9 +1151,9 @@ void LibraryToolbox::compute_derivations()
         for (size_t i = 1; i < sent.size(); i++) {
             const auto &tok = sent[i];
             // Variables are replaced with their types, which act as variables of the context-free grammar
-            sent2.push_back(this->is_constant(tok) ? tok : this->get_sentence(this->get_var_sym_to_lab(tok)).at(0));
+            sent2.push_back(this->is_constant(tok) ? tok : this->get_sentence_view(this->get_var_sym_to_lab(tok)).at(0));
         }
-        this->derivations[sent.at(0)].push_back(std::make_pair(ass.get_thesis(), sent2));
+        this->derivations[sent.at(0)].push_back(std::make_pair(table.get_thesis(row), sent2));
     }
 }
 
@@ -970,12 +1177,53 @@ RegisteredProver LibraryToolbox::register_prover(const std::vector<std::string>
 
 void LibraryToolbox::compute_registered_provers()
 {
-    for (size_t index = 0; index < LibraryToolbox::registered_provers().size(); index++) {
-        this->compute_registered_prover(index, false);
+    // The set of registered provers depends on which modules are linked
+    // in, so their templates are part of the digest
+    HashSink hasher;
+    auto hash_string = [&hasher](const std::string &str) {
+        hasher.write(str.c_str(), static_cast< std::streamsize >(str.size() + 1));
+    };
+    hash_string(this->cache_digest);
+    for (const auto &data : LibraryToolbox::registered_provers()) {
+        hash_string(std::to_string(data.templ_hyps.size()));
+        for (const auto &hyp : data.templ_hyps) {
+            hash_string(hyp);
+        }
+        hash_string(data.templ_thesis);
+    }
+    std::string digest = hasher.get_digest();
+    const size_t provers_num = LibraryToolbox::registered_provers().size();
+    this->registered_provers_flags = std::make_unique< std::once_flag[] >(provers_num);
+    if (this->cache != nullptr && this->cache->get_registered_provers(digest, this->instance_registered_provers) && this->instance_registered_provers.size() == provers_num) {
+        for (size_t index = 0; index < provers_num; index++) {
+            auto &inst_data = this->instance_registered_provers[index];
+            if (inst_data.valid) {
+                inst_data.label_str = this->resolve_label(inst_data.label);
+            }
+            // Mark the prover as resolved, so that it is not looked for again
+            std::call_once(this->registered_provers_flags[index], []() {});
+        }
+        return;
+    }
+    this->instance_registered_provers.clear();
+    this->instance_registered_provers.resize(provers_num);
+    if (this->cache != nullptr) {
+        parallel_for(provers_num, [this](size_t index) {
+            this->get_registered_prover_instance(index);
+        });
+        this->cache->set_registered_provers(digest, this->instance_registered_provers);
+        this->cache_modified = true;
     }
     //cerr << "Computed " << LibraryToolbox::registered_provers().size() << " registered provers" << endl;
 }
 
+const RegisteredProverInstanceData &LibraryToolbox::get_registered_prover_instance(size_t index) const
+{
+    gio::assert_or_throw< std::out_of_range >(index < this->instance_registered_provers.size(), "registered prover not available");
+    std::call_once(this->registered_provers_flags[index], [this,index]() { this->compute_registered_prover(index, false); });
+    return this->instance_registered_provers[index];
+}
+
 void LibraryToolbox::compute_parser_initialization()
 {
     std::function< std::ostream&(std::ostream&, SymTok) > sym_printer = [&](std::ostream &os, SymTok sym)->std::ostream& { return os << this->resolve_symbol(sym); };
@@ -998,11 +1246,9 @@ void LibraryToolbox::compute_parser_initialization()
         if (this->cache != nullptr) {
             this->cache->set_digest(ders_digest);
             this->cache->set_lr_parser_data(this->parser->get_cached_data());
-            this->cache->store();
+            this->cache_modified = true;
         }
     }
-    // Drop the cache so that memory can be recovered
-    this->cache = nullptr;
 }
 
 const LRParser<SymTok, LabTok> &LibraryToolbox::get_parser() const
@@ -1025,40 +1271,226 @@ ParsingTree<SymTok, LabTok> LibraryToolbox::parse_sentence(const Sentence &sent)
     return this->parse_sentence(sent.begin()+1, sent.end(), this->lib.get_parsing_addendum().get_syntax().at(sent.at(0)));
 }
 
+std::shared_ptr< const LibraryToolbox::TypeProof > LibraryToolbox::get_type_proof(const std::vector< SymTok > &type_sent) const
+{
+    // Temporary variables can be released and created again with another
+    // type, so sentences containing them are not cached
+    bool cacheable = std::all_of(type_sent.begin(), type_sent.end(), [this](SymTok tok) { return tok.val() <= this->lib.get_symbols_num(); });
+    if (cacheable) {
+        std::lock_guard< std::mutex > lock(this->type_proofs_mutex);
+        auto it = this->type_proofs.find(type_sent);
+        if (it != this->type_proofs.end()) {
+            return it->second;
+        }
+        auto old_it = this->old_type_proofs.find(type_sent);
+        if (old_it != this->old_type_proofs.end()) {
+            auto ret = old_it->second;
+            this->old_type_proofs.erase(old_it);
+            this->cache_type_proof(type_sent, ret);
+            return ret;
+        }
+    }
+    // Compute without holding the lock; if another thread did the same in
+    // the meantime, its result is kept
+    auto ret = this->compute_type_proof(type_sent);
+    if (cacheable) {
+        std::lock_guard< std::mutex > lock(this->type_proofs_mutex);
+        auto it = this->type_proofs.find(type_sent);
+        if (it != this->type_proofs.end()) {
+            return it->second;
+        }
+        auto old_it = this->old_type_proofs.find(type_sent);
+        if (old_it != this->old_type_proofs.end()) {
+            ret = old_it->second;
+            this->old_type_proofs.erase(old_it);
+        }
+        this->cache_type_proof(type_sent, ret);
+    }
+    return ret;
+}
+
+// Must be called with type_proofs_mutex held
+void LibraryToolbox::cache_type_proof(const Sentence &type_sent, const std::shared_ptr< const TypeProof > &type_proof) const
+{
+    if (this->type_proofs.size() >= type_proofs_cache_size) {
+        this->old_type_proofs = std::move(this->type_proofs);
+        this->type_proofs.clear();
+    }
+    this->type_proofs.insert(std::make_pair(type_sent, type_proof));
+}
+
+std::shared_ptr< const LibraryToolbox::TypeProof > LibraryToolbox::compute_type_proof(const std::vector< SymTok > &type_sent) const
+{
+    auto tree = this->parse_sentence(type_sent.begin()+1, type_sent.end(), type_sent[0]);
+    if (tree.label == LabTok{}) {
+        return nullptr;
+    }
+    return this->build_type_proof(tree);
+}
+
+std::shared_ptr< const LibraryToolbox::TypeProof > LibraryToolbox::build_type_proof(const ParsingTree< SymTok, LabTok > &tree) const
+{
+    // First identify equal subterms, each of which is a label applied to
+    // other subterms, listed in the order of the floating hypotheses
+    std::map< std::pair< LabTok, std::vector< size_t > >, size_t > term_ids;
+    std::vector< const std::pair< LabTok, std::vector< size_t > >* > terms;
+    std::function< size_t(const ParsingTree< SymTok, LabTok >&) > intern = [&](const ParsingTree< SymTok, LabTok > &tree) {
+        std::vector< size_t > children;
+        const Assertion &ass = this->get_assertion(tree.label);
+        if (ass.is_valid()) {
+            std::unordered_map< SymTok, const ParsingTree< SymTok, LabTok >* > children_by_var;
+            auto it = tree.children.begin();
+            for (auto &tok : this->lib.get_sentence_view(tree.label)) {
+                if (!this->lib.is_constant(tok)) {
+                    children_by_var[tok] = &(*it);
+                    it++;
+                }
+            }
+            assert(it == tree.children.end());
+            for (auto &hyp : ass.get_float_hyps()) {
+                children.push_back(intern(*children_by_var.at(this->lib.get_sentence_view(hyp).at(1))));
+            }
+        }
+        auto res = term_ids.insert(std::make_pair(std::make_pair(tree.label, std::move(children)), terms.size()));
+        if (res.second) {
+            terms.push_back(&res.first->first);
+        }
+        return res.first->second;
+    };
+    size_t root = intern(tree);
+
+    // Then emit them, saving each compound subterm the first time it appears
+    auto ret = std::make_shared< TypeProof >();
+    const size_t not_saved = std::numeric_limits< size_t >::max();
+    std::vector< size_t > saved(terms.size(), not_saved);
+    std::unordered_map< LabTok, size_t > var_slots;
+    std::function< void(size_t) > emit = [&](size_t id) {
+        if (saved[id] != not_saved) {
+            ret->prog.emit_saved_step(saved[id]);
+            return;
+        }
+        const auto &term = *terms[id];
+        if (!this->get_assertion(term.first).is_valid()) {
+            auto res = var_slots.insert(std::make_pair(term.first, ret->vars.size()));
+            if (res.second) {
+                ret->vars.push_back(term.first);
+            }
+            ret->prog.emit_hyp(res.first->second);
+            return;
+        }
+        size_t begin = ret->prog.get_pos();
+        for (size_t child : term.second) {
+            emit(child);
+        }
+        ret->prog.emit_label(term.first);
+        if (!term.second.empty()) {
+            saved[id] = ret->prog.save_step(begin);
+        }
+    };
+    emit(root);
+    return ret;
+}
+
+void LibraryToolbox::emit_type_proof(ProofProgram &prog, const TypeProof &type_proof, const std::unordered_map< SymTok, std::shared_ptr< const ProofProgram > > &var_progs) const
+{
+    std::vector< std::shared_ptr< const ProofProgram > > hyps;
+    for (size_t i = 0; i < type_proof.vars.size(); i++) {
+        const LabTok var_lab = type_proof.vars[i];
+        auto it = var_progs.end();
+        if (!var_progs.empty()) {
+            it = var_progs.find(this->get_var_lab_to_sym(var_lab));
+        }
+        if (it == var_progs.end()) {
+            auto var_prog = std::make_shared< ProofProgram >();
+            var_prog->emit_label(var_lab);
+            hyps.push_back(var_prog);
+        } else {
+            hyps.push_back(it->second);
+        }
+    }
+    prog.emit_program(type_proof.prog, hyps);
+}
+
+ParsingTree2< SymTok, LabTok > LibraryToolbox::parse_sentence2(typename Sentence::const_iterator sent_begin, typename Sentence::const_iterator sent_end, SymTok type) const
+{
+    return this->get_parser().parse2(sent_begin, sent_end, type);
+}
+
+std::vector< ParsingTree2< SymTok, LabTok > > LibraryToolbox::parse_sentences2(const std::vector< SentenceView > &sents, size_t jobs) const
+{
+    std::vector< LRParser< SymTok, LabTok >::ParseRequest > reqs;
+    reqs.reserve(sents.size());
+    for (const auto sent : sents) {
+        reqs.push_back(std::make_tuple(sent.begin()+1, sent.end(), this->get_parsing_addendum().get_syntax().at(sent.at(0))));
+    }
+    return this->get_parser().parse_many(reqs, jobs);
+}
+
 void LibraryToolbox::compute_sentences_parsing()
 {
     /*if (!this->parser_initialization_computed) {
         this->compute_parser_initialization();
     }*/
-    for (LabTok label : this->gen_labels()) {
-        const Sentence &sent = this->get_sentence(label);
-        auto pt = this->parse_sentence(sent.begin()+1, sent.end(), this->get_parsing_addendum().get_syntax().at(sent[0]));
-        if (pt.label == LabTok{}) {
-            throw std::runtime_error("Failed to parse a sentence in the library");
-        }
-        this->parsed_sents.resize(label.val()+1);
-        this->parsed_sents[label.val()] = pt;
-        this->parsed_sents2.resize(label.val()+1);
-        this->parsed_sents2[label.val()] = pt_to_pt2(pt);
-        this->parsed_iters.resize(label.val()+1);
-        ParsingTreeMultiIterator< SymTok, LabTok > it = this->parsed_sents2[label.val()].get_multi_iterator();
+    // The parser is not modified while parsing, so sentences can be parsed
+    // concurrently, each thread writing in the slots of its own labels
+    size_t labels_num = this->get_labels_num();
+    if (this->cache != nullptr && this->cache->get_sentences_parsing(this->cache_digest, this->parsed_sents2) && this->parsed_sents2.size() == labels_num + 1) {
+        this->parsed_sents2_owner = this->cache->get_sentences_parsing_owner();
+        // Old style trees are cheaply rebuilt from the cached ones
+        this->parsed_sents.resize(labels_num + 1);
+        parallel_for(labels_num, [this](size_t i) {
+            this->parsed_sents[i+1] = pt2_to_pt(this->parsed_sents2[i+1]);
+        });
+    } else {
+        std::vector< SentenceView > sents;
+        sents.reserve(labels_num);
+        for (size_t i = 0; i < labels_num; i++) {
+            sents.push_back(this->get_sentence_view(LabTok(i+1)));
+        }
+        auto pts = this->parse_sentences2(sents);
+        for (const auto &pt : pts) {
+            if (pt.get_nodes_len() == 0) {
+                throw std::runtime_error("Failed to parse a sentence in the library");
+            }
+        }
+        // Parsed sentences are stored in the arena, where equal sentences
+        // share their nodes, and parsed_sents2 points there
+        std::call_once(this->parsed_sents_arena_flag, [this,&pts,labels_num]() {
+            this->parsed_sents_arena = std::make_unique< ParsingTreeArena< SymTok, LabTok > >();
+            this->parsed_sents_ids.resize(labels_num + 1, ParsingTreeArena< SymTok, LabTok >::invalid_id);
+            for (size_t i = 0; i < labels_num; i++) {
+                this->parsed_sents_ids[i+1] = this->parsed_sents_arena->intern_tree(pts[i]);
+            }
+        });
+        pts.clear();
+        this->parsed_sents.resize(labels_num + 1);
+        this->parsed_sents2.resize(labels_num + 1);
+        parallel_for(labels_num, [this](size_t i) {
+            this->parsed_sents2[i+1] = this->parsed_sents_arena->get_tree(this->parsed_sents_ids[i+1]);
+            this->parsed_sents[i+1] = pt2_to_pt(this->parsed_sents2[i+1]);
+        });
+        if (this->cache != nullptr) {
+            this->cache->set_sentences_parsing(this->cache_digest, this->parsed_sents2);
+            this->cache_modified = true;
+        }
+    }
+    this->parsed_iters.resize(labels_num + 1);
+    parallel_for(labels_num, [this](size_t i) {
+        ParsingTreeMultiIterator< SymTok, LabTok > it = this->parsed_sents2[i+1].get_multi_iterator();
         while (true) {
             auto x = it.next();
-            this->parsed_iters[label.val()].push_back(x);
+            this->parsed_iters[i+1].push_back(x);
             if (x.first == it.Finished) {
                 break;
             }
         }
-    }
+    });
 }
 
 LabTok LibraryToolbox::get_registered_prover_label(const RegisteredProver &prover) const
 {
-    const size_t &index = prover.index;
-    if (index >= this->instance_registered_provers.size() || !this->instance_registered_provers[index].valid) {
-        throw std::runtime_error("cannot modify const object");
-    }
-    const RegisteredProverInstanceData &inst_data = this->instance_registered_provers[index];
+    const RegisteredProverInstanceData &inst_data = this->get_registered_prover_instance(prover.index);
+    gio::assert_or_throw< std::runtime_error >(inst_data.valid, "Could not find the template assertion");
     return inst_data.label;
 }
 
@@ -1125,9 +1557,31 @@ Generator<std::pair<LabTok, std::reference_wrapper<const ParsingTree2<SymTok, La
     );
 }
 
-void LibraryToolbox::compute_registered_prover(size_t index, bool exception_on_failure)
+const ParsingTreeArena< SymTok, LabTok > &LibraryToolbox::get_parsed_sents_arena() const
+{
+    std::call_once(this->parsed_sents_arena_flag, [this]() { this->compute_parsed_sents_arena(); });
+    return *this->parsed_sents_arena;
+}
+
+ParsingTreeArena< SymTok, LabTok >::Id LibraryToolbox::get_parsed_sent_id(LabTok label) const
+{
+    std::call_once(this->parsed_sents_arena_flag, [this]() { this->compute_parsed_sents_arena(); });
+    return this->parsed_sents_ids.at(label.val());
+}
+
+void LibraryToolbox::compute_parsed_sents_arena() const
+{
+    this->parsed_sents_arena = std::make_unique< ParsingTreeArena< SymTok, LabTok > >();
+    this->parsed_sents_ids.resize(this->parsed_sents2.size(), ParsingTreeArena< SymTok, LabTok >::invalid_id);
+    for (LabTok::val_type i = 1; i < this->parsed_sents2.size(); i++) {
+        if (this->parsed_sents2[i].get_nodes_len() != 0) {
+            this->parsed_sents_ids[i] = this->parsed_sents_arena->intern(this->parsed_sents2[i]);
+        }
+    }
+}
+
+void LibraryToolbox::compute_registered_prover(size_t index, bool exception_on_failure) const
 {
-    this->instance_registered_provers.resize(LibraryToolbox::registered_provers().size());
     const RegisteredProverData &data = LibraryToolbox::registered_provers()[index];
     RegisteredProverInstanceData &inst_data = this->instance_registered_provers[index];
     if (!inst_data.valid) {
@@ -1143,11 +1597,14 @@ void LibraryToolbox::compute_registered_prover(size_t index, bool exception_on_f
             if (exception_on_failure) {
                 throw std::runtime_error("Could not find the template assertion");
             } else {
-                std::cerr << "Could not find a template assertion for:" << std::endl;
+                // Provers may be resolved concurrently, so write the message at once
+                std::ostringstream buf;
+                buf << "Could not find a template assertion for:" << std::endl;
                 for (const auto &hyp : data.templ_hyps) {
-                    std::cerr << " * " << hyp << std::endl;
+                    buf << " * " << hyp << std::endl;
                 }
-                std::cerr << " => " << data.templ_thesis << std::endl;
+                buf << " => " << data.templ_thesis << std::endl;
+                std::cerr << buf.str();
                 return;
             }
         }
@@ -1182,6 +1639,64 @@ ToolboxCache::~ToolboxCache()
 {
 }
 
+std::shared_ptr< const void > ToolboxCache::get_sentences_parsing_owner() const {
+    return nullptr;
+}
+
+bool ToolboxCache::get_sentences_parsing(const std::string &digest, std::vector< ParsingTree2< SymTok, LabTok > > &parsed_sents2) {
+    (void) digest;
+    (void) parsed_sents2;
+    return false;
+}
+
+void ToolboxCache::set_sentences_parsing(const std::string &digest, const std::vector< ParsingTree2< SymTok, LabTok > > &parsed_sents2) {
+    (void) digest;
+    (void) parsed_sents2;
+}
+
+bool ToolboxCache::get_vars(const std::string &digest, std::vector< std::set< LabTok > > &sentence_vars, std::vector< std::set< LabTok > > &assertion_unconst_vars, std::vector< std::set< LabTok > > &assertion_const_vars) {
+    (void) digest;
+    (void) sentence_vars;
+    (void) assertion_unconst_vars;
+    (void) assertion_const_vars;
+    return false;
+}
+
+void ToolboxCache::set_vars(const std::string &digest, const std::vector< std::set< LabTok > > &sentence_vars, const std::vector< std::set< LabTok > > &assertion_unconst_vars, const std::vector< std::set< LabTok > > &assertion_const_vars) {
+    (void) digest;
+    (void) sentence_vars;
+    (void) assertion_unconst_vars;
+    (void) assertion_const_vars;
+}
+
+bool ToolboxCache::get_labels_to_theses(const std::string &digest, std::unordered_map< LabTok, std::vector< LabTok > > &root_labels_to_theses,
+                                        std::unordered_map< LabTok, std::vector< LabTok > > &imp_ant_labels_to_theses, std::unordered_map< LabTok, std::vector< LabTok > > &imp_con_labels_to_theses) {
+    (void) digest;
+    (void) root_labels_to_theses;
+    (void) imp_ant_labels_to_theses;
+    (void) imp_con_labels_to_theses;
+    return false;
+}
+
+void ToolboxCache::set_labels_to_theses(const std::string &digest, const std::unordered_map< LabTok, std::vector< LabTok > > &root_labels_to_theses,
+                                        const std::unordered_map< LabTok, std::vector< LabTok > > &imp_ant_labels_to_theses, const std::unordered_map< LabTok, std::vector< LabTok > > &imp_con_labels_to_theses) {
+    (void) digest;
+    (void) root_labels_to_theses;
+    (void) imp_ant_labels_to_theses;
+    (void) imp_con_labels_to_theses;
+}
+
+bool ToolboxCache::get_registered_provers(const std::string &digest, std::vector< RegisteredProverInstanceData > &provers) {
+    (void) digest;
+    (void) provers;
+    return false;
+}
+
+void ToolboxCache::set_registered_provers(const std::string &digest, const std::vector< RegisteredProverInstanceData > &provers) {
+    (void) digest;
+    (void) provers;
+}
+
 FileToolboxCache::FileToolboxCache(const boost::filesystem::path &filename) : filename(filename) {
 }
 
@@ -1223,6 +1738,320 @@ void FileToolboxCache::set_lr_parser_data(const LRParser< SymTok, LabTok >::Cach
     this->lr_parser_data = cached_data;
 }
 
+SnapshotToolboxCache::SnapshotToolboxCache(const boost::filesystem::path &filename) : filename(filename) {
+}
+
+bool SnapshotToolboxCache::load() {
+    if (!this->reader.open(this->filename) || !this->reader.has_section("lr_parser")) {
+        return false;
+    }
+    try {
+        auto cur = this->reader.get_section("lr_parser");
+        auto states = cur.read_array< uint64_t >();
+        auto shift_syms = cur.read_jagged< SymTok >();
+        auto shift_states = cur.read_jagged< uint64_t >();
+        auto red_syms = cur.read_jagged< SymTok >();
+        auto red_labs = cur.read_jagged< LabTok >();
+        auto red_lens = cur.read_jagged< uint64_t >();
+        auto red_states = cur.read_jagged< uint64_t >();
+        size_t num = states.size();
+        gio::assert_or_throw< std::runtime_error >(shift_syms.size() == num && shift_states.size() == num && red_syms.size() == num &&
+                                                   red_labs.size() == num && red_lens.size() == num && red_states.size() == num, "Inconsistent snapshot LR parser data");
+        LRParser< SymTok, LabTok >::CachedData data;
+        for (size_t i = 0; i < num; i++) {
+            auto &entry = data[states[i]];
+            auto syms = shift_syms[i];
+            auto targets = shift_states[i];
+            gio::assert_or_throw< std::runtime_error >(syms.size() == targets.size(), "Inconsistent snapshot LR parser data");
+            for (size_t j = 0; j < syms.size(); j++) {
+                entry.first[syms[j]] = targets[j];
+            }
+            auto rsyms = red_syms[i];
+            auto rlabs = red_labs[i];
+            auto rlens = red_lens[i];
+            auto rstates = red_states[i];
+            gio::assert_or_throw< std::runtime_error >(rlabs.size() == rsyms.size() && rlens.size() == rsyms.size() && rstates.size() == rsyms.size(), "Inconsistent snapshot LR parser data");
+            for (size_t j = 0; j < rsyms.size(); j++) {
+                entry.second.push_back(std::make_tuple(rsyms[j], rlabs[j], rlens[j], rstates[j]));
+            }
+        }
+        this->digest = this->reader.get_digest();
+        this->lr_parser_data = std::move(data);
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    return true;
+}
+
+bool SnapshotToolboxCache::store() {
+    SnapshotWriter writer(this->digest);
+    writer.begin_section("lr_parser");
+    std::vector< uint64_t > states;
+    SnapshotJaggedArrayBuilder< SymTok > shift_syms, red_syms;
+    SnapshotJaggedArrayBuilder< uint64_t > shift_states, red_lens, red_states;
+    SnapshotJaggedArrayBuilder< LabTok > red_labs;
+    for (const auto &state : this->lr_parser_data) {
+        states.push_back(state.first);
+        for (const auto &shift : state.second.first) {
+            shift_syms.push_value(shift.first);
+            shift_states.push_value(shift.second);
+        }
+        shift_syms.end_row();
+        shift_states.end_row();
+        for (const auto &red : state.second.second) {
+            red_syms.push_value(std::get< 0 >(red));
+            red_labs.push_value(std::get< 1 >(red));
+            red_lens.push_value(std::get< 2 >(red));
+            red_states.push_value(std::get< 3 >(red));
+        }
+        red_syms.end_row();
+        red_labs.end_row();
+        red_lens.end_row();
+        red_states.end_row();
+    }
+    writer.write_vector(states);
+    writer.write_jagged(shift_syms);
+    writer.write_jagged(shift_states);
+    writer.write_jagged(red_syms);
+    writer.write_jagged(red_labs);
+    writer.write_jagged(red_lens);
+    writer.write_jagged(red_states);
+    for (const auto &table : this->tables) {
+        writer.copy_section(table.first, table.second.get_data());
+    }
+    for (const auto &name : { "sentences_parsing", "vars", "labels_to_theses", "registered_provers" }) {
+        if (this->tables.find(name) == this->tables.end() && this->reader.has_section(name)) {
+            writer.copy_section(name, this->reader.get_section_data(name));
+        }
+    }
+    // The file is going to be replaced
+    this->reader.close();
+    this->tables.clear();
+    return writer.store(this->filename);
+}
+
+std::string SnapshotToolboxCache::get_digest() {
+    return this->digest;
+}
+
+void SnapshotToolboxCache::set_digest(std::string digest) {
+    this->digest = digest;
+}
+
+LRParser< SymTok, LabTok >::CachedData SnapshotToolboxCache::get_lr_parser_data() {
+    return this->lr_parser_data;
+}
+
+void SnapshotToolboxCache::set_lr_parser_data(const LRParser< SymTok, LabTok >::CachedData &cached_data) {
+    this->lr_parser_data = cached_data;
+}
+
+std::optional< SnapshotCursor > SnapshotToolboxCache::get_table(const std::string &name, const std::string &digest) const {
+    if (!this->reader.has_section(name)) {
+        return {};
+    }
+    auto cur = this->reader.get_section(name);
+    if (cur.read_string() != digest) {
+        return {};
+    }
+    return cur;
+}
+
+static SnapshotBuffer &new_table(std::map< std::string, SnapshotBuffer > &tables, const std::string &name, const std::string &digest) {
+    auto &writer = tables[name];
+    writer = SnapshotBuffer();
+    writer.write_string(digest);
+    return writer;
+}
+
+static void write_sets(SnapshotBuffer &writer, const std::vector< std::set< LabTok > > &sets) {
+    SnapshotJaggedArrayBuilder< LabTok > builder;
+    for (const auto &set : sets) {
+        builder.push_row(set.begin(), set.end());
+    }
+    writer.write_jagged(builder);
+}
+
+static std::vector< std::set< LabTok > > read_sets(SnapshotCursor &cur) {
+    auto jagged = cur.read_jagged< LabTok >();
+    std::vector< std::set< LabTok > > ret;
+    ret.reserve(jagged.size());
+    for (size_t i = 0; i < jagged.size(); i++) {
+        auto row = jagged[i];
+        ret.emplace_back(row.begin(), row.end());
+    }
+    return ret;
+}
+
+static void write_labels_map(SnapshotBuffer &writer, const std::unordered_map< LabTok, std::vector< LabTok > > &map) {
+    std::vector< LabTok > keys;
+    SnapshotJaggedArrayBuilder< LabTok > values;
+    for (const auto &entry : map) {
+        keys.push_back(entry.first);
+        values.push_row(entry.second.begin(), entry.second.end());
+    }
+    writer.write_vector(keys);
+    writer.write_jagged(values);
+}
+
+static std::unordered_map< LabTok, std::vector< LabTok > > read_labels_map(SnapshotCursor &cur) {
+    auto keys = cur.read_array< LabTok >();
+    auto values = cur.read_jagged< LabTok >();
+    gio::assert_or_throw< std::runtime_error >(keys.size() == values.size(), "Inconsistent snapshot labels map");
+    std::unordered_map< LabTok, std::vector< LabTok > > ret;
+    for (size_t i = 0; i < keys.size(); i++) {
+        ret[keys[i]] = values[i].to_vector();
+    }
+    return ret;
+}
+
+bool SnapshotToolboxCache::get_sentences_parsing(const std::string &digest, std::vector< ParsingTree2< SymTok, LabTok > > &parsed_sents2) {
+    try {
+        auto cur = this->get_table("sentences_parsing", digest);
+        if (!cur) {
+            return false;
+        }
+        auto trees = cur->read_jagged< ParsingTreeNode< SymTok, LabTok > >();
+        // Trees point directly inside the mapped file
+        std::vector< ParsingTree2< SymTok, LabTok > > ret(trees.size());
+        for (size_t i = 0; i < trees.size(); i++) {
+            auto nodes = trees[i];
+            if (!nodes.empty()) {
+                ret[i] = ParsingTree2< SymTok, LabTok >(nodes.data(), nodes.size());
+            }
+        }
+        this->mapping = this->reader.get_mapping();
+        parsed_sents2 = std::move(ret);
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr< const void > SnapshotToolboxCache::get_sentences_parsing_owner() const {
+    return this->mapping;
+}
+
+void SnapshotToolboxCache::set_sentences_parsing(const std::string &digest, const std::vector< ParsingTree2< SymTok, LabTok > > &parsed_sents2) {
+    auto &writer = new_table(this->tables, "sentences_parsing", digest);
+    SnapshotJaggedArrayBuilder< ParsingTreeNode< SymTok, LabTok > > trees;
+    for (const auto &pt : parsed_sents2) {
+        trees.push_row(pt.get_nodes(), pt.get_nodes() + pt.get_nodes_len());
+    }
+    writer.write_jagged(trees);
+}
+
+bool SnapshotToolboxCache::get_vars(const std::string &digest, std::vector< std::set< LabTok > > &sentence_vars, std::vector< std::set< LabTok > > &assertion_unconst_vars, std::vector< std::set< LabTok > > &assertion_const_vars) {
+    try {
+        auto cur = this->get_table("vars", digest);
+        if (!cur) {
+            return false;
+        }
+        auto sentence = read_sets(*cur);
+        auto unconst = read_sets(*cur);
+        auto const_ = read_sets(*cur);
+        sentence_vars = std::move(sentence);
+        assertion_unconst_vars = std::move(unconst);
+        assertion_const_vars = std::move(const_);
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    return true;
+}
+
+void SnapshotToolboxCache::set_vars(const std::string &digest, const std::vector< std::set< LabTok > > &sentence_vars, const std::vector< std::set< LabTok > > &assertion_unconst_vars, const std::vector< std::set< LabTok > > &assertion_const_vars) {
+    auto &writer = new_table(this->tables, "vars", digest);
+    write_sets(writer, sentence_vars);
+    write_sets(writer, assertion_unconst_vars);
+    write_sets(writer, assertion_const_vars);
+}
+
+bool SnapshotToolboxCache::get_labels_to_theses(const std::string &digest, std::unordered_map< LabTok, std::vector< LabTok > > &root_labels_to_theses,
+                                                std::unordered_map< LabTok, std::vector< LabTok > > &imp_ant_labels_to_theses, std::unordered_map< LabTok, std::vector< LabTok > > &imp_con_labels_to_theses) {
+    try {
+        auto cur = this->get_table("labels_to_theses", digest);
+        if (!cur) {
+            return false;
+        }
+        auto root = read_labels_map(*cur);
+        auto imp_ant = read_labels_map(*cur);
+        auto imp_con = read_labels_map(*cur);
+        root_labels_to_theses = std::move(root);
+        imp_ant_labels_to_theses = std::move(imp_ant);
+        imp_con_labels_to_theses = std::move(imp_con);
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    return true;
+}
+
+void SnapshotToolboxCache::set_labels_to_theses(const std::string &digest, const std::unordered_map< LabTok, std::vector< LabTok > > &root_labels_to_theses,
+                                                const std::unordered_map< LabTok, std::vector< LabTok > > &imp_ant_labels_to_theses, const std::unordered_map< LabTok, std::vector< LabTok > > &imp_con_labels_to_theses) {
+    auto &writer = new_table(this->tables, "labels_to_theses", digest);
+    write_labels_map(writer, root_labels_to_theses);
+    write_labels_map(writer, imp_ant_labels_to_theses);
+    write_labels_map(writer, imp_con_labels_to_theses);
+}
+
+/* Each substitution map is stored as a row of variables and, in another
+ * jagged array, one row for each of its entries. */
+bool SnapshotToolboxCache::get_registered_provers(const std::string &digest, std::vector< RegisteredProverInstanceData > &provers) {
+    try {
+        auto cur = this->get_table("registered_provers", digest);
+        if (!cur) {
+            return false;
+        }
+        auto valid = cur->read_array< uint8_t >();
+        auto labels = cur->read_array< LabTok >();
+        auto perm_invs = cur->read_jagged< uint64_t >();
+        auto map_vars = cur->read_jagged< SymTok >();
+        auto map_sents = cur->read_jagged< SymTok >();
+        size_t num = valid.size();
+        gio::assert_or_throw< std::runtime_error >(labels.size() == num && perm_invs.size() == num && map_vars.size() == num, "Inconsistent snapshot registered provers");
+        std::vector< RegisteredProverInstanceData > ret(num);
+        size_t sent_idx = 0;
+        for (size_t i = 0; i < num; i++) {
+            auto &inst_data = ret[i];
+            inst_data.valid = valid[i] != 0;
+            inst_data.label = labels[i];
+            auto perm_inv = perm_invs[i];
+            inst_data.perm_inv.assign(perm_inv.begin(), perm_inv.end());
+            for (const auto &var : map_vars[i]) {
+                gio::assert_or_throw< std::runtime_error >(sent_idx < map_sents.size(), "Inconsistent snapshot registered provers");
+                inst_data.ass_map[var] = map_sents[sent_idx++].to_vector();
+            }
+        }
+        gio::assert_or_throw< std::runtime_error >(sent_idx == map_sents.size(), "Inconsistent snapshot registered provers");
+        provers = std::move(ret);
+    } catch (const std::runtime_error&) {
+        return false;
+    }
+    return true;
+}
+
+void SnapshotToolboxCache::set_registered_provers(const std::string &digest, const std::vector< RegisteredProverInstanceData > &provers) {
+    auto &writer = new_table(this->tables, "registered_provers", digest);
+    std::vector< uint8_t > valid;
+    std::vector< LabTok > labels;
+    SnapshotJaggedArrayBuilder< uint64_t > perm_invs;
+    SnapshotJaggedArrayBuilder< SymTok > map_vars, map_sents;
+    for (const auto &inst_data : provers) {
+        valid.push_back(inst_data.valid ? 1 : 0);
+        labels.push_back(inst_data.label);
+        perm_invs.push_row(inst_data.perm_inv.begin(), inst_data.perm_inv.end());
+        for (const auto &entry : inst_data.ass_map) {
+            map_vars.push_value(entry.first);
+            map_sents.push_row(entry.second.begin(), entry.second.end());
+        }
+        map_vars.end_row();
+    }
+    writer.write_vector(valid);
+    writer.write_vector(labels);
+    writer.write_jagged(perm_invs);
+    writer.write_jagged(map_vars);
+    writer.write_jagged(map_sents);
+}
+
 std::string ProofPrinter::to_string() const
 {
     std::ostringstream buf;
@@ -1,11 +1,15 @@
 #pragma once
 
 #include <vector>
+#include <map>
+#include <set>
+#include <optional>
 #include <unordered_map>
 #include <functional>
 #include <fstream>
 #include <string>
 #include <memory>
+#include <mutex>
 
 #include <boost/filesystem.hpp>
 
@@ -14,16 +18,18 @@
 
 class LibraryToolbox;
 
-template<typename Engine>
-using Prover = std::function< bool(Engine&) >;
-
 #include "library.h"
+#include "asstable.h"
 #include "parsing/lr.h"
 #include "parsing/unif.h"
+#include "parsing/discr.h"
+#include "parsing/ptarena.h"
 #include "sentengine.h"
 #include "mmtemplates.h"
 #include "tempgen.h"
 #include "ptengine.h"
+#include "proofprog.h"
+#include "snapshot.h"
 
 class LibraryToolbox;
 
@@ -113,6 +119,30 @@ public:
     virtual void set_digest(std::string digest) = 0;
     virtual LRParser< SymTok, LabTok >::CachedData get_lr_parser_data() = 0;
     virtual void set_lr_parser_data(const LRParser< SymTok, LabTok >::CachedData &cached_data) = 0;
+
+    /* The other tables computed by LibraryToolbox are cached independently
+     * of each other, each one along with the digest of the data it was
+     * computed from. A getter returns false if its table is not available
+     * for the requested digest, in which case the toolbox computes it again
+     * and hands it to the setter. The default implementations do not cache
+     * anything. */
+    virtual bool get_sentences_parsing(const std::string &digest, std::vector< ParsingTree2< SymTok, LabTok > > &parsed_sents2);
+    virtual void set_sentences_parsing(const std::string &digest, const std::vector< ParsingTree2< SymTok, LabTok > > &parsed_sents2);
+    virtual bool get_vars(const std::string &digest, std::vector< std::set< LabTok > > &sentence_vars, std::vector< std::set< LabTok > > &assertion_unconst_vars, std::vector< std::set< LabTok > > &assertion_const_vars);
+    virtual void set_vars(const std::string &digest, const std::vector< std::set< LabTok > > &sentence_vars, const std::vector< std::set< LabTok > > &assertion_unconst_vars, const std::vector< std::set< LabTok > > &assertion_const_vars);
+    virtual bool get_labels_to_theses(const std::string &digest, std::unordered_map< LabTok, std::vector< LabTok > > &root_labels_to_theses,
+                                      std::unordered_map< LabTok, std::vector< LabTok > > &imp_ant_labels_to_theses, std::unordered_map< LabTok, std::vector< LabTok > > &imp_con_labels_to_theses);
+    virtual void set_labels_to_theses(const std::string &digest, const std::unordered_map< LabTok, std::vector< LabTok > > &root_labels_to_theses,
+                                      const std::unordered_map< LabTok, std::vector< LabTok > > &imp_ant_labels_to_theses, const std::unordered_map< LabTok, std::vector< LabTok > > &imp_con_labels_to_theses);
+    // The label_str debug field of registered provers is not cached
+    virtual bool get_registered_provers(const std::string &digest, std::vector< RegisteredProverInstanceData > &provers);
+    virtual void set_registered_provers(const std::string &digest, const std::vector< RegisteredProverInstanceData > &provers);
+
+    /* The parsing trees returned by get_sentences_parsing() may point
+     * inside memory owned by the cache; the returned handle keeps it alive
+     * after the cache is gone. The default implementation returns nullptr,
+     * for caches whose trees do not need it. */
+    virtual std::shared_ptr< const void > get_sentences_parsing_owner() const;
 };
 
 class FileToolboxCache : public ToolboxCache {
@@ -131,6 +161,48 @@ private:
     LRParser< SymTok, LabTok >::CachedData lr_parser_data;
 };
 
+/* Same as FileToolboxCache, but data is stored in a binary snapshot
+ * (see snapshot.h), which is much faster to load and store. */
+class SnapshotToolboxCache : public ToolboxCache {
+public:
+    SnapshotToolboxCache(const boost::filesystem::path &filename);
+    bool load() override;
+    bool store() override;
+    std::string get_digest() override;
+    void set_digest(std::string digest) override;
+    LRParser< SymTok, LabTok >::CachedData get_lr_parser_data() override;
+    void set_lr_parser_data(const LRParser< SymTok, LabTok >::CachedData &cached_data) override;
+    bool get_sentences_parsing(const std::string &digest, std::vector< ParsingTree2< SymTok, LabTok > > &parsed_sents2) override;
+    void set_sentences_parsing(const std::string &digest, const std::vector< ParsingTree2< SymTok, LabTok > > &parsed_sents2) override;
+    bool get_vars(const std::string &digest, std::vector< std::set< LabTok > > &sentence_vars, std::vector< std::set< LabTok > > &assertion_unconst_vars, std::vector< std::set< LabTok > > &assertion_const_vars) override;
+    void set_vars(const std::string &digest, const std::vector< std::set< LabTok > > &sentence_vars, const std::vector< std::set< LabTok > > &assertion_unconst_vars, const std::vector< std::set< LabTok > > &assertion_const_vars) override;
+    bool get_labels_to_theses(const std::string &digest, std::unordered_map< LabTok, std::vector< LabTok > > &root_labels_to_theses,
+                              std::unordered_map< LabTok, std::vector< LabTok > > &imp_ant_labels_to_theses, std::unordered_map< LabTok, std::vector< LabTok > > &imp_con_labels_to_theses) override;
+    void set_labels_to_theses(const std::string &digest, const std::unordered_map< LabTok, std::vector< LabTok > > &root_labels_to_theses,
+                              const std::unordered_map< LabTok, std::vector< LabTok > > &imp_ant_labels_to_theses, const std::unordered_map< LabTok, std::vector< LabTok > > &imp_con_labels_to_theses) override;
+    bool get_registered_provers(const std::string &digest, std::vector< RegisteredProverInstanceData > &provers) override;
+    void set_registered_provers(const std::string &digest, const std::vector< RegisteredProverInstanceData > &provers) override;
+    std::shared_ptr< const void > get_sentences_parsing_owner() const override;
+
+private:
+    // Return a cursor positioned after the section digest, if it matches
+    std::optional< SnapshotCursor > get_table(const std::string &name, const std::string &digest) const;
+
+    boost::filesystem::path filename;
+    std::string digest;
+    LRParser< SymTok, LabTok >::CachedData lr_parser_data;
+    // The snapshot is kept open after load(), so that tables can be read
+    // when they are requested and copied as they are when storing
+    SnapshotReader reader;
+    // Tables that were set since loading, already serialized as the
+    // content of a section with the same name
+    std::map< std::string, SnapshotBuffer > tables;
+    // Parsing trees returned by get_sentences_parsing() point inside the
+    // snapshot, so it stays mapped as long as this handle or its copies
+    // returned by get_sentences_parsing_owner() are alive
+    std::shared_ptr< const void > mapping;
+};
+
 class temp_allocator {
 public:
     virtual ~temp_allocator() = default;
@@ -143,7 +215,11 @@ public:
     explicit LibraryToolbox(const ExtendedLibrary &lib, std::string turnstile, std::shared_ptr< ToolboxCache > cache = nullptr);
 private:
     void compute_everything();
+    void compute_cache_digest();
     std::shared_ptr< ToolboxCache > cache;
+    // Digest of the library content the cached tables depend on
+    std::string cache_digest;
+    bool cache_modified = false;
 
     // Essentials
 public:
@@ -178,9 +254,22 @@ public:
 
     // Type proving
 public:
+    /* On checkpointed engines, when the variables' provers are programs
+     * (or there are none), the type prover is a program too. */
     template< typename Engine = ProofEngine, typename std::enable_if< std::is_base_of< ProofEngine, Engine >::value >::type* = nullptr >
     Prover< Engine > build_type_prover(const std::vector< SymTok > &type_sent, const std::unordered_map< SymTok, Prover< Engine > > &var_provers = {}) const
     {
+        if constexpr (std::is_base_of< CheckpointedProofEngine, Engine >::value) {
+            std::unordered_map< SymTok, std::shared_ptr< const ProofProgram > > var_progs;
+            if (get_programs(var_provers, var_progs)) {
+                auto type_proof = this->get_type_proof(type_sent);
+                if (type_proof != nullptr) {
+                    auto prog = std::make_shared< ProofProgram >();
+                    this->emit_type_proof(*prog, *type_proof, var_progs);
+                    return ProgramProver< Engine >{prog, this->get_proof_exception_dumper()};
+                }
+            }
+        }
         return [=](Engine &engine){
             return this->type_proving_helper(type_sent, engine, var_provers);
         };
@@ -188,11 +277,36 @@ public:
     template< typename Engine = ProofEngine, typename std::enable_if< std::is_base_of< ProofEngine, Engine >::value >::type* = nullptr >
     Prover< Engine > build_type_prover(const ParsingTree2< SymTok, LabTok > &pt, const std::unordered_map< LabTok, Prover< Engine > > &var_provers = {}) const
     {
+        if constexpr (std::is_base_of< CheckpointedProofEngine, Engine >::value) {
+            std::unordered_map< LabTok, std::shared_ptr< const ProofProgram > > var_progs_lab;
+            if (get_programs(var_provers, var_progs_lab)) {
+                std::unordered_map< SymTok, std::shared_ptr< const ProofProgram > > var_progs;
+                for (const auto &x : var_progs_lab) {
+                    var_progs[this->get_var_lab_to_sym(x.first)] = x.second;
+                }
+                auto prog = std::make_shared< ProofProgram >();
+                this->emit_type_proof(*prog, *this->build_type_proof(pt2_to_pt(pt)), var_progs);
+                return ProgramProver< Engine >{prog, this->get_proof_exception_dumper()};
+            }
+        }
         return [=](Engine &engine){
             return this->type_proving_helper(pt, engine, var_provers);
         };
     }
 private:
+    // Collect the programs of provers, failing if some of them is not a program
+    template< typename Key, typename Engine >
+    static bool get_programs(const std::unordered_map< Key, Prover< Engine > > &provers, std::unordered_map< Key, std::shared_ptr< const ProofProgram > > &progs) {
+        for (const auto &x : provers) {
+            auto prog = get_program(x.second);
+            if (prog == nullptr) {
+                return false;
+            }
+            progs[x.first] = prog;
+        }
+        return true;
+    }
+
     template< typename Engine = ProofEngine, typename std::enable_if< std::is_base_of< ProofEngine, Engine >::value >::type* = nullptr >
     void type_proving_helper_unwind_tree(const ParsingTree< SymTok, LabTok > &tree, Engine &engine, const std::unordered_map<LabTok, const Prover< Engine >* > &var_provers) const {
         // We need to sort children according to their order as floating hypotheses of this assertion
@@ -203,7 +317,7 @@ private:
             assert(it == var_provers.end());
             std::unordered_map< SymTok, const ParsingTree< SymTok, LabTok >* > children;
             auto it2 = tree.children.begin();
-            for (auto &tok : this->lib.get_sentence(tree.label)) {
+            for (auto &tok : this->lib.get_sentence_view(tree.label)) {
                 if (!this->lib.is_constant(tok)) {
                     children[tok] = &(*it2);
                     it2++;
@@ -211,7 +325,7 @@ private:
             }
             assert(it2 == tree.children.end());
             for (auto &hyp : ass.get_float_hyps()) {
-                SymTok tok = this->lib.get_sentence(hyp).at(1);
+                SymTok tok = this->lib.get_sentence_view(hyp).at(1);
                 this->type_proving_helper_unwind_tree(*children.at(tok), engine, var_provers);
             }
             engine.process_label(tree.label);
@@ -228,18 +342,24 @@ public:
     template< typename Engine = ProofEngine, typename std::enable_if< std::is_base_of< ProofEngine, Engine >::value >::type* = nullptr >
     bool type_proving_helper(const std::vector< SymTok > &type_sent, Engine &engine, const std::unordered_map< SymTok, Prover< Engine > > &var_provers = {}) const
     {
-        SymTok type = type_sent[0];
-        auto tree = this->parse_sentence(type_sent.begin()+1, type_sent.end(), type);
-        if (tree.label == LabTok{}) {
+        auto type_proof = this->get_type_proof(type_sent);
+        if (type_proof == nullptr) {
             return false;
-        } else {
-            std::unordered_map<LabTok, const Prover< Engine >* > lab_var_provers;
-            for (const auto &x : var_provers) {
-                lab_var_provers.insert(std::make_pair(this->get_var_sym_to_lab(x.first), &x.second));
+        }
+        type_proof->prog.execute(engine, [&](size_t slot) {
+            LabTok var_lab = type_proof->vars[slot];
+            auto it = var_provers.end();
+            if (!var_provers.empty()) {
+                it = var_provers.find(this->get_var_lab_to_sym(var_lab));
+            }
+            if (it == var_provers.end()) {
+                engine.process_label(var_lab);
+            } else {
+                it->second(engine);
             }
-            this->type_proving_helper_unwind_tree(tree, engine, lab_var_provers);
             return true;
-        }
+        });
+        return true;
     }
     template< typename Engine = ProofEngine, typename std::enable_if< std::is_base_of< ProofEngine, Engine >::value >::type* = nullptr >
     bool type_proving_helper(const ParsingTree2< SymTok, LabTok > &pt, Engine &engine, const std::unordered_map< LabTok, Prover< Engine > > &var_provers = {}) const
@@ -252,10 +372,41 @@ public:
         return true;
     }
 
+private:
+    /* The type proof of a sentence as a program whose hypothesis slots are
+     * its variables, so that it can be reused whatever the variables are
+     * replaced with; repeated subterms are emitted as saved steps. */
+    struct TypeProof {
+        ProofProgram prog;
+        std::vector< LabTok > vars;
+    };
+    // Return nullptr if the sentence cannot be parsed
+    std::shared_ptr< const TypeProof > get_type_proof(const std::vector< SymTok > &type_sent) const;
+    std::shared_ptr< const TypeProof > compute_type_proof(const std::vector< SymTok > &type_sent) const;
+    std::shared_ptr< const TypeProof > build_type_proof(const ParsingTree< SymTok, LabTok > &tree) const;
+    // Emit the type proof, where variables are proved by the given programs or by their floating hypotheses
+    void emit_type_proof(ProofProgram &prog, const TypeProof &type_proof, const std::unordered_map< SymTok, std::shared_ptr< const ProofProgram > > &var_progs) const;
+    /* The cache is kept in two generations: when the current one reaches
+     * this size it becomes the old one and the previous old one is dropped,
+     * while hits in the old generation are moved back to the current one.
+     * So the type proofs in use survive, and at most twice this many are
+     * kept. Type proofs are shared, so the provers already built keep
+     * theirs anyway. */
+    static const size_t type_proofs_cache_size = 1 << 16;
+    mutable std::mutex type_proofs_mutex;
+    mutable std::unordered_map< Sentence, std::shared_ptr< const TypeProof >, boost::hash< Sentence > > type_proofs;
+    mutable std::unordered_map< Sentence, std::shared_ptr< const TypeProof >, boost::hash< Sentence > > old_type_proofs;
+    void cache_type_proof(const Sentence &type_sent, const std::shared_ptr< const TypeProof > &type_proof) const;
+
     // Assertion unification
 public:
     std::vector<std::tuple< LabTok, std::vector< size_t >, std::unordered_map<SymTok, Sentence > > > unify_assertion(const std::vector< Sentence > &hypotheses, const Sentence &thesis, bool just_first=true, bool up_to_hyps_perms=true, const std::set< std::pair< SymTok, SymTok > > &antidists = {}) const;
     std::vector<std::tuple< LabTok, std::vector< size_t >, std::unordered_map<SymTok, Sentence > > > unify_assertion(const std::vector< std::pair< SymTok, ParsingTree< SymTok, LabTok > > > &hypotheses, const std::pair< SymTok, ParsingTree< SymTok, LabTok > > &thesis, bool just_first=true, bool up_to_hyps_perms=true, const std::set< std::pair< SymTok, SymTok > > &antidists = {}) const;
+    /* Same as unify_assertion() for each of many (hypotheses, thesis) queries;
+     * identical queries are processed only once, the candidates for all the
+     * theses are found in a single walk of the assertions index and the
+     * queries are then unified across jobs threads (see parallel_for()). */
+    std::vector< std::vector<std::tuple< LabTok, std::vector< size_t >, std::unordered_map<SymTok, Sentence > > > > unify_assertion_batch(const std::vector< std::pair< std::vector< Sentence >, Sentence > > &queries, bool just_first=true, bool up_to_hyps_perms=true, const std::set< std::pair< SymTok, SymTok > > &antidists = {}, size_t jobs = 0) const;
 
     // Reading and printing
 public:
@@ -292,6 +443,13 @@ private:
     void compute_is_var_by_type();
     std::vector< bool > is_var_by_type;
 
+    // Flat copy of the valid assertions, for the loops that walk many of them
+public:
+    const AssertionTable &get_assertions_table() const;
+private:
+    void compute_assertions_table();
+    AssertionTable assertions_table;
+
     // Assertions sorted according to the type of their thesis
 public:
     const std::unordered_map< SymTok, std::vector< LabTok > > &get_assertions_by_type() const;
@@ -335,12 +493,22 @@ private:
     std::unordered_map< LabTok, std::vector< LabTok > > imp_ant_labels_to_theses;
     std::unordered_map< LabTok, std::vector< LabTok > > imp_con_labels_to_theses;
 
+    // Index of the assertions' theses, used to find the assertions that may unify with a sentence
+public:
+    const DiscriminationTree< SymTok, LabTok, LabTok > &get_assertions_index() const;
+private:
+    void compute_assertions_index();
+    std::unique_ptr< DiscriminationTree< SymTok, LabTok, LabTok > > assertions_index;
+
     // LR parsing
 public:
     const LRParser< SymTok, LabTok > &get_parser() const;
     ParsingTree< SymTok, LabTok > parse_sentence(typename Sentence::const_iterator sent_begin, typename Sentence::const_iterator sent_end, SymTok type) const;
     ParsingTree< SymTok, LabTok > parse_sentence(const Sentence &sent, SymTok type) const;
     ParsingTree< SymTok, LabTok > parse_sentence(const Sentence &sent) const;
+    ParsingTree2< SymTok, LabTok > parse_sentence2(typename Sentence::const_iterator sent_begin, typename Sentence::const_iterator sent_end, SymTok type) const;
+    // Parse sentences beginning with their type symbol, in parallel; sentences that cannot be parsed get empty trees
+    std::vector< ParsingTree2< SymTok, LabTok > > parse_sentences2(const std::vector< SentenceView > &sents, size_t jobs = 0) const;
 private:
     void compute_parser_initialization();
     std::unique_ptr< LRParser< SymTok, LabTok > > parser;
@@ -358,8 +526,26 @@ private:
     void compute_sentences_parsing();
     std::vector< ParsingTree< SymTok, LabTok > > parsed_sents;
     std::vector< ParsingTree2< SymTok, LabTok > > parsed_sents2;
+    // Keeps alive the memory parsed_sents2 points to when it comes from
+    // the cache, which is dropped once the toolbox is built
+    std::shared_ptr< const void > parsed_sents2_owner;
     std::vector< std::vector< std::pair< ParsingTreeMultiIterator< SymTok, LabTok >::Status, ParsingTreeNode< SymTok, LabTok > > > > parsed_iters;
 
+    /* Hash-consed store of the preparsed sentences. When the sentences are
+     * parsed, it is built right away and it stores the nodes that
+     * parsed_sents2 points to, once for each distinct sentence; when they
+     * come from the cache, whose memory is kept by parsed_sents2_owner, it
+     * is built the first time it is requested. Sentences that were not
+     * parsed get invalid_id. */
+public:
+    const ParsingTreeArena< SymTok, LabTok > &get_parsed_sents_arena() const;
+    ParsingTreeArena< SymTok, LabTok >::Id get_parsed_sent_id(LabTok label) const;
+private:
+    void compute_parsed_sents_arena() const;
+    mutable std::once_flag parsed_sents_arena_flag;
+    mutable std::unique_ptr< ParsingTreeArena< SymTok, LabTok > > parsed_sents_arena;
+    mutable std::vector< ParsingTreeArena< SymTok, LabTok >::Id > parsed_sents_ids;
+
     // Provers utilities
 public:
     LabTok get_registered_prover_label(const RegisteredProver &prover) const;
@@ -368,16 +554,57 @@ public:
     template< typename Engine = CheckpointedProofEngine, typename std::enable_if< std::is_base_of< CheckpointedProofEngine, Engine >::value >::type* = nullptr >
     Prover< Engine > build_registered_prover(const RegisteredProver &prover, const std::unordered_map< std::string, Prover< Engine > > &types_provers, const std::vector< Prover< Engine > > &hyps_provers) const
     {
-        const size_t &index = prover.index;
-        if (index >= this->instance_registered_provers.size() || !this->instance_registered_provers[index].valid) {
-            throw std::runtime_error("cannot modify const object");
+        const RegisteredProverInstanceData &inst_data = this->get_registered_prover_instance(prover.index);
+        gio::assert_or_throw< std::runtime_error >(inst_data.valid, "Could not find the template assertion");
+        const RegisteredProverInstanceData *inst_ptr = &inst_data;
+
+        // If all the provers it uses are programs, the new one is a program too
+        auto prog = this->compose_registered_program(inst_data, types_provers, hyps_provers);
+        if (prog != nullptr) {
+            return ProgramProver< Engine >{prog, this->get_proof_exception_dumper()};
         }
-        const RegisteredProverInstanceData &inst_data = this->instance_registered_provers[index];
-
         return [=](Engine &engine){
-            return this->proving_helper(inst_data, types_provers, hyps_provers, engine);
+            return this->proving_helper(*inst_ptr, types_provers, hyps_provers, engine);
         };
     }
+    /* The program that proving_helper() would run, or nullptr if some of
+     * the provers is not a program or a type proof cannot be found */
+    template< typename Engine = CheckpointedProofEngine, typename std::enable_if< std::is_base_of< CheckpointedProofEngine, Engine >::value >::type* = nullptr >
+    std::shared_ptr< const ProofProgram > compose_registered_program(const RegisteredProverInstanceData &inst_data, const std::unordered_map< std::string, Prover< Engine > > &types_provers, const std::vector< Prover< Engine > > &hyps_provers) const
+    {
+        std::vector< std::shared_ptr< const ProofProgram > > hyps_progs;
+        for (const auto &hyp_prover : hyps_provers) {
+            hyps_progs.push_back(get_program(hyp_prover));
+            if (hyps_progs.back() == nullptr) {
+                return nullptr;
+            }
+        }
+        std::unordered_map< SymTok, std::shared_ptr< const ProofProgram > > types_progs;
+        for (const auto &type_pair : types_provers) {
+            auto type_prog = get_program(type_pair.second);
+            if (type_prog == nullptr) {
+                return nullptr;
+            }
+            types_progs[this->get_symbol(type_pair.first)] = type_prog;
+        }
+        const Assertion &ass = this->get_assertion(inst_data.label);
+        auto ret = std::make_shared< ProofProgram >();
+        for (auto &hyp : ass.get_float_hyps()) {
+            auto type_proof = this->get_type_proof(substitute(this->get_sentence_view(hyp), inst_data.ass_map, this->get_standard_is_var_sym()));
+            if (type_proof == nullptr) {
+                return nullptr;
+            }
+            this->emit_type_proof(*ret, *type_proof, types_progs);
+        }
+        for (size_t i = 0; i < ass.get_ess_hyps().size(); i++) {
+            ret->emit_subprogram(hyps_progs[inst_data.perm_inv[i]]);
+        }
+        ret->emit_label(ass.get_thesis());
+        return ret;
+    }
+    /* Registered provers are resolved lazily, the first time each of them
+     * is used. When a cache is available, all of them are resolved in
+     * parallel here instead, so that the result can be stored. */
     void compute_registered_provers();
     template< typename Engine = CheckpointedProofEngine, typename std::enable_if< std::is_base_of< CheckpointedProofEngine, Engine >::value >::type* = nullptr >
     Prover< Engine > build_prover(const std::vector< Sentence > &templ_hyps,
@@ -415,7 +642,7 @@ public:
 
         // Compute floating hypotheses
         for (auto &hyp : ass.get_float_hyps()) {
-            bool res = this->type_proving_helper(substitute(this->get_sentence(hyp), inst_data.ass_map, this->get_standard_is_var_sym()), engine, types_provers);
+            bool res = this->type_proving_helper(substitute(this->get_sentence_view(hyp), inst_data.ass_map, this->get_standard_is_var_sym()), engine, types_provers);
             if (!res) {
                 //std::cerr << "Applying " << inst_data.label_str << " a floating hypothesis failed..." << std::endl;
                 engine.rollback();
@@ -446,14 +673,16 @@ public:
         return true;
     }
 private:
-    void compute_registered_prover(size_t i, bool exception_on_failure = true);
+    void compute_registered_prover(size_t i, bool exception_on_failure = true) const;
+    const RegisteredProverInstanceData &get_registered_prover_instance(size_t index) const;
     // This is an instance of the Construct On First Use idiom, which prevents the static initialization fiasco;
     // see https://isocpp.org/wiki/faq/ctors#static-init-order-on-first-use-members
     static std::vector< RegisteredProverData > &registered_provers() {
         static auto ret = std::make_unique< std::vector< RegisteredProverData > >();
         return *ret;
     }
-    std::vector< RegisteredProverInstanceData > instance_registered_provers;
+    mutable std::vector< RegisteredProverInstanceData > instance_registered_provers;
+    mutable std::unique_ptr< std::once_flag[] > registered_provers_flags;
 
     // Dynamic generation of temporary variables and labels
 public:
@@ -477,6 +706,8 @@ public:
 public:
     void dump_proof_exception(const ProofException<Sentence> &e, std::ostream &out) const;
     void dump_proof_exception(const ProofException<ParsingTree2<SymTok, LabTok>> &e, std::ostream &out) const;
+    // Dump the errors of the programs built by the toolbox to std::cerr, as proving_helper() does
+    ProofExceptionHandler get_proof_exception_dumper() const;
 
     // Library interface
 public:
@@ -487,7 +718,7 @@ public:
     size_t get_symbols_num() const override;
     size_t get_labels_num() const override;
     bool is_constant(SymTok c) const override;
-    const Sentence &get_sentence(LabTok label) const override;
+    SentenceView get_sentence_view(LabTok label) const override;
     SentenceType get_sentence_type(LabTok label) const override;
     const Assertion &get_assertion(LabTok label) const override;
     //std::function< const Assertion*() > list_assertions() const;
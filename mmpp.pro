@@ -55,7 +55,7 @@ equals(DISABLE_TESTS, "true") {
 }
 
 !win32 {
-    QMAKE_LIBS += -lboost_system -lboost_filesystem -lboost_serialization
+    QMAKE_LIBS += -lboost_system -lboost_filesystem -lboost_serialization -lboost_iostreams
     !equals(DISABLE_TESTS, "true") {
         QMAKE_LIBS += -lboost_unit_test_framework
     }
@@ -117,6 +117,8 @@ QMAKE_CXXFLAGS_RELEASE *= -Og
 SOURCES += \
     main.cpp \
     mm/library.cpp \
+    mm/asstable.cpp \
+    mm/proofprog.cpp \
     mm/proof.cpp \
     old/unification.cpp \
     provers/wff.cpp \
@@ -135,9 +137,13 @@ SOURCES += \
     test/test_minor.cpp \
     web/step.cpp \
     utils/threadmanager.cpp \
+    utils/parallel.cpp \
     apps/learning.cpp \
     provers/uct.cpp \
     mm/tokenizer.cpp \
+    mm/scanner.cpp \
+    mm/snapshot.cpp \
+    apps/bench_tokenizer.cpp \
     mm/engine.cpp \
     mm/funds.cpp \
     mm/mmtemplates.cpp \
@@ -170,6 +176,8 @@ HEADERS += \
     pch.h \
     provers/wff.h \
     mm/library.h \
+    mm/asstable.h \
+    mm/proofprog.h \
     mm/proof.h \
     old/unification.h \
     mm/toolbox.h \
@@ -190,10 +198,15 @@ HEADERS += \
     parsing/unif.h \
     web/step.h \
     utils/threadmanager.h \
+    utils/parallel.h \
     utils/backref_registry.h \
     parsing/algos.h \
+    parsing/discr.h \
+    parsing/ptarena.h \
     provers/uct.h \
     mm/tokenizer.h \
+    mm/scanner.h \
+    mm/snapshot.h \
     mm/engine.h \
     mm/funds.h \
     mm/mmtypes.h \
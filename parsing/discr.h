@@ -0,0 +1,138 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "parsing/parser.h"
+
+/* A discrimination tree indexes a set of patterns, i.e., parsing trees
+ * whose variables can be substituted, so that the patterns that may match a
+ * given parsing tree are found without trying all of them. Each pattern is
+ * read in prefix order, which is the order in which the nodes of a
+ * ParsingTree2 are stored, and each variable is replaced by a wildcard of
+ * its type. Repeated variables are not checked, so the returned candidates
+ * are a superset of the patterns that unilaterally unify with the query;
+ * a unificator has to confirm them.
+ */
+template< typename SymType, typename LabType, typename ValueType >
+class DiscriminationTree {
+public:
+    DiscriminationTree(const std::function< bool(LabType) > &is_var) : is_var(is_var), nodes(1) {
+    }
+
+    void insert(const ParsingTree2< SymType, LabType > &pattern, const ValueType &value) {
+        size_t cur = 0;
+        for (size_t i = 0; i < pattern.get_nodes_len(); i++) {
+            const auto &node = pattern.get_nodes()[i];
+            size_t next = this->nodes.size();
+            if (this->is_var(node.label)) {
+                auto res = this->nodes[cur].wildcards.insert(std::make_pair(node.type, next));
+                next = res.first->second;
+            } else {
+                auto res = this->nodes[cur].labels.insert(std::make_pair(node.label, next));
+                next = res.first->second;
+            }
+            if (next == this->nodes.size()) {
+                this->nodes.emplace_back();
+            }
+            cur = next;
+        }
+        this->nodes[cur].values.push_back(value);
+    }
+
+    // Call func(value) for each value whose pattern may match pt
+    template< typename Func >
+    void find_candidates(const ParsingTree2< SymType, LabType > &pt, const Func &func) const {
+        this->find_candidates_impl(0, pt.get_nodes(), pt.get_nodes() + pt.get_nodes_len(), func);
+    }
+
+    std::vector< ValueType > find_candidates(const ParsingTree2< SymType, LabType > &pt) const {
+        std::vector< ValueType > ret;
+        this->find_candidates(pt, [&ret](const ValueType &value) {
+            ret.push_back(value);
+        });
+        return ret;
+    }
+
+    /* Same as find_candidates() for many trees at once, calling
+     * func(i, value) for the values found for pts[i]. The index is walked
+     * only once: trees that follow the same path are carried down it
+     * together, so shared prefixes are looked up only once. */
+    template< typename Func >
+    void find_candidates_batch(const std::vector< const ParsingTree2< SymType, LabType >* > &pts, const Func &func) const {
+        std::vector< Cursor > cursors;
+        cursors.reserve(pts.size());
+        for (size_t i = 0; i < pts.size(); i++) {
+            cursors.push_back({ i, pts[i]->get_nodes(), pts[i]->get_nodes() + pts[i]->get_nodes_len() });
+        }
+        this->find_candidates_batch_impl(0, cursors, func);
+    }
+
+    size_t get_nodes_num() const {
+        return this->nodes.size();
+    }
+
+private:
+    struct Node {
+        std::unordered_map< LabType, size_t > labels;
+        std::unordered_map< SymType, size_t > wildcards;
+        std::vector< ValueType > values;
+    };
+
+    template< typename Func >
+    void find_candidates_impl(size_t cur, const ParsingTreeNode< SymType, LabType > *it, const ParsingTreeNode< SymType, LabType > *end, const Func &func) const {
+        const auto &node = this->nodes[cur];
+        if (it == end) {
+            for (const auto &value : node.values) {
+                func(value);
+            }
+            return;
+        }
+        auto label_it = node.labels.find(it->label);
+        if (label_it != node.labels.end()) {
+            this->find_candidates_impl(label_it->second, it + 1, end, func);
+        }
+        // A wildcard swallows the whole subtree rooted at the current node
+        auto wildcard_it = node.wildcards.find(it->type);
+        if (wildcard_it != node.wildcards.end()) {
+            this->find_candidates_impl(wildcard_it->second, it + 1 + it->descendants_num, end, func);
+        }
+    }
+
+    // A tree of a batch query and the position it has reached
+    struct Cursor {
+        size_t idx;
+        const ParsingTreeNode< SymType, LabType > *it;
+        const ParsingTreeNode< SymType, LabType > *end;
+    };
+
+    template< typename Func >
+    void find_candidates_batch_impl(size_t cur, const std::vector< Cursor > &cursors, const Func &func) const {
+        const auto &node = this->nodes[cur];
+        std::map< size_t, std::vector< Cursor > > next;
+        for (const auto &cursor : cursors) {
+            if (cursor.it == cursor.end) {
+                for (const auto &value : node.values) {
+                    func(cursor.idx, value);
+                }
+                continue;
+            }
+            auto label_it = node.labels.find(cursor.it->label);
+            if (label_it != node.labels.end()) {
+                next[label_it->second].push_back({ cursor.idx, cursor.it + 1, cursor.end });
+            }
+            auto wildcard_it = node.wildcards.find(cursor.it->type);
+            if (wildcard_it != node.wildcards.end()) {
+                next[wildcard_it->second].push_back({ cursor.idx, cursor.it + 1 + cursor.it->descendants_num, cursor.end });
+            }
+        }
+        for (const auto &child : next) {
+            this->find_candidates_batch_impl(child.first, child.second, func);
+        }
+    }
+
+    std::function< bool(LabType) > is_var;
+    std::vector< Node > nodes;
+};
@@ -5,10 +5,13 @@
 #include <utility>
 #include <set>
 #include <map>
-#include <queue>
 #include <iostream>
 #include <functional>
 #include <memory>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+#include <cassert>
 
 #include <boost/serialization/unordered_map.hpp>
 #include <boost/serialization/vector.hpp>
@@ -17,10 +20,6 @@
 #include "parser.h"
 #include "libs/serialize_tuple.h"
 
-// The state encodes (producting symbol, rule name, position, producted sentence)
-template< typename SymType, typename LabType >
-using LRState = std::set< std::tuple< SymType, LabType, size_t, std::vector< SymType > > >;
-
 template< typename SymType >
 std::ostream &default_sym_printer(std::ostream &os, SymType sym) {
     return os << sym;
@@ -31,196 +30,255 @@ std::ostream &default_lab_printer(std::ostream &os, LabType sym) {
     return os << sym;
 }
 
+/* Every state is mapped to a pair containing the shift map and the vector of reductions;
+ * each reduction is described by its head symbol, its label, its number of symbols and its number of variables. */
+template< typename SymType, typename LabType >
+using LRAutomaton = std::unordered_map< size_t, std::pair< std::unordered_map< SymType, size_t >, std::vector< std::tuple< SymType, LabType, size_t, size_t > > > >;
+
+/* A compiled version of LRAutomaton, which is what the parsing loop
+ * actually uses. Symbols are renumbered to dense column indices, so that
+ * a sentence can be translated once before parsing; the shift table is
+ * then stored with row displacement: the row of each state is placed at
+ * an offset in a shared array, so that a shift is looked up with two
+ * array accesses and no hashing, while the table stays about as compact
+ * as the sparse automaton. Reductions are stored in a single vector,
+ * contiguous for each state.
+ */
 template< typename SymType, typename LabType >
-static LRState< SymType, LabType > evolve_state(const LRState< SymType, LabType > &state, SymType sym, const std::unordered_map<SymType, std::vector<std::pair<LabType, std::vector< SymType > > > > &derivations) {
-    LRState< SymType, LabType > new_state;
-    std::queue< SymType > next_syms_queue;
-    std::set< SymType > next_syms;
-
-    // Read sym through each of the std::tuples
-    for (auto i : state) {
-        const auto &head_sym = std::get<0>(i);
-        const auto &rule = std::get<1>(i);
-        const size_t &pos = std::get<2>(i);
-        const std::vector< SymType > &sent = std::get<3>(i);
-        if (pos < sent.size() && sent[pos] == sym) {
-            new_state.insert(make_tuple(head_sym, rule, pos+1, sent));
-            if (pos+1 < sent.size()) {
-                next_syms_queue.push(sent[pos+1]);
+class LRTable {
+public:
+    typedef uint32_t Index;
+    static constexpr Index npos = std::numeric_limits< Index >::max();
+
+    struct Reduction {
+        SymType type;
+        LabType label;
+        Index type_col;
+        Index sym_num;
+        Index var_num;
+    };
+
+    LRTable() = default;
+
+    explicit LRTable(const LRAutomaton< SymType, LabType > &automaton) {
+        // Assign columns and count states
+        size_t states_num = 0;
+        auto add_column = [this](const SymType &sym) {
+            this->columns.insert(std::make_pair(sym, static_cast< Index >(this->columns.size())));
+        };
+        for (const auto &row : automaton) {
+            states_num = std::max(states_num, row.first + 1);
+            for (const auto &shift : row.second.first) {
+                add_column(shift.first);
+                states_num = std::max(states_num, shift.second + 1);
+            }
+            for (const auto &reduction : row.second.second) {
+                add_column(std::get<0>(reduction));
             }
         }
-    }
+        assert(states_num < npos);
+
+        // Collect the rows and the reductions, in state order
+        std::vector< std::vector< std::pair< Index, Index > > > rows(states_num);
+        this->reductions_offsets.assign(states_num + 1, 0);
+        for (size_t state = 0; state < states_num; state++) {
+            auto it = automaton.find(state);
+            if (it != automaton.end()) {
+                for (const auto &shift : it->second.first) {
+                    rows[state].push_back(std::make_pair(this->columns.at(shift.first), static_cast< Index >(shift.second)));
+                }
+                std::sort(rows[state].begin(), rows[state].end());
+                for (const auto &reduction : it->second.second) {
+                    this->reductions.push_back({ std::get<0>(reduction), std::get<1>(reduction), this->columns.at(std::get<0>(reduction)),
+                                                 static_cast< Index >(std::get<2>(reduction)), static_cast< Index >(std::get<3>(reduction)) });
+                }
+            }
+            this->reductions_offsets[state+1] = static_cast< Index >(this->reductions.size());
+        }
 
-    // Saturate with fresh derivations
-    while (!next_syms_queue.empty()) {
-        auto next_sym = next_syms_queue.front();
-        next_syms_queue.pop();
-        bool res;
-        std::tie(std::ignore, res) = next_syms.insert(next_sym);
-        if (res) {
-            auto it = derivations.find(next_sym);
-            if (it != derivations.end()) {
-                for (auto j : it->second) {
-                    const auto &lab = j.first;
-                    const auto &sent = j.second;
-                    new_state.insert(make_tuple(next_sym, lab, 0, sent));
-                    if (sent.size() > 0) {
-                        next_syms_queue.push(sent[0]);
+        // Pack the rows, placing the longest ones first at the first offset where they fit
+        std::vector< Index > order(states_num);
+        for (size_t i = 0; i < states_num; i++) {
+            order[i] = static_cast< Index >(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [&rows](Index x, Index y) {
+            return rows[x].size() > rows[y].size();
+        });
+        this->bases.assign(states_num, 0);
+        size_t first_free = 0;
+        for (const auto state : order) {
+            const auto &row = rows[state];
+            if (row.empty()) {
+                continue;
+            }
+            while (first_free < this->checks.size() && this->checks[first_free] != npos) {
+                first_free++;
+            }
+            size_t base = first_free >= row.front().first ? first_free - row.front().first : 0;
+            while (true) {
+                bool fits = true;
+                for (const auto &entry : row) {
+                    if (base + entry.first < this->checks.size() && this->checks[base + entry.first] != npos) {
+                        fits = false;
+                        break;
                     }
                 }
+                if (fits) {
+                    break;
+                }
+                base++;
+            }
+            this->bases[state] = static_cast< Index >(base);
+            if (this->checks.size() < base + row.back().first + 1) {
+                this->checks.resize(base + row.back().first + 1, npos);
+                this->targets.resize(base + row.back().first + 1, npos);
+            }
+            for (const auto &entry : row) {
+                this->checks[base + entry.first] = state;
+                this->targets[base + entry.first] = entry.second;
             }
         }
     }
 
-    return new_state;
-}
-
-template< typename SymType, typename LabType >
-static std::set< SymType > next_possible_symbols(const LRState< SymType, LabType > &state) {
-    std::set< SymType > res;
-    for (auto i : state) {
-        const size_t &pos = std::get<2>(i);
-        const std::vector< SymType > &sent = std::get<3>(i);
-        if (pos < sent.size()) {
-            res.insert(sent[pos]);
+    // Return npos if the symbol never appears in the automaton
+    Index get_column(const SymType &sym) const {
+        auto it = this->columns.find(sym);
+        if (it == this->columns.end()) {
+            return npos;
         }
+        return it->second;
     }
-    return res;
-}
 
-template< typename SymType, typename LabType >
-static void print_state(const LRState< SymType, LabType > &state,
-                 const std::function< std::ostream&(std::ostream&, SymType) > &sym_printer = default_sym_printer< SymType >,
-                 const std::function< std::ostream&(std::ostream&, LabType) > &lab_printer = default_lab_printer< LabType >) {
-    for (auto i : state) {
-        sym_printer(lab_printer(std::cout  << "(", std::get<1>(i)) << ") ", std::get<0>(i)) << ":";
-        for (size_t j = 0; j < std::get<3>(i).size(); j++) {
-            if (j == std::get<2>(i)) {
-                std::cout << " •";
-            }
-            sym_printer(std::cout << " ", std::get<3>(i)[j]);
+    // Return npos if there is no shift from state with the symbol at column col
+    Index get_shift(Index state, Index col) const {
+        if (col == npos) {
+            return npos;
         }
-        if (std::get<3>(i).size() == std::get<2>(i)) {
-            std::cout << " •";
+        size_t idx = static_cast< size_t >(this->bases[state]) + col;
+        if (idx < this->checks.size() && this->checks[idx] == state) {
+            return this->targets[idx];
         }
-        std::cout << std::endl;
+        return npos;
     }
-    std::cout << std::endl;
-}
 
-template< typename SymType, typename LabType >
-static std::pair< size_t, size_t > count_rules(const LRState< SymType, LabType > &state, const std::unordered_map<SymType, std::vector<std::pair<LabType, std::vector< SymType > > > > &derivations) {
-    size_t shift_num = 0;
-    size_t reduce_num = 0;
-    for (auto i : state) {
-        const size_t &pos = std::get<2>(i);
-        const std::vector< SymType > &sent = std::get<3>(i);
-        if (pos == sent.size()) {
-            // If the position is at the end of the sentence, then we should reduce
-            reduce_num++;
-        } else {
-            // If the current symbol is a terminal, then we should shift
-            if (derivations.find(sent[pos]) == derivations.end()) {
-                shift_num++;
-            }
-        }
+    const Reduction *reductions_begin(Index state) const {
+        return this->reductions.data() + this->reductions_offsets[state];
+    }
+
+    const Reduction *reductions_end(Index state) const {
+        return this->reductions.data() + this->reductions_offsets[state+1];
+    }
+
+    size_t get_states_num() const {
+        return this->bases.size();
     }
-    return std::make_pair(shift_num, reduce_num);
-}
 
+private:
+    std::unordered_map< SymType, Index > columns;
+    std::vector< Index > bases;
+    std::vector< Index > checks;
+    std::vector< Index > targets;
+    std::vector< Index > reductions_offsets;
+    std::vector< Reduction > reductions;
+};
+
+/* The search for a parsing is a depth first visit of the possible
+ * sequences of shifts and reductions, where shifts are tried before
+ * reductions. The visit is iterative: each frame of the backtracking stack
+ * remembers the next action to try in its configuration, and undoing an
+ * action only needs the states that a reduction removed from the state
+ * stack, which are saved on a separate stack. All the stacks are kept
+ * between calls, so a helper that is reused (LRParser keeps one for each
+ * thread) does not allocate once its buffers are large enough.
+ */
 template< typename SymType, typename LabType >
 class LRParsingHelper {
 public:
-    LRParsingHelper(const std::unordered_map< size_t, std::pair< std::unordered_map< SymType, size_t >, std::vector< std::tuple< SymType, LabType, size_t, size_t > > > > &automaton,
-                    typename std::vector<SymType>::const_iterator sent_begin, typename std::vector<SymType>::const_iterator sent_end, SymType target_type) :
-    automaton(automaton), sent_begin(sent_begin), sent_end(sent_end), target_type(target_type), parsing_tree_stack_size(0) {
-        this->state_stack.push_back(0);
-        this->sent_it = this->sent_begin;
-    }
+    typedef typename LRTable< SymType, LabType >::Index Index;
+
+    template< typename It >
+    bool do_parsing(const LRTable< SymType, LabType > &table, It sent_begin, It sent_end, SymType target_type) {
+        this->sent_cols.clear();
+        this->state_stack.clear();
+        this->saved_states.clear();
+        this->frames.clear();
+        this->labels_stack.clear();
+        size_t parsing_tree_stack_size = 0;
+
+        // Symbols are translated to columns once, instead of at each shift attempt
+        for (auto it = sent_begin; it != sent_end; it++) {
+            this->sent_cols.push_back(table.get_column(*it));
+        }
+        size_t sent_pos = 0;
 
-    std::tuple< bool, bool > do_parsing() {
-        const auto &row = this->automaton.at(this->state_stack.back());
-        const auto &shifts = row.first;
-        const auto &reductions = row.second;
-
-        // Try to perform a shift
-        if (this->sent_it != sent_end) {
-            auto shift = shifts.find(*this->sent_it);
-            if (shift != shifts.end()) {
-                this->state_stack.push_back(shift->second);
-                this->sent_it++;
-
-                bool res;
-                bool must_halt;
-                std::tie(res, must_halt) = this->do_parsing();
-                if (res || must_halt) {
-                    return std::make_tuple(res, must_halt);
+        this->state_stack.push_back(0);
+        this->frames.push_back({ 0, 0 });
+        while (true) {
+            const Index state = this->frames.back().state;
+            const auto reductions_begin = table.reductions_begin(state);
+            const size_t reductions_num = table.reductions_end(state) - reductions_begin;
+            Index &next_action = this->frames.back().next_action;
+
+            // Try to perform a shift
+            if (next_action == 0) {
+                next_action++;
+                if (sent_pos != this->sent_cols.size()) {
+                    auto shift = table.get_shift(state, this->sent_cols[sent_pos]);
+                    if (shift != LRTable< SymType, LabType >::npos) {
+                        this->state_stack.push_back(shift);
+                        sent_pos++;
+                        this->frames.push_back({ shift, 0 });
+                        continue;
+                    }
                 }
-
-                this->sent_it--;
-                this->state_stack.pop_back();
             }
-        }
 
-        // Try to perform each reduction
-        for (const auto &reduction : reductions) {
-            SymType type;
-            LabType lab;
-            size_t sym_num;
-            size_t var_num;
-            std::tie(type, lab, sym_num, var_num) = reduction;
-
-            this->labels_stack.push_back(std::make_tuple(type, lab, var_num));
-            assert(this->parsing_tree_stack_size >= var_num);
-            this->parsing_tree_stack_size += 1 - var_num;
-            /*ParsingTree< SymType, LabType > new_parsing_tree;
-            new_parsing_tree.label = lab;
-            new_parsing_tree.type = type;
-            std::copy(this->parsing_tree_stack.end() - var_num, this->parsing_tree_stack.end(), std::back_inserter(new_parsing_tree.children));
-            this->parsing_tree_stack.resize(this->parsing_tree_stack.size() - var_num);
-            this->parsing_tree_stack.push_back(new_parsing_tree);*/
-
-            // Detect if the search has terminated
-            if (this->sent_it == this->sent_end && this->parsing_tree_stack_size == 1 && this->state_stack.size() == 1 + sym_num && type == this->target_type) {
-                return std::make_tuple(true, false);
-            }
+            // Try to perform the next reduction
+            if (next_action <= reductions_num) {
+                const auto &reduction = reductions_begin[next_action - 1];
+                next_action++;
+                this->labels_stack.push_back(std::make_tuple(reduction.type, reduction.label, static_cast< size_t >(reduction.var_num)));
+                assert(parsing_tree_stack_size >= reduction.var_num);
+                parsing_tree_stack_size += 1 - static_cast< size_t >(reduction.var_num);
+
+                // Detect if the search has terminated
+                if (sent_pos == this->sent_cols.size() && parsing_tree_stack_size == 1 && this->state_stack.size() == 1 + reduction.sym_num && reduction.type == target_type) {
+                    return true;
+                }
 
-            std::vector< size_t > temp_states;
-            std::copy(this->state_stack.end() - sym_num, this->state_stack.end(), std::back_inserter(temp_states));
-            this->state_stack.resize(this->state_stack.size() - sym_num);
-            auto new_row_it = this->automaton.find(this->state_stack.back());
-            // If the search had not terminated before and we do not have a new state to go, than the search has failed
-            if (new_row_it == this->automaton.end()) {
-                return std::make_tuple(false, true);
-            }
-            const auto &new_row = new_row_it->second;
-            // As above
-            auto new_state_it = new_row.first.find(type);
-            if (new_state_it == new_row.first.end()) {
-                return std::make_tuple(false, true);
+                this->saved_states.insert(this->saved_states.end(), this->state_stack.end() - reduction.sym_num, this->state_stack.end());
+                this->state_stack.resize(this->state_stack.size() - reduction.sym_num);
+                // If the search had not terminated before and we do not have a new state to go, than the search has failed
+                auto new_state = table.get_shift(this->state_stack.back(), reduction.type_col);
+                if (new_state == LRTable< SymType, LabType >::npos) {
+                    return false;
+                }
+                this->state_stack.push_back(new_state);
+                this->frames.push_back({ new_state, 0 });
+                continue;
             }
-            this->state_stack.push_back(new_state_it->second);
 
-            bool res;
-            bool must_halt;
-            std::tie(res, must_halt) = this->do_parsing();
-            if (res || must_halt) {
-                return std::make_tuple(res, must_halt);
+            // All the actions have been tried, so backtrack to the previous
+            // configuration and undo the action that led here
+            this->frames.pop_back();
+            if (this->frames.empty()) {
+                return false;
             }
-
+            const Index last_action = this->frames.back().next_action - 1;
             this->state_stack.pop_back();
-            std::copy(temp_states.begin(), temp_states.end(), std::back_inserter(this->state_stack));
-
-            this->parsing_tree_stack_size -= 1 - var_num;
-            this->labels_stack.pop_back();
-            /*this->parsing_tree_stack.pop_back();
-            std::copy(new_parsing_tree.children.begin(), new_parsing_tree.children.end(), std::back_inserter(this->parsing_tree_stack));*/
+            if (last_action == 0) {
+                sent_pos--;
+            } else {
+                const auto &reduction = table.reductions_begin(this->frames.back().state)[last_action - 1];
+                this->state_stack.insert(this->state_stack.end(), this->saved_states.end() - reduction.sym_num, this->saved_states.end());
+                this->saved_states.resize(this->saved_states.size() - reduction.sym_num);
+                parsing_tree_stack_size -= 1 - static_cast< size_t >(reduction.var_num);
+                this->labels_stack.pop_back();
+            }
         }
-
-        return std::make_tuple(false, false);
     }
 
-    ParsingTree< SymType, LabType > get_parsing_tree() {
+    ParsingTree< SymType, LabType > get_parsing_tree() const {
         std::vector< ParsingTree< SymType, LabType > > stack;
         for (const auto &x : this->labels_stack) {
             ParsingTree< SymType, LabType > pt;
@@ -235,17 +293,57 @@ public:
         return stack[0];
     }
 
+    /* The reductions are in postfix order, so first the size of each
+     * subtree is computed; then, walking them backwards, each node knows its
+     * position in prefix order and can assign one to its children. */
+    ParsingTree2< SymType, LabType > get_parsing_tree2() {
+        const size_t num = this->labels_stack.size();
+        this->sizes.resize(num);
+        this->positions.resize(num);
+        this->subtrees.clear();
+        for (size_t i = 0; i < num; i++) {
+            size_t size = 1;
+            for (size_t j = 0; j < std::get<2>(this->labels_stack[i]); j++) {
+                assert(!this->subtrees.empty());
+                size += this->sizes[this->subtrees.back()];
+                this->subtrees.pop_back();
+            }
+            this->sizes[i] = size;
+            this->subtrees.push_back(i);
+        }
+        assert(this->subtrees.size() == 1 && this->sizes[num-1] == num);
+
+        std::vector< ParsingTreeNode< SymType, LabType > > nodes(num);
+        this->positions[num-1] = 0;
+        for (size_t i = num; i-- > 0; ) {
+            const auto &x = this->labels_stack[i];
+            const size_t pos = this->positions[i];
+            nodes[pos] = { std::get<1>(x), std::get<0>(x), this->sizes[i] - 1 };
+            size_t child_end = pos + this->sizes[i];
+            size_t child = i - 1;
+            for (size_t j = 0; j < std::get<2>(x); j++) {
+                child_end -= this->sizes[child];
+                this->positions[child] = child_end;
+                child -= this->sizes[child];
+            }
+        }
+        return ParsingTree2< SymType, LabType >(std::move(nodes), NULL, 0);
+    }
+
 private:
-    const std::unordered_map< size_t, std::pair< std::unordered_map< SymType, size_t >, std::vector< std::tuple< SymType, LabType, size_t, size_t > > > > &automaton;
-    typename std::vector<SymType>::const_iterator sent_begin;
-    typename std::vector<SymType>::const_iterator sent_end;
-    const SymType target_type;
-
-    typename std::vector<SymType>::const_iterator sent_it;
-    std::vector< size_t > state_stack;
-    //std::vector< ParsingTree< SymType, LabType > > parsing_tree_stack;
-    size_t parsing_tree_stack_size;
+    std::vector< Index > sent_cols;
+    std::vector< Index > state_stack;
+    std::vector< Index > saved_states;
+    struct Frame {
+        Index state;
+        // The next action to try: 0 is the shift, i is the i-th reduction
+        Index next_action;
+    };
+    std::vector< Frame > frames;
     std::vector< std::tuple< SymType, LabType, size_t > > labels_stack;
+    std::vector< size_t > sizes;
+    std::vector< size_t > positions;
+    std::vector< size_t > subtrees;
 };
 
 template< typename SymType, typename LabType >
@@ -261,7 +359,7 @@ public:
 #endif
     }
 
-    typedef std::unordered_map< size_t, std::pair< std::unordered_map< SymType, size_t >, std::vector< std::tuple< SymType, LabType, size_t, size_t > > > > CachedData;
+    typedef LRAutomaton< SymType, LabType > CachedData;
 
     const CachedData &get_cached_data() const {
         return this->automaton;
@@ -269,14 +367,14 @@ public:
 
     void set_cached_data(const CachedData &cached_data) {
         this->automaton = cached_data;
+        this->clear_construction_data();
+        this->table = LRTable< SymType, LabType >(this->automaton);
     }
 
     using Parser< SymType, LabType >::parse;
     ParsingTree< SymType, LabType > parse(typename std::vector<SymType>::const_iterator sent_begin, typename std::vector<SymType>::const_iterator sent_end, SymType type) const {
-        LRParsingHelper< SymType, LabType > helper(this->automaton, sent_begin, sent_end, type);
-        bool res;
-        std::tie(res, std::ignore) = helper.do_parsing();
-        if (res) {
+        auto &helper = get_helper();
+        if (this->table.get_states_num() != 0 && helper.do_parsing(this->table, sent_begin, sent_end, type)) {
             auto parsing_tree = helper.get_parsing_tree();
 #ifdef LR_PARSER_SELF_TEST
             // Check that the returned parsing tree is correct
@@ -290,100 +388,381 @@ public:
         }
     }
 
-    void initialize() {
-        size_t num_states = 0;
-        std::map< LRState< SymType, LabType >, std::shared_ptr< std::pair< size_t, std::map< SymType, size_t > > > > states;
-        std::set< LRState< SymType, LabType > > processed_states;
-        std::queue< LRState< SymType, LabType > > new_states;
-
-        auto get_state_data = [&](const LRState< SymType, LabType > &state)->std::shared_ptr< std::pair< size_t, std::map< SymType, size_t > > > {
-            bool res;
-            typename std::map< LRState< SymType, LabType >, std::shared_ptr< std::pair< size_t, std::map< SymType, size_t > > > >::iterator it;
-            std::tie(it, res) = states.insert(std::make_pair(state, std::make_shared< std::pair< size_t, std::map< SymType, size_t > > >(num_states, std::map< SymType, size_t >())));
-            if (res) {
-                num_states++;
+    // Same as parse(), but the tree is directly built in the ParsingTree2 format; it is empty if parsing fails
+    ParsingTree2< SymType, LabType > parse2(typename std::vector<SymType>::const_iterator sent_begin, typename std::vector<SymType>::const_iterator sent_end, SymType type) const {
+        return this->parse2_range(sent_begin, sent_end, type);
+    }
+
+    ParsingTree2< SymType, LabType > parse2(const std::vector<SymType> &sent, SymType type) const {
+        return this->parse2(sent.begin(), sent.end(), type);
+    }
+
+    ParsingTree2< SymType, LabType > parse2(const SymType *sent_begin, const SymType *sent_end, SymType type) const {
+        return this->parse2_range(sent_begin, sent_end, type);
+    }
+
+    using typename Parser< SymType, LabType >::ParseRequest;
+    std::vector< ParsingTree2< SymType, LabType > > parse_many(const std::vector< ParseRequest > &reqs, size_t jobs = 0) const override {
+        std::vector< ParsingTree2< SymType, LabType > > ret(reqs.size());
+        parallel_for(reqs.size(), [&](size_t i) {
+            ret[i] = this->parse2(std::get<0>(reqs[i]), std::get<1>(reqs[i]), std::get<2>(reqs[i]));
+        }, jobs);
+        return ret;
+    }
+
+    /* Build the LR(0) automaton. An item is a pair (rule, position of the
+     * dot) and a state is identified by its kernel, i.e., the sorted vector
+     * of its items with the dot after the beginning (the initial state has
+     * an empty kernel); the other items are the closure of the symbols
+     * after the dot, i.e., all the rules that can begin a derivation of
+     * them, which is computed once for each nonterminal. Rules are numbered
+     * in the order of (head symbol, label, body) and reductions are listed
+     * in the same order; states are numbered in the order they are
+     * discovered. The construction data is only kept if keep_for_update
+     * is set, so that update() can reuse it later.
+     */
+    void initialize(bool keep_for_update = false) {
+        this->rules = this->collect_rules();
+        this->rules_rank.resize(this->rules.size());
+        for (RuleIdx i = 0; i < this->rules.size(); i++) {
+            this->rules_rank[i] = i;
+        }
+        this->explore({}, {}, {}, {}, 0);
+        if (!keep_for_update) {
+            this->clear_construction_data();
+        }
+    }
+
+    /* Update the automaton after some derivations were added to the
+     * derivations map. A state that was already there keeps its items and
+     * gains the items that the new rules add to its closure: only the
+     * shifts on the first symbols of those are recomputed, while the other
+     * shifts and the reductions are copied from the current automaton. The
+     * result is the same as calling initialize() again. If the automaton
+     * was loaded with set_cached_data(), or the derivations changed in some
+     * other way than by adding rules (including the case where a symbol
+     * that already appeared in some rule becomes a nonterminal), the
+     * automaton is built again from scratch. The same happens if the last
+     * call to initialize() did not keep the construction data; in any case
+     * the construction data is kept after update().
+     */
+    void update() {
+        auto new_rules = this->collect_rules();
+        if (this->kernels.empty() || new_rules.size() < this->rules.size()) {
+            this->initialize(true);
+            return;
+        }
+
+        // Find which rules are new; old rules keep their index
+        std::vector< bool > is_old(new_rules.size(), false);
+        for (const auto &rule : this->rules) {
+            auto it = std::lower_bound(new_rules.begin(), new_rules.end(), rule, rule_less);
+            if (it == new_rules.end() || rule_less(rule, *it) || it->var_num != rule.var_num) {
+                this->initialize(true);
+                return;
             }
-            return it->second;
-        };
+            is_old[it - new_rules.begin()] = true;
+        }
+        const RuleIdx old_rules_num = static_cast< RuleIdx >(this->rules.size());
+        if (old_rules_num == new_rules.size()) {
+            return;
+        }
+        const auto old_closures = this->compute_closures();
+        for (RuleIdx i = 0; i < new_rules.size(); i++) {
+            if (!is_old[i]) {
+                this->rules.push_back(std::move(new_rules[i]));
+            }
+        }
+        std::vector< RuleIdx > order(this->rules.size());
+        for (RuleIdx i = 0; i < this->rules.size(); i++) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [this](RuleIdx x, RuleIdx y) {
+            return rule_less(this->rules[x], this->rules[y]);
+        });
+        this->rules_rank.resize(this->rules.size());
+        for (RuleIdx i = 0; i < order.size(); i++) {
+            this->rules_rank[order[i]] = i;
+        }
+
+        auto old_kernels_idx = std::move(this->kernels_idx);
+        auto old_kernels = std::move(this->kernels);
+        auto old_automaton = std::move(this->automaton);
+        this->explore(old_kernels_idx, old_kernels, old_automaton, old_closures, old_rules_num);
+    }
+
+private:
+    typedef uint32_t RuleIdx;
+    typedef std::pair< RuleIdx, RuleIdx > Item;
+    typedef std::vector< Item > Kernel;
+
+    struct Rule {
+        SymType head;
+        LabType label;
+        std::vector< SymType > body;
+        size_t var_num;
+    };
+
+    struct KernelHasher {
+        size_t operator()(const Kernel &kernel) const {
+            return boost::hash_range(kernel.begin(), kernel.end());
+        }
+    };
 
-        // Construct initial state and push it to the std::queue of new states
-        LRState< SymType, LabType > initial;
-        for (auto i : this->derivations) {
-            auto sym = i.first;
-            for (auto j : i.second) {
-                auto lab = j.first;
-                auto sent = j.second;
-                initial.insert(make_tuple(sym, lab, 0, sent));
+    static bool rule_less(const Rule &x, const Rule &y) {
+        return std::tie(x.head, x.label, x.body) < std::tie(y.head, y.label, y.body);
+    }
+
+    std::vector< Rule > collect_rules() const {
+        std::vector< Rule > ret;
+        for (const auto &der : this->derivations) {
+            for (const auto &rule : der.second) {
+                size_t var_num = 0;
+                for (const auto &sym : rule.second) {
+                    if (this->derivations.find(sym) != this->derivations.end()) {
+                        var_num++;
+                    }
+                }
+                ret.push_back({ der.first, rule.first, rule.second, var_num });
+            }
+        }
+        std::sort(ret.begin(), ret.end(), rule_less);
+        ret.erase(std::unique(ret.begin(), ret.end(), [](const Rule &x, const Rule &y) { return !rule_less(x, y) && !rule_less(y, x); }), ret.end());
+        return ret;
+    }
+
+    std::unordered_map< SymType, std::vector< Item > > compute_closures() const {
+        std::unordered_map< SymType, std::vector< RuleIdx > > rules_by_head;
+        for (RuleIdx i = 0; i < this->rules.size(); i++) {
+            rules_by_head[this->rules[i].head].push_back(i);
+        }
+        std::unordered_map< SymType, std::vector< Item > > closures;
+        for (const auto &der : rules_by_head) {
+            std::set< SymType > seen_syms = { der.first };
+            std::vector< SymType > syms_queue = { der.first };
+            std::vector< Item > closure;
+            while (!syms_queue.empty()) {
+                const auto sym = syms_queue.back();
+                syms_queue.pop_back();
+                auto it = rules_by_head.find(sym);
+                if (it == rules_by_head.end()) {
+                    continue;
+                }
+                for (const auto rule : it->second) {
+                    closure.push_back(std::make_pair(rule, 0));
+                    if (!this->rules[rule].body.empty() && seen_syms.insert(this->rules[rule].body[0]).second) {
+                        syms_queue.push_back(this->rules[rule].body[0]);
+                    }
+                }
             }
+            std::sort(closure.begin(), closure.end());
+            closures[der.first] = std::move(closure);
         }
-        new_states.push(initial);
-
-        // Iteratively consider each new state and all its possible evolutions
-        while (!new_states.empty()) {
-            LRState< SymType, LabType > state = new_states.front();
-            new_states.pop();
-            bool res;
-            std::tie(std::ignore, res) = processed_states.insert(state);
-            // Proceed only if new state is actually new
-            if (res) {
-                auto state_data = get_state_data(state);
-                const size_t state_idx = state_data->first;
-                //std::cout << state_idx << std::endl;
-                //print_state(state, sym_printer, lab_printer);
-
-                // Build the shift map and enqueue new states
-                std::unordered_map< SymType, size_t > shifts;
-                std::set< SymType > next_syms = next_possible_symbols(state);
+        return closures;
+    }
+
+    /* Visit all the states reachable from the initial one. If an old
+     * automaton is given, with the closures and the number of rules it was
+     * built with, the states that were already there are derived from it. */
+    void explore(const std::unordered_map< Kernel, size_t, KernelHasher > &old_kernels_idx, const std::vector< const Kernel* > &old_kernels, const CachedData &old_automaton,
+                 const std::unordered_map< SymType, std::vector< Item > > &old_closures, RuleIdx old_rules_num) {
+        const auto closures = this->compute_closures();
+        this->kernels_idx.clear();
+        this->kernels.clear();
+        this->automaton.clear();
+        const size_t npos = std::numeric_limits< size_t >::max();
+        std::vector< size_t > new_to_old;
+        std::vector< size_t > old_to_new(old_kernels.size(), npos);
+        auto get_state_idx = [&](Kernel &&kernel) {
+            auto res = this->kernels_idx.insert(std::make_pair(std::move(kernel), this->kernels.size()));
+            if (res.second) {
+                this->kernels.push_back(&res.first->first);
+                auto old_it = old_kernels_idx.find(res.first->first);
+                new_to_old.push_back(old_it == old_kernels_idx.end() ? npos : old_it->second);
+                if (old_it != old_kernels_idx.end()) {
+                    old_to_new[old_it->second] = res.first->second;
+                }
+            }
+            return res.first->second;
+        };
+        get_state_idx({});
+
+        // The items that the new rules add to a state only depend on the symbols after the dots
+        std::map< std::vector< SymType >, std::vector< Item > > added_items_cache;
+        auto get_added_items = [&](const Kernel &kernel)->const std::vector< Item >& {
+            std::vector< SymType > next_syms;
+            for (const auto &item : kernel) {
+                const auto &rule = this->rules[item.first];
+                if (item.second < rule.body.size()) {
+                    next_syms.push_back(rule.body[item.second]);
+                }
+            }
+            std::sort(next_syms.begin(), next_syms.end());
+            next_syms.erase(std::unique(next_syms.begin(), next_syms.end()), next_syms.end());
+            auto res = added_items_cache.insert(std::make_pair(next_syms, std::vector< Item >()));
+            if (res.second) {
+                std::vector< Item > new_items;
+                std::vector< Item > old_items;
                 for (const auto &sym : next_syms) {
-                    auto new_state = evolve_state(state, sym, derivations);
-                    const size_t new_state_idx = get_state_data(new_state)->first;
-                    shifts.insert(std::make_pair(sym, new_state_idx));
-                    new_states.push(new_state);
+                    auto it = closures.find(sym);
+                    if (it != closures.end()) {
+                        new_items.insert(new_items.end(), it->second.begin(), it->second.end());
+                    }
+                    it = old_closures.find(sym);
+                    if (it != old_closures.end()) {
+                        old_items.insert(old_items.end(), it->second.begin(), it->second.end());
+                    }
                 }
+                std::sort(new_items.begin(), new_items.end());
+                std::sort(old_items.begin(), old_items.end());
+                std::set_difference(new_items.begin(), new_items.end(), old_items.begin(), old_items.end(), std::back_inserter(res.first->second));
+                res.first->second.erase(std::unique(res.first->second.begin(), res.first->second.end()), res.first->second.end());
+            }
+            return res.first->second;
+        };
 
-                // Build the vector of reductions
-                std::vector< std::tuple< SymType, LabType, size_t, size_t > > reductions;
-                for (auto rule : state) {
-                    const SymType &head_sym = std::get<0>(rule);
-                    const LabType &lab = std::get<1>(rule);
-                    const size_t &pos = std::get<2>(rule);
-                    const std::vector< SymType > &sent = std::get<3>(rule);
-                    size_t sym_num = sent.size();
-                    size_t var_num = 0;
-                    for (const auto &sym : sent) {
-                        if (this->derivations.find(sym) != this->derivations.end()) {
-                            var_num++;
+        std::vector< Item > items;
+        std::map< SymType, Kernel > evolutions;
+        std::vector< Item > initial_added_items;
+        for (RuleIdx i = old_rules_num; i < this->rules.size() && !old_kernels.empty(); i++) {
+            initial_added_items.push_back(std::make_pair(i, 0));
+        }
+        for (size_t state_idx = 0; state_idx < this->kernels.size(); state_idx++) {
+            const Kernel &kernel = *this->kernels[state_idx];
+
+            // If the state was already there, only the shifts on the first
+            // symbols of the added items change
+            const size_t old_idx = new_to_old[state_idx];
+            if (old_idx != npos) {
+                const auto &added_items = state_idx == 0 ? initial_added_items : get_added_items(kernel);
+                if (std::none_of(added_items.begin(), added_items.end(), [this](const Item &item) { return this->rules[item.first].body.empty(); })) {
+                    evolutions.clear();
+                    for (const auto &item : added_items) {
+                        evolutions[this->rules[item.first].body[0]].push_back(std::make_pair(item.first, 1));
+                    }
+                    const auto &old_row = old_automaton.at(old_idx);
+                    std::map< SymType, size_t > old_shifts(old_row.first.begin(), old_row.first.end());
+                    std::set< SymType > syms;
+                    for (const auto &shift : old_shifts) {
+                        syms.insert(shift.first);
+                    }
+                    for (const auto &evolution : evolutions) {
+                        syms.insert(evolution.first);
+                    }
+                    std::unordered_map< SymType, size_t > shifts;
+                    for (const auto &sym : syms) {
+                        auto old_shift = old_shifts.find(sym);
+                        auto evolution = evolutions.find(sym);
+                        size_t new_idx;
+                        if (evolution == evolutions.end()) {
+                            new_idx = old_to_new[old_shift->second];
+                            if (new_idx == npos) {
+                                new_idx = get_state_idx(Kernel(*old_kernels[old_shift->second]));
+                            }
+                        } else {
+                            Kernel new_kernel;
+                            if (old_shift != old_shifts.end()) {
+                                const auto &old_kernel = *old_kernels[old_shift->second];
+                                std::merge(old_kernel.begin(), old_kernel.end(), evolution->second.begin(), evolution->second.end(), std::back_inserter(new_kernel));
+                            } else {
+                                new_kernel = evolution->second;
+                            }
+                            new_idx = get_state_idx(std::move(new_kernel));
                         }
+                        shifts.insert(std::make_pair(sym, new_idx));
                     }
-                    if (pos == sent.size()) {
-                        reductions.push_back(std::make_tuple(head_sym, lab, sym_num, var_num));
+                    this->automaton[state_idx] = make_pair(shifts, old_row.second);
+                    continue;
+                }
+            }
+
+            // Compute all the items of the state
+            items.clear();
+            if (state_idx == 0) {
+                for (RuleIdx i = 0; i < this->rules.size(); i++) {
+                    items.push_back(std::make_pair(i, 0));
+                }
+            } else {
+                items = kernel;
+                for (const auto &item : kernel) {
+                    const auto &rule = this->rules[item.first];
+                    if (item.second < rule.body.size()) {
+                        auto it = closures.find(rule.body[item.second]);
+                        if (it != closures.end()) {
+                            items.insert(items.end(), it->second.begin(), it->second.end());
+                        }
                     }
                 }
+                std::sort(items.begin(), items.end());
+                items.erase(std::unique(items.begin(), items.end()), items.end());
+            }
 
-                // Insert information in the automaton
-                this->automaton[state_idx] = make_pair(shifts, reductions);
+            // Read each symbol through the items
+            evolutions.clear();
+            std::vector< RuleIdx > reducible;
+            for (const auto &item : items) {
+                const auto &rule = this->rules[item.first];
+                if (item.second == rule.body.size()) {
+                    reducible.push_back(item.first);
+                } else {
+                    evolutions[rule.body[item.second]].push_back(std::make_pair(item.first, item.second + 1));
+                }
+            }
+
+            // Build the shift map, numbering new states in symbol order
+            std::unordered_map< SymType, size_t > shifts;
+            for (auto &evolution : evolutions) {
+                shifts.insert(std::make_pair(evolution.first, get_state_idx(std::move(evolution.second))));
             }
-        }
 
-        // Look again at all states to list conflicts
-        /*for (const auto &it : states) {
-            const auto &state = it.first;
-            size_t shift_num;
-            size_t reduce_num;
-            std::tie(shift_num, reduce_num) = count_rules(state, this->derivations);
-            if (reduce_num > 1 || (reduce_num > 0 && shift_num > 0)) {
-                std::cout << "State " << it.second->first << " is conflicting!" << std::endl;
-                print_state(state, this->sym_printer, this->lab_printer);
-                std::cout << std::endl;
+            // Build the vector of reductions
+            std::sort(reducible.begin(), reducible.end(), [this](RuleIdx x, RuleIdx y) {
+                return this->rules_rank[x] < this->rules_rank[y];
+            });
+            std::vector< std::tuple< SymType, LabType, size_t, size_t > > reductions;
+            for (const auto rule_idx : reducible) {
+                const auto &rule = this->rules[rule_idx];
+                reductions.push_back(std::make_tuple(rule.head, rule.label, rule.body.size(), rule.var_num));
             }
-        }*/
+
+            // Insert information in the automaton
+            this->automaton[state_idx] = make_pair(shifts, reductions);
+        }
+        this->table = LRTable< SymType, LabType >(this->automaton);
+    }
+
+    template< typename It >
+    ParsingTree2< SymType, LabType > parse2_range(It sent_begin, It sent_end, SymType type) const {
+        auto &helper = get_helper();
+        if (this->table.get_states_num() != 0 && helper.do_parsing(this->table, sent_begin, sent_end, type)) {
+            return helper.get_parsing_tree2();
+        } else {
+            return {};
+        }
+    }
+
+    void clear_construction_data() {
+        // Swap with empty containers, so that their memory is released
+        std::vector< const Kernel* >().swap(this->kernels);
+        std::unordered_map< Kernel, size_t, KernelHasher >().swap(this->kernels_idx);
+        std::vector< RuleIdx >().swap(this->rules_rank);
+        std::vector< Rule >().swap(this->rules);
+    }
+
+    static LRParsingHelper< SymType, LabType > &get_helper() {
+        static thread_local LRParsingHelper< SymType, LabType > helper;
+        return helper;
     }
 
-private:
     const std::unordered_map<SymType, std::vector<std::pair<LabType, std::vector<SymType> > > > &derivations;
-    /* Every state is mapped to a pair containing the shift map and the vector of reductions;
-     * each reduction is described by its head symbol, its label, its number of symbols and its number of variables. */
+    // The automaton is kept for caching, while parsing uses its compiled version
     CachedData automaton;
+    LRTable< SymType, LabType > table;
+    // Construction data, only kept for update() if initialize() was asked to
+    std::vector< Rule > rules;
+    std::vector< RuleIdx > rules_rank;
+    std::unordered_map< Kernel, size_t, KernelHasher > kernels_idx;
+    std::vector< const Kernel* > kernels;
     const std::function< std::ostream&(std::ostream&, SymType) > sym_printer;
     const std::function< std::ostream&(std::ostream&, LabType) > lab_printer;
 
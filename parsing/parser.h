@@ -3,9 +3,12 @@
 #include <vector>
 #include <unordered_map>
 #include <cassert>
+#include <tuple>
 
 #include <boost/functional/hash.hpp>
 
+#include "utils/parallel.h"
+
 template< typename SymType, typename LabType >
 struct ParsingTree {
     LabType label;
@@ -397,6 +400,29 @@ public:
         return this->parse(sent.begin(), sent.end(), type);
     }
     virtual ParsingTree< SymType, LabType > parse(typename std::vector<SymType>::const_iterator sent_begin, typename std::vector<SymType>::const_iterator sent_end, SymType type) const = 0;
+
+    /* A sentence to parse, given as a range, with the type it must be parsed
+     * as; pointers are used instead of iterators, so that sentences do not
+     * need to be stored in a std::vector. */
+    typedef std::tuple< const SymType*, const SymType*, SymType > ParseRequest;
+
+    /* Parse many sentences, spreading them on jobs threads with
+     * parallel_for(), and return the parsing trees in the same order; a
+     * sentence that cannot be parsed gets an empty tree. Since parse() is
+     * called concurrently, it must not modify the parser. */
+    virtual std::vector< ParsingTree2< SymType, LabType > > parse_many(const std::vector< ParseRequest > &reqs, size_t jobs = 0) const {
+        std::vector< ParsingTree2< SymType, LabType > > ret(reqs.size());
+        parallel_for(reqs.size(), [&](size_t i) {
+            // parse() wants vector iterators, so the sentence is copied
+            const std::vector< SymType > sent(std::get<0>(reqs[i]), std::get<1>(reqs[i]));
+            auto pt = this->parse(sent, std::get<2>(reqs[i]));
+            if (pt.label != LabType{}) {
+                ret[i] = pt_to_pt2(pt);
+            }
+        }, jobs);
+        return ret;
+    }
+
     virtual ~Parser() {}
 };
 
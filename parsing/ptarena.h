@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+
+#include "parsing/parser.h"
+
+/* A hash-consing store for parsing trees: each distinct subtree is stored
+ * once and identified by an integer id, which remains valid as long as the
+ * arena is alive. Since equal trees always get the same id, comparing two
+ * interned trees is an integer comparison and the id can be directly used
+ * as a hash value. Common subterms, which are very frequent in the
+ * sentences of a library, are stored only once.
+ *
+ * The arena can also store whole trees in the usual prefix order, so that
+ * it can back a collection of ParsingTree2's where equal trees share their
+ * nodes (see intern_tree()).
+ *
+ * Interning is not thread safe, while all the const methods can be called
+ * concurrently.
+ */
+template< typename SymType, typename LabType >
+class ParsingTreeArena {
+public:
+    typedef uint32_t Id;
+    static constexpr Id invalid_id = std::numeric_limits< Id >::max();
+
+    ParsingTreeArena() : nodes_set(0, NodeHasher{ this }, NodeEqual{ this }) {
+    }
+
+    // The hasher and the comparator point back to the arena, so it cannot be moved
+    ParsingTreeArena(const ParsingTreeArena &x) = delete;
+    ParsingTreeArena &operator=(const ParsingTreeArena &x) = delete;
+
+    Id intern(const ParsingTree2< SymType, LabType > &pt) {
+        return this->intern(pt.get_root());
+    }
+
+    Id intern(const ParsingTreeIterator< SymType, LabType > &it) {
+        std::vector< Id > children;
+        for (const auto &child : it) {
+            children.push_back(this->intern(child));
+        }
+        const auto &node = it.get_node();
+        return this->intern_node(node.label, node.type, children);
+    }
+
+    Id intern_node(LabType label, SymType type, const std::vector< Id > &children) {
+        // The node is tentatively appended, so that the set can compare it
+        // with the ones already there; if an equal one is found, it is removed
+        Id id = static_cast< Id >(this->nodes.size());
+        this->nodes.push_back({ label, type, static_cast< uint32_t >(this->children.size()), static_cast< uint32_t >(children.size()) });
+        this->children.insert(this->children.end(), children.begin(), children.end());
+        auto res = this->nodes_set.insert(id);
+        if (!res.second) {
+            this->children.resize(this->nodes.back().children_begin);
+            this->nodes.pop_back();
+        }
+        return *res.first;
+    }
+
+    /* Intern pt and also store its nodes, once for all the trees equal to
+     * it, so that get_tree() can return it. */
+    Id intern_tree(const ParsingTree2< SymType, LabType > &pt) {
+        Id id = this->intern(pt);
+        auto res = this->trees.insert(std::make_pair(id, std::make_pair(this->trees_nodes.size(), pt.get_nodes_len())));
+        if (res.second) {
+            this->trees_nodes.insert(this->trees_nodes.end(), pt.get_nodes(), pt.get_nodes() + pt.get_nodes_len());
+        }
+        return id;
+    }
+
+    /* Return a tree that points to the nodes stored by intern_tree(); it
+     * is invalidated by the following calls to intern_tree(). */
+    ParsingTree2< SymType, LabType > get_tree(Id id) const {
+        const auto &tree = this->trees.at(id);
+        return ParsingTree2< SymType, LabType >(this->trees_nodes.data() + tree.first, tree.second);
+    }
+
+    LabType get_label(Id id) const {
+        return this->nodes[id].label;
+    }
+
+    SymType get_type(Id id) const {
+        return this->nodes[id].type;
+    }
+
+    size_t get_children_num(Id id) const {
+        return this->nodes[id].children_num;
+    }
+
+    Id get_child(Id id, size_t i) const {
+        assert(i < this->nodes[id].children_num);
+        return this->children[this->nodes[id].children_begin + i];
+    }
+
+    ParsingTree2< SymType, LabType > expand(Id id) const {
+        ParsingTree2Generator< SymType, LabType > gen;
+        this->expand_impl(id, gen);
+        return gen.get_parsing_tree();
+    }
+
+    // Number of distinct subtrees stored in the arena
+    size_t size() const {
+        return this->nodes.size();
+    }
+
+private:
+    struct Node {
+        LabType label;
+        SymType type;
+        uint32_t children_begin;
+        uint32_t children_num;
+    };
+
+    struct NodeHasher {
+        const ParsingTreeArena *arena;
+        size_t operator()(Id id) const {
+            const auto &node = this->arena->nodes[id];
+            size_t res = 0;
+            boost::hash_combine(res, node.label);
+            boost::hash_combine(res, node.type);
+            boost::hash_range(res, this->arena->children.begin() + node.children_begin, this->arena->children.begin() + node.children_begin + node.children_num);
+            return res;
+        }
+    };
+
+    struct NodeEqual {
+        const ParsingTreeArena *arena;
+        bool operator()(Id x, Id y) const {
+            const auto &nx = this->arena->nodes[x];
+            const auto &ny = this->arena->nodes[y];
+            if (nx.label != ny.label || nx.type != ny.type || nx.children_num != ny.children_num) {
+                return false;
+            }
+            return std::equal(this->arena->children.begin() + nx.children_begin, this->arena->children.begin() + nx.children_begin + nx.children_num,
+                              this->arena->children.begin() + ny.children_begin);
+        }
+    };
+
+    void expand_impl(Id id, ParsingTree2Generator< SymType, LabType > &gen) const {
+        const auto &node = this->nodes[id];
+        gen.open_node(node.label, node.type);
+        for (size_t i = 0; i < node.children_num; i++) {
+            this->expand_impl(this->children[node.children_begin + i], gen);
+        }
+        gen.close_node();
+    }
+
+    std::vector< Node > nodes;
+    std::vector< Id > children;
+    std::unordered_set< Id, NodeHasher, NodeEqual > nodes_set;
+    // Whole trees stored by intern_tree(), as offset and length in trees_nodes
+    std::unordered_map< Id, std::pair< size_t, size_t > > trees;
+    std::vector< ParsingTreeNode< SymType, LabType > > trees_nodes;
+};
@@ -190,7 +190,7 @@ std::pair< bool, bool > search_theorem(const LibraryToolbox &tb, const std::vect
     if (!res.empty()) {
         std::cout << "     Found match " << tb.resolve_label(std::get<0>(res[0])) << std::endl;
         found = true;
-        VectorMap< SymTok, Sentence > subst(std::get<2>(res[0]).begin(), std::get<2>(res[0]).end());
+        ProofSentenceTraits< Sentence >::SubstMapType subst(std::get<2>(res[0]).begin(), std::get<2>(res[0]).end());
         auto dists = propagate_dists< Sentence >(tb.get_assertion(std::get<0>(res[0])), subst, tb);
         if (!gio::is_included(dists.begin(), dists.end(), acceptable_dists.begin(), acceptable_dists.end())) {
             std::cout << "     It has (excessive) DISTINCT VARIABLES provisions!" << std::endl;
@@ -625,7 +625,7 @@ std::map< LabTok, std::tuple< LabTok, std::vector< LabTok >, std::vector< LabTok
                 if (!ass.get_ess_hyps().empty()) {
                     continue;
                 }
-                if (tb.get_sentence(ass.get_thesis())[0] != tb.get_turnstile()) {
+                if (tb.get_sentence_view(ass.get_thesis())[0] != tb.get_turnstile()) {
                     continue;
                 }
                 const auto &pt = tb.get_parsed_sent(ass.get_thesis());
@@ -891,7 +891,7 @@ void search_equalities() {
                 continue;
             }
             const auto &pt = tb.get_parsed_sent(ass->get_thesis());
-            const auto &sent = tb.get_sentence(ass->get_thesis());
+            const auto sent = tb.get_sentence_view(ass->get_thesis());
             if (sent[0] != tb.get_turnstile()) {
                 continue;
             }
@@ -130,7 +130,7 @@ bool UCTProver::is_assertion_useful(const Assertion &ass) const
     if (!ass.is_valid()) {
         return false;
     }
-    if (this->tb.get_sentence(ass.get_thesis()).at(0) != this->tb.get_turnstile()) {
+    if (this->tb.get_sentence_view(ass.get_thesis()).at(0) != this->tb.get_turnstile()) {
         return false;
     }
     if (ass.is_theorem() && ass.has_proof() && ass.get_proof_operator(this->tb)->is_trivial()) {
@@ -177,10 +177,11 @@ static std::unordered_map< LabTok, std::vector< LabTok > > filter_assertions(con
                 new_list.push_back(lab2);
             }
         }
-        sort(new_list.begin(), new_list.end(), [&tb](const auto &x, const auto &y) {
-            const auto &assx = tb.get_assertion(x);
-            const auto &assy = tb.get_assertion(y);
-            return assx.get_ess_hyps().size() < assy.get_ess_hyps().size() || (assx.get_ess_hyps().size() == assy.get_ess_hyps().size() && tb.get_sentence(x).size() > tb.get_sentence(y).size());
+        const auto &table = tb.get_assertions_table();
+        sort(new_list.begin(), new_list.end(), [&tb,&table](const auto &x, const auto &y) {
+            const auto hyps_x = table.get_ess_hyps(table.get_row(x)).size();
+            const auto hyps_y = table.get_ess_hyps(table.get_row(y)).size();
+            return hyps_x < hyps_y || (hyps_x == hyps_y && tb.get_library().get_sentence_view(x).size() > tb.get_library().get_sentence_view(y).size());
         });
     }
     return ret;
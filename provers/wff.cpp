@@ -342,7 +342,7 @@ void TVar<PropTag>::get_variables(ptvar_set<Tag> &vars) const
 
 Prover<CheckpointedProofEngine> TVar<PropTag>::get_type_prover(const LibraryToolbox &tb) const
 {
-    return tb.build_type_prover(this->get_name());
+    return tb.build_type_prover< CheckpointedProofEngine >(this->get_name());
     /*auto label = tb.get_var_sym_to_lab(tb.get_symbol(this->name));
     return [label](AbstractCheckpointedProofEngine &engine) {
         engine.process_label(label);
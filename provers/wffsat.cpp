@@ -138,6 +138,8 @@ std::pair<bool, Prover<CheckpointedProofEngine> > get_sat_prover(pwff wff, const
     } else {
         res.second();
         assert(cnf_cb.prover_stack.size() == 1);
+        // The provers built along the resolution are programs, so this is
+        // a single flat program too
         auto final_prover = tb.build_registered_prover(falsify_rp, {{"ph", wff->get_type_prover(tb)}}, {cnf_cb.prover_stack[0]});
         return make_pair(true, final_prover);
     }
@@ -70,11 +70,11 @@ z3::expr extract_thesis(z3::expr proof) {
 
 void prove_and_print(pwff wff, const LibraryToolbox &tb) {
     CreativeProofEngineImpl< Sentence > engine(tb);
+    engine.set_share_steps(true);
     wff->get_adv_truth_prover(tb).second(engine);
-    if (engine.get_proof_labels().size() > 0) {
-        //cout << "adv truth proof: " << tb.print_proof(engine.get_proof_labels()) << endl;
+    if (!engine.get_stack().empty()) {
         std::cout << "stack top: " << tb.print_sentence(engine.get_stack().back(), SentencePrinter::STYLE_ANSI_COLORS_SET_MM) << std::endl;
-        std::cout << "proof length: " << engine.get_proof_labels().size() << std::endl;
+        std::cout << "shared proof length: " << engine.get_shared_proof_size() << std::endl;
     }
 }
 
@@ -66,8 +66,8 @@ int count_root_type_main(int argc, char *argv[]) {
     RootStats imp1(tb);
     RootStats imp2(tb);
     LabTok imp_label = tb.get_label("wi");
-    for (const auto &ass : tb.get_library().get_assertions()) {
-        if (ass.is_valid() && tb.get_sentence(ass.get_thesis()).at(0) == tb.get_turnstile()) {
+    for (const Assertion &ass : tb.gen_assertions()) {
+        if (tb.get_sentence(ass.get_thesis()).at(0) == tb.get_turnstile()) {
             const auto &pt = tb.get_parsed_sent(ass.get_thesis());
             root.process(pt);
             if (pt.label == imp_label) {
@@ -127,11 +127,12 @@ int temp_main(int argc, char *argv[]) {
     std::cout << prover.first << std::endl;
 
     CreativeProofEngineImpl< Sentence > engine(tb);
+    // Tautology proofs repeat many subproofs, which are built only once
+    engine.set_share_steps(true);
     prover.second(engine);
-    if (engine.get_proof_labels().size() > 0) {
-        //std::cout << "adv truth proof: " << tb.print_proof(engine.get_proof_labels()) << std::endl;
+    if (!engine.get_stack().empty()) {
         std::cout << "stack top: " << tb.print_sentence(engine.get_stack().back(), SentencePrinter::STYLE_ANSI_COLORS_SET_MM) << std::endl;
-        std::cout << "proof length: " << engine.get_proof_labels().size() << std::endl;
+        std::cout << "shared proof length: " << engine.get_shared_proof_size() << std::endl;
         //UncompressedProof proof = { engine.get_proof_labels() };
     }
 
@@ -22,7 +22,13 @@
 
 #include <iostream>
 
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
 #include "mm/funds.h"
+#include "mm/library.h"
+#include "mm/reader.h"
+#include "mm/tokenizer.h"
 
 // Some useful printers
 namespace std {
@@ -43,3 +49,23 @@ inline std::ostream &operator<<(std::ostream &str, LabTok tok) {
 inline std::ostream &operator<<(std::ostream &str, CodeTok tok) {
     return str << tok.val();
 }
+
+/* Read a library from the given Metamath source, without executing its
+ * proofs; tokenizers read from files, so the source goes through a
+ * temporary one. */
+inline LibraryImpl read_test_library(const std::string &source) {
+    auto filename = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::ofstream(filename) << source;
+    LibraryImpl lib;
+    try {
+        MappedFileTokenizer ft(filename);
+        Reader p(ft, false, true);
+        p.run();
+        lib = p.get_library();
+    } catch (...) {
+        boost::filesystem::remove(filename);
+        throw;
+    }
+    boost::filesystem::remove(filename);
+    return lib;
+}
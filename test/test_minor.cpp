@@ -2,10 +2,18 @@
 #include <string>
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <random>
 
 #include <giolib/containers.h>
 
 #include "mm/proof.h"
+#include "mm/tokenizer.h"
+#include "mm/scanner.h"
+#include "mm/snapshot.h"
+#include "mm/toolbox.h"
+#include "mm/asstable.h"
+#include "utils/parallel.h"
 #include "test.h"
 
 #ifdef ENABLE_TEST_CODE
@@ -71,4 +79,531 @@ BOOST_AUTO_TEST_CASE(test_has_no_diagonal) {
     BOOST_TEST(gio::has_no_diagonal(x3.begin(), x3.end()));
 }
 
+BOOST_AUTO_TEST_CASE(test_parallel_for) {
+    const size_t num = 1000;
+    for (size_t jobs : { 1, 2, 7 }) {
+        std::vector< size_t > hits(num);
+        parallel_for(num, [&](size_t i) { hits[i]++; }, jobs);
+        BOOST_TEST(std::all_of(hits.begin(), hits.end(), [](size_t x) { return x == 1; }));
+
+        // The exception of the smallest failing index must be reported
+        std::vector< size_t > done(num);
+        try {
+            parallel_for(num, [&](size_t i) {
+                done[i] = 1;
+                if (i % 100 == 37) {
+                    throw i;
+                }
+            }, jobs);
+            BOOST_TEST(false);
+        } catch (size_t i) {
+            BOOST_TEST(i == 37u);
+        }
+        BOOST_TEST(std::all_of(done.begin(), done.begin() + 37, [](size_t x) { return x == 1; }));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_mapped_file_tokenizer) {
+    auto dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directory(dir);
+    {
+        boost::filesystem::ofstream main(dir / "main.mm");
+        main << "$( A comment $$ with $) dollars $$) $c wff |- $.\n$[ inc.mm $]\n$($)\tph $f wff ph $.\n";
+        boost::filesystem::ofstream inc(dir / "inc.mm");
+        inc << "$v ph $. $( Included $)";
+    }
+    FileTokenizer ft(dir / "main.mm");
+    MappedFileTokenizer mft(dir / "main.mm");
+    std::vector< std::pair< bool, std::string > > expected, actual;
+    for (auto tok = ft.next(); !tok.second.empty(); tok = ft.next()) {
+        expected.push_back(tok);
+    }
+    for (auto tok = mft.next_view(); !tok.second.empty(); tok = mft.next_view()) {
+        actual.push_back(std::make_pair(tok.first, std::string(tok.second)));
+    }
+    BOOST_TEST(expected.size() == 16u);
+    BOOST_TEST((actual == expected));
+    BOOST_TEST(!ft.has_persistent_views());
+    BOOST_TEST(mft.has_persistent_views());
+    // The reader has to keep its own copy of the tokens of FileTokenizer
+    boost::filesystem::ofstream(dir / "valid.mm") << "$c wff $. $v ph $. ph $f wff ph $.\n";
+    FileTokenizer ft2(dir / "valid.mm");
+    Reader reader(ft2, false);
+    reader.run();
+    const auto &lib = reader.get_library();
+    BOOST_TEST((lib.get_sentence_view(lib.get_label("ph")).to_sentence() == Sentence{lib.get_symbol("wff"), lib.get_symbol("ph")}));
+    boost::filesystem::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_CASE(test_reader_error_order) {
+    // A wrong proof is reported before a later reading error, even when proofs are deferred
+    auto filename = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::ofstream(filename) << "$c wff |- $. $v ph $. wph $f wff ph $.\n"
+                                             "bad $p |- ph $= wph $.\n"
+                                             "$c wff $.\n";
+    for (size_t jobs : { 1, 2 }) {
+        MappedFileTokenizer ft(filename);
+        Reader p(ft, true, false, jobs);
+        BOOST_CHECK_THROW(p.run(), ProofException< Sentence >);
+    }
+    boost::filesystem::remove(filename);
+}
+
+BOOST_AUTO_TEST_CASE(test_mm_scanners) {
+    std::string data;
+    std::mt19937 gen;
+    std::uniform_int_distribution< int > len_dist(0, 70);
+    const std::string seps = " \t\r\n\f$\x7f\x01\xc3";
+    for (int i = 0; i < 300; i++) {
+        data += std::string(static_cast< size_t >(len_dist(gen)), 'a' + static_cast< char >(i % 26));
+        data += seps[static_cast< size_t >(i) % seps.size()];
+        data += std::string(static_cast< size_t >(len_dist(gen)) % 40, ' ');
+    }
+    auto orig = get_mm_scanner();
+    for (auto scanner : { MMScanner::SCALAR, MMScanner::SSE2, MMScanner::AVX2 }) {
+        if (!set_mm_scanner(scanner)) {
+            continue;
+        }
+        for (size_t pos = 0; pos <= data.size(); pos++) {
+            size_t valid_end = pos;
+            while (valid_end < data.size() && is_mm_valid(data[valid_end])) {
+                valid_end++;
+            }
+            size_t white_end = pos;
+            while (white_end < data.size() && is_mm_whitespace(data[white_end])) {
+                white_end++;
+            }
+            BOOST_TEST(scan_mm_valid(data.data(), pos, data.size()) == valid_end);
+            BOOST_TEST(scan_mm_whitespace(data.data(), pos, data.size()) == white_end);
+        }
+    }
+    set_mm_scanner(orig);
+}
+
+BOOST_AUTO_TEST_CASE(test_library_snapshot) {
+    auto dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    boost::filesystem::create_directory(dir);
+    {
+        boost::filesystem::ofstream main(dir / "main.mm");
+        main << "$( $t htmldef \"ph\" as \"<i>ph</i>\"; $)\n$( $j syntax 'wff'; syntax '|-' as 'wff'; $)\n"
+                "$c ( ) -> wff |- $. $v ph ps $. wph $f wff ph $. wps $f wff ps $. wi $a wff ( ph -> ps ) $.\n"
+                "${ min $e |- ph $. maj $e |- ( ph -> ps ) $. ax-mp $a |- ps $. $}\n"
+                "${ $d ph ps $. ax-1 $a |- ( ph -> ( ps -> ph ) ) $. $}\n"
+                "$( Some theorem $)\n${ a1i.1 $e |- ph $. a1i $p |- ( ps -> ph ) $= wph wps wph wi a1i.1 wph wps ax-1 ax-mp $. $}\n";
+    }
+    LibraryImpl lib1 = read_library_with_snapshot(dir / "main.mm", dir / "main.mm.snapshot");
+    BOOST_TEST(boost::filesystem::exists(dir / "main.mm.snapshot"));
+    LibraryImpl lib2 = read_library_with_snapshot(dir / "main.mm", dir / "main.mm.snapshot");
+    BOOST_TEST(lib1.get_symbols() == lib2.get_symbols());
+    BOOST_TEST(lib1.get_labels() == lib2.get_labels());
+    BOOST_TEST(lib1.get_max_number() == lib2.get_max_number());
+    BOOST_TEST(lib1.get_assertions().size() == lib2.get_assertions().size());
+    BOOST_TEST(lib1.get_addendum().get_htmldefs() == lib2.get_addendum().get_htmldefs());
+    BOOST_TEST((lib1.get_parsing_addendum().get_syntax() == lib2.get_parsing_addendum().get_syntax()));
+    BOOST_TEST(lib1.get_final_stack_frame().types == lib2.get_final_stack_frame().types);
+    BOOST_TEST(lib1.get_labels_num() == lib2.get_labels_num());
+    for (LabTok::val_type i = 0; i <= lib1.get_labels_num(); i++) {
+        const auto &ass1 = lib1.get_assertion(LabTok(i));
+        const auto &ass2 = lib2.get_assertion(LabTok(i));
+        BOOST_TEST((lib1.get_sentence_view(LabTok(i)) == lib2.get_sentence_view(LabTok(i))));
+        BOOST_TEST(ass1.is_valid() == ass2.is_valid());
+        BOOST_TEST(ass1.get_float_hyps() == ass2.get_float_hyps());
+        BOOST_TEST(ass1.get_ess_hyps() == ass2.get_ess_hyps());
+        BOOST_TEST((ass1.get_mand_dists() == ass2.get_mand_dists()));
+        BOOST_TEST(ass1.get_comment() == ass2.get_comment());
+        BOOST_TEST((ass1.get_proof() == nullptr) == (ass2.get_proof() == nullptr));
+    }
+    BOOST_TEST(lib2.get_assertion(lib2.get_label("ax-1")).get_mand_dists().size() == 1u);
+    auto proof1 = std::dynamic_pointer_cast< const UncompressedProof >(lib1.get_assertion(lib1.get_label("a1i")).get_proof());
+    auto proof2 = std::dynamic_pointer_cast< const UncompressedProof >(lib2.get_assertion(lib2.get_label("a1i")).get_proof());
+    BOOST_TEST((proof1 != nullptr && proof2 != nullptr && proof1->get_labels() == proof2->get_labels()));
+
+    // A modified database must not be loaded from a stale snapshot
+    {
+        boost::filesystem::ofstream main(dir / "main.mm", std::ios_base::app);
+        main << "ax-2 $a |- ( ph -> ph ) $.\n";
+    }
+    LibraryImpl lib3 = read_library_with_snapshot(dir / "main.mm", dir / "main.mm.snapshot");
+    BOOST_TEST(lib3.get_label("ax-2") != LabTok{});
+    boost::filesystem::remove_all(dir);
+
+    // lib2 still reads from the old snapshot, and is copied out of it when modified
+    const LabTok a1i = lib1.get_label("a1i");
+    BOOST_TEST(lib2.get_sentence_view(a1i) == lib1.get_sentence_view(a1i));
+    LabTok label = lib2.create_label("ax-3");
+    lib2.add_sentence(label, lib1.get_sentence(a1i), SentenceType::AXIOM);
+    BOOST_TEST(lib2.get_sentence_view(label) == lib1.get_sentence_view(a1i));
+    BOOST_TEST(lib2.get_sentence_view(a1i) == lib1.get_sentence_view(a1i));
+    BOOST_TEST(lib2.get_assertion(a1i).get_ess_hyps() == lib1.get_assertion(a1i).get_ess_hyps());
+
+    // A sentence given again with the same length is overwritten in place
+    Sentence sent = lib2.get_sentence(label);
+    std::swap(sent.front(), sent.back());
+    lib2.add_sentence(label, sent, SentenceType::AXIOM);
+    BOOST_TEST(lib2.get_sentence(label) == sent);
+    BOOST_TEST(lib2.get_sentence_view(a1i) == lib1.get_sentence_view(a1i));
+    // Longer and shorter ones do not touch the following label
+    LabTok next_label = lib2.create_label("ax-4");
+    lib2.add_sentence(next_label, lib1.get_sentence(a1i), SentenceType::AXIOM);
+    Sentence longer = sent;
+    longer.push_back(sent.back());
+    lib2.add_sentence(label, longer, SentenceType::AXIOM);
+    BOOST_TEST(lib2.get_sentence(label) == longer);
+    BOOST_TEST(lib2.get_sentence_view(next_label) == lib1.get_sentence_view(a1i));
+    Sentence shorter(sent.begin(), sent.begin() + 2);
+    lib2.add_sentence(label, shorter, SentenceType::AXIOM);
+    BOOST_TEST(lib2.get_sentence(label) == shorter);
+    BOOST_TEST(lib2.get_sentence_view(next_label) == lib1.get_sentence_view(a1i));
+}
+
+// The implication syntax, with syntax parsing enabled
+const std::string wff_syntax_source = "$( $j syntax 'wff'; syntax '|-' as 'wff'; $)\n"
+                                      "$c ( ) -> wff |- $. $v ph ps $. wph $f wff ph $. wps $f wff ps $. wi $a wff ( ph -> ps ) $.\n";
+
+// A theorem whose proof repeats the subproof of ( ph -> ps )
+const std::string repeated_subproof_source = "$c ( ) -> wff |- $. $v ph ps $. wph $f wff ph $. wps $f wff ps $. wi $a wff ( ph -> ps ) $.\n"
+                                             "ax-1 $a |- ( ph -> ( ps -> ph ) ) $.\n"
+                                             "th $p |- ( ( ph -> ps ) -> ( ( ph -> ps ) -> ( ph -> ps ) ) ) $= wph wps wi wph wps wi ax-1 $.\n";
+
+BOOST_AUTO_TEST_CASE(test_proof_dists_check) {
+    const std::string base = "$c ( ) -> wff |- $. $v ph ps $. wph $f wff ph $. wps $f wff ps $. wi $a wff ( ph -> ps ) $.\n"
+                             "${ min $e |- ph $. maj $e |- ( ph -> ps ) $. ax-mp $a |- ps $. $}\n"
+                             "${ $d ph ps $. ax-1 $a |- ( ph -> ( ps -> ph ) ) $. $}\n";
+    auto execute = [&base](const std::string &thm, const std::string &label) {
+        LibraryImpl lib = read_test_library(base + thm);
+        lib.get_assertion(lib.get_label(label)).get_proof_executor< Sentence >(lib)->execute();
+    };
+    BOOST_CHECK_NO_THROW(execute("${ $d ph ps $. a1i.1 $e |- ph $. a1i $p |- ( ps -> ph ) $= wph wps wph wi a1i.1 wph wps ax-1 ax-mp $. $}\n", "a1i"));
+    // The constraint required by ax-1 is missing
+    BOOST_CHECK_THROW(execute("${ a1i.1 $e |- ph $. a1i $p |- ( ps -> ph ) $= wph wps wph wi a1i.1 wph wps ax-1 ax-mp $. $}\n", "a1i"), ProofException< Sentence >);
+    // Both variables of ax-1 are substituted with ph
+    BOOST_CHECK_THROW(execute("${ $d ph ps $. id1 $p |- ( ph -> ( ph -> ph ) ) $= wph wph ax-1 $. $}\n", "id1"), ProofException< Sentence >);
+}
+
+BOOST_AUTO_TEST_CASE(test_compressed_proof_verifier) {
+    LibraryImpl lib = read_test_library(repeated_subproof_source);
+    const Assertion &th = lib.get_assertion(lib.get_label("th"));
+    const Assertion &ax1 = lib.get_assertion(lib.get_label("ax-1"));
+    CompressedProof compressed = th.get_proof_operator(lib)->compress();
+    // The repeated subproof of ( ph -> ps ) is saved and reused
+    BOOST_TEST((std::find(compressed.get_codes().begin(), compressed.get_codes().end(), CodeTok{}) != compressed.get_codes().end()));
+    BOOST_CHECK_NO_THROW(compressed.verify(lib, th));
+    BOOST_CHECK_THROW(compressed.verify(lib, ax1), ProofException< Sentence >);
+    std::vector< CodeTok > codes = compressed.get_codes();
+    codes.push_back(CodeTok(static_cast< CodeTok::val_type >(codes.size() + 10)));
+    BOOST_CHECK_THROW(CompressedProof(compressed.get_refs(), codes).verify(lib, th), ProofException< Sentence >);
+}
+
+BOOST_AUTO_TEST_CASE(test_proof_recompression) {
+    LibraryImpl lib = read_test_library(repeated_subproof_source);
+    const Assertion &th = lib.get_assertion(lib.get_label("th"));
+    auto is_saving = [](const CompressedProof &proof) {
+        return std::find(proof.get_codes().begin(), proof.get_codes().end(), CodeTok{}) != proof.get_codes().end();
+    };
+    for (const auto strategy : { ProofOperator::CS_NO_BACKREFS, ProofOperator::CS_BACKREFS_ON_IDENTICAL_TREE, ProofOperator::CS_BACKREFS_ON_IDENTICAL_SENTENCE }) {
+        // Encoding directly from the codes or from the uncompressed proof gives the same result
+        CompressedProof direct = th.get_proof_operator(lib)->compress().get_operator(lib, th)->compress(strategy);
+        CompressedProof from_labels = th.get_proof_operator(lib)->compress(strategy);
+        BOOST_TEST(direct.get_refs() == from_labels.get_refs());
+        BOOST_TEST(direct.get_codes() == from_labels.get_codes());
+        BOOST_CHECK_NO_THROW(direct.verify(lib, th));
+        BOOST_TEST(is_saving(direct) == (strategy != ProofOperator::CS_NO_BACKREFS));
+        auto proofs = recompress_proofs(lib, strategy, 2);
+        BOOST_REQUIRE(proofs.at(lib.get_label("th").val()) != nullptr);
+        BOOST_TEST(proofs[lib.get_label("th").val()]->get_codes() == direct.get_codes());
+        BOOST_TEST(proofs[lib.get_label("ax-1").val()] == nullptr);
+    }
+    // Both encodings above go through the proof graph, so check it against
+    // the expected codes: ( ph -> ps ) is saved and then referred to
+    CompressedProof tree = th.get_proof_operator(lib)->compress(ProofOperator::CS_BACKREFS_ON_IDENTICAL_TREE);
+    BOOST_TEST((tree.get_refs() == std::vector< LabTok >{lib.get_label("wi"), lib.get_label("ax-1")}));
+    BOOST_TEST((tree.get_codes() == std::vector< CodeTok >{CodeTok(1), CodeTok(2), CodeTok(3), CodeTok{}, CodeTok(5), CodeTok(4)}));
+}
+
+// Records the labels ('l') and the saved steps ('s') it is asked to push
+struct SavingEngine final : public CheckpointedProofEngine, public StepSavingProofEngine {
+    void process_label(const LabTok label) override { this->ops.push_back(std::make_pair('l', label.val())); }
+    void checkpoint() override {}
+    void commit() override {}
+    void rollback() override {}
+    bool shares_steps() const override { return true; }
+    size_t save_step() override { return this->saved_num++; }
+    void process_saved_step(size_t step_num) override { this->ops.push_back(std::make_pair('s', step_num)); }
+    std::vector< std::pair< char, size_t > > ops;
+    size_t saved_num = 0;
+};
+
+BOOST_AUTO_TEST_CASE(test_proof_program) {
+    LibraryImpl lib = read_test_library(wff_syntax_source);
+    LibraryToolbox tb(lib, "|-");
+    LabTok wph = lib.get_label("wph");
+    LabTok wps = lib.get_label("wps");
+    LabTok wi = lib.get_label("wi");
+
+    // ( ( ph -> ps ) -> ( ph -> ps ) ), with ps provided by a hypothesis slot
+    ProofProgram prog;
+    size_t begin = prog.get_pos();
+    prog.emit_label(wph);
+    prog.emit_hyp(0);
+    prog.emit_label(wi);
+    size_t saved = prog.save_step(begin);
+    prog.emit_saved_step(saved);
+    prog.emit_label(wi);
+    BOOST_TEST(prog.get_hyps_num() == 1u);
+    BOOST_CHECK_THROW(prog.get_labels(), std::invalid_argument);
+
+    CreativeProofEngineImpl< Sentence > engine(tb);
+    BOOST_TEST(prog.replay< CheckpointedProofEngine >(engine, {trivial_prover(wps)}));
+    BOOST_TEST(engine.get_stack().size() == 1u);
+    BOOST_TEST((engine.get_stack().back() == tb.read_sentence("wff ( ( ph -> ps ) -> ( ph -> ps ) )")));
+    BOOST_TEST((engine.get_proof_labels() == std::vector< LabTok >{wph, wps, wi, wph, wps, wi, wi}));
+
+    // A failing hypothesis or a rejected step leave the engine untouched
+    BOOST_TEST(!prog.replay< CheckpointedProofEngine >(engine, {null_prover}));
+    ProofProgram bad;
+    bad.emit_label(wi);
+    BOOST_TEST(!bad.replay< CheckpointedProofEngine >(engine));
+    BOOST_TEST(engine.get_stack().size() == 1u);
+    // The error that made the replay fail is reported
+    size_t exceptions_num = 0;
+    BOOST_TEST(!bad.replay< CheckpointedProofEngine >(engine, {}, [&exceptions_num](const ProofException< Sentence >&) { exceptions_num++; }));
+    BOOST_TEST(exceptions_num == 1u);
+
+    // Slots can be replaced by programs
+    auto wps_prog = std::make_shared< ProofProgram >();
+    wps_prog->emit_label(wps);
+    ProofProgram composed;
+    composed.emit_program(prog, {wps_prog});
+    BOOST_TEST(composed.get_hyps_num() == 0u);
+    BOOST_TEST((composed.get_labels() == std::vector< LabTok >{wph, wps, wi, wph, wps, wi, wi}));
+
+    // Engines that share steps push saved steps again instead of rebuilding them
+    SavingEngine saving_engine;
+    BOOST_TEST(composed.replay< CheckpointedProofEngine >(saving_engine));
+    BOOST_TEST(saving_engine.saved_num == 1u);
+    BOOST_TEST((saving_engine.ops == std::vector< std::pair< char, size_t > >{{'l', wph.val()}, {'l', wps.val()}, {'l', wi.val()}, {'s', 0}, {'l', wi.val()}}));
+    CreativeProofEngineImpl< Sentence > sharing_engine(tb);
+    sharing_engine.set_share_steps(true);
+    BOOST_TEST(composed.replay< CheckpointedProofEngine >(sharing_engine));
+    BOOST_TEST((sharing_engine.get_stack().back() == tb.read_sentence("wff ( ( ph -> ps ) -> ( ph -> ps ) )")));
+
+    // Programs filling slots are referred to, not copied
+    ProofProgram twice;
+    twice.emit_hyp(0);
+    twice.emit_hyp(0);
+    twice.emit_label(wi);
+    ProofProgram nested;
+    nested.emit_program(twice, {std::make_shared< const ProofProgram >(composed)});
+    BOOST_TEST(nested.get_code().size() == 3u);
+    auto composed_labels = composed.get_labels();
+    auto nested_labels = composed_labels;
+    nested_labels.insert(nested_labels.end(), composed_labels.begin(), composed_labels.end());
+    nested_labels.push_back(wi);
+    BOOST_TEST((nested.get_labels() == nested_labels));
+    SavingEngine nested_saving_engine;
+    BOOST_TEST(nested.replay< CheckpointedProofEngine >(nested_saving_engine));
+    BOOST_TEST((nested_saving_engine.ops == std::vector< std::pair< char, size_t > >{{'l', wph.val()}, {'l', wps.val()}, {'l', wi.val()}, {'s', 0}, {'l', wi.val()}, {'s', 1}, {'l', wi.val()}}));
+
+    // Type provers are programs
+    auto type_prover = tb.build_type_prover< CheckpointedProofEngine >(tb.read_sentence("wff ( ph -> ( ps -> ph ) )"));
+    auto type_prog = get_program(type_prover);
+    BOOST_TEST_REQUIRE(type_prog != nullptr);
+    BOOST_TEST((type_prog->get_labels() == std::vector< LabTok >{wph, wps, wph, wi, wi}));
+}
+
+BOOST_AUTO_TEST_CASE(test_type_proving) {
+    LibraryImpl lib = read_test_library(wff_syntax_source);
+    LibraryToolbox tb(lib, "|-");
+    LabTok wph = lib.get_label("wph");
+    LabTok wps = lib.get_label("wps");
+    LabTok wi = lib.get_label("wi");
+    auto sent = tb.read_sentence("wff ( ( ph -> ps ) -> ( ph -> ps ) )");
+    // Proving the same sentence again goes through the cached type proof
+    for (size_t i = 0; i < 2; i++) {
+        auto prover = tb.build_type_prover< CheckpointedProofEngine >(sent);
+        auto prog = get_program(prover);
+        BOOST_TEST_REQUIRE(prog != nullptr);
+        BOOST_TEST((prog->get_labels() == std::vector< LabTok >{wph, wps, wi, wph, wps, wi, wi}));
+        // The repeated subterm is emitted once and then pushed again as a saved step
+        BOOST_TEST(prog->get_code().size() == 5u);
+        BOOST_TEST(prog->get_saved_steps_num() == 1u);
+    }
+    // The repeated subterm is pushed again by engines that share steps
+    SavingEngine saving_engine;
+    BOOST_TEST(tb.build_type_prover< CheckpointedProofEngine >(sent)(saving_engine));
+    BOOST_TEST((saving_engine.ops == std::vector< std::pair< char, size_t > >{{'l', wph.val()}, {'l', wps.val()}, {'l', wi.val()}, {'s', 0}, {'l', wi.val()}}));
+    // Variables are still replaced by their provers
+    auto prover = tb.build_type_prover< CheckpointedProofEngine >(sent, {{lib.get_symbol("ps"), tb.build_type_prover< CheckpointedProofEngine >(tb.read_sentence("wff ph"))}});
+    auto prog = get_program(prover);
+    BOOST_TEST_REQUIRE(prog != nullptr);
+    BOOST_TEST((prog->get_labels() == std::vector< LabTok >{wph, wph, wi, wph, wph, wi, wi}));
+    // Provers that are not programs give a prover that is not a program either
+    auto closure_prover = tb.build_type_prover< CheckpointedProofEngine >(sent, {{lib.get_symbol("ps"), trivial_prover(wph)}});
+    BOOST_TEST(get_program(closure_prover) == nullptr);
+    CreativeProofEngineImpl< Sentence > engine(tb);
+    BOOST_TEST(!tb.build_type_prover< CheckpointedProofEngine >(tb.read_sentence("wff ( ph ->"))(engine));
+}
+
+BOOST_AUTO_TEST_CASE(test_engine_shared_steps) {
+    LibraryImpl lib = read_test_library(wff_syntax_source);
+    LibraryToolbox tb(lib, "|-");
+    LabTok wph = lib.get_label("wph");
+    LabTok wps = lib.get_label("wps");
+    LabTok wi = lib.get_label("wi");
+    Assertion ass({wph, wps}, {});
+
+    CreativeProofEngineImpl< Sentence > engine(tb);
+    engine.set_share_steps(true);
+    // A step built after a checkpoint is forgotten when rolling back
+    engine.checkpoint();
+    for (auto label : {wph, wps, wi}) {
+        engine.process_label(label);
+    }
+    engine.rollback();
+    BOOST_TEST(engine.get_stack().empty());
+    BOOST_TEST(tb.type_proving_helper(tb.read_sentence("wff ( ( ph -> ps ) -> ( ph -> ps ) )"), engine));
+    BOOST_TEST(engine.get_stack().size() == 1u);
+    BOOST_TEST((engine.get_stack().back() == tb.read_sentence("wff ( ( ph -> ps ) -> ( ph -> ps ) )")));
+    BOOST_CHECK_THROW(engine.get_proof_labels(), std::logic_error);
+    // ( ph -> ps ) is saved the first time and referenced the second one
+    auto comp = engine.get_compressed_proof(ass);
+    BOOST_TEST((comp.first == std::vector< LabTok >{wi}));
+    BOOST_TEST((comp.second == std::vector< CodeTok >{CodeTok(1), CodeTok(2), CodeTok(3), CodeTok{}, CodeTok(4), CodeTok(3)}));
+    BOOST_TEST(engine.get_shared_proof_size() == 5u);
+
+    // The proof of a newly built step begins with the one of its first
+    // hypothesis, and the same holds when a built step is reused
+    CreativeProofEngineImpl< Sentence > engine2(tb);
+    engine2.set_share_steps(true);
+    for (auto label : {wph, wps, wi}) {
+        engine2.process_label(label);
+    }
+    BOOST_TEST((engine2.get_stack_proof_begin() == std::vector< size_t >{0}));
+    engine2.process_label(wph);
+    BOOST_TEST((engine2.get_stack_proof_begin() == std::vector< size_t >{0, 3}));
+    engine2.process_label(wi);
+    BOOST_TEST((engine2.get_stack_proof_begin() == std::vector< size_t >{0}));
+    BOOST_TEST(engine2.get_shared_proof_size() == 5u);
+    for (auto label : {wph, wps, wi}) {
+        engine2.process_label(label);
+    }
+    BOOST_TEST((engine2.get_stack_proof_begin() == std::vector< size_t >{0, 5}));
+    BOOST_TEST(engine2.get_shared_proof_size() == 6u);
+}
+
+BOOST_AUTO_TEST_CASE(test_compress_shared_proof) {
+    LibraryImpl lib = read_test_library(wff_syntax_source);
+    LibraryToolbox tb(lib, "|-");
+    LabTok wph = lib.get_label("wph");
+    LabTok wps = lib.get_label("wps");
+    Assertion ass({wph, wps}, {});
+    auto sent = tb.read_sentence("wff ( ( ph -> ( ps -> ph ) ) -> ( ph -> ( ps -> ph ) ) )");
+
+    // What the web prover printed before steps were shared: the full proof,
+    // executed again and compressed on identical sentences
+    CreativeProofEngineImpl< Sentence > engine(tb);
+    BOOST_TEST(tb.type_proving_helper(sent, engine));
+    UncompressedProof uncomp_proof(engine.get_proof_labels());
+    auto old_proof = uncomp_proof.get_operator(tb, ass)->compress(ProofOperator::CS_BACKREFS_ON_IDENTICAL_SENTENCE);
+
+    CreativeProofEngineImpl< Sentence > sharing_engine(tb);
+    sharing_engine.set_share_steps(true);
+    BOOST_TEST(tb.type_proving_helper(sent, sharing_engine));
+    auto proof = compress_shared_proof(tb, ass, sharing_engine);
+    BOOST_TEST((proof.get_refs() == old_proof.get_refs()));
+    BOOST_TEST((proof.get_codes() == old_proof.get_codes()));
+    BOOST_TEST(proof.get_codes().size() <= sharing_engine.get_compressed_proof(ass).second.size());
+}
+
+BOOST_AUTO_TEST_CASE(test_assertions_table) {
+    LibraryImpl lib = read_test_library("$c ( ) -> wff |- $. $v ph ps ch $. wph $f wff ph $. wps $f wff ps $. wch $f wff ch $. wi $a wff ( ph -> ps ) $.\n"
+                                        "${ min $e |- ph $. maj $e |- ( ph -> ps ) $. ax-mp $a |- ps $. $}\n"
+                                        "${ $d ps ph $. $d ch ph $. ax-1 $a |- ( ph -> ( ps -> ph ) ) $. $}\n"
+                                        "$( Some theorem $)\n${ a1i.1 $e |- ph $. a1i $p |- ( ps -> ph ) $= wph wps wph wi a1i.1 wph wps ax-1 ax-mp $. $}\n");
+    AssertionTable table(lib);
+    size_t valid_num = 0;
+    for (const Assertion &ass : lib.gen_assertions()) {
+        valid_num++;
+        const auto row = table.get_row(ass.get_thesis());
+        BOOST_REQUIRE(row != AssertionTable::npos);
+        BOOST_TEST(table.get_thesis(row) == ass.get_thesis());
+        BOOST_TEST(table.get_number(row) == ass.get_number());
+        BOOST_TEST(table.is_theorem(row) == ass.is_theorem());
+        BOOST_TEST(table.has_proof(row) == ass.has_proof());
+        BOOST_TEST(table.is_usage_disc(row) == ass.is_usage_disc());
+        BOOST_TEST(std::equal(table.get_float_hyps(row).begin(), table.get_float_hyps(row).end(), ass.get_float_hyps().begin(), ass.get_float_hyps().end()));
+        BOOST_TEST(std::equal(table.get_ess_hyps(row).begin(), table.get_ess_hyps(row).end(), ass.get_ess_hyps().begin(), ass.get_ess_hyps().end()));
+        BOOST_TEST(std::equal(table.get_opt_hyps(row).begin(), table.get_opt_hyps(row).end(), ass.get_opt_hyps().begin(), ass.get_opt_hyps().end()));
+        BOOST_TEST(std::equal(table.get_mand_dists(row).begin(), table.get_mand_dists(row).end(), ass.get_mand_dists().begin(), ass.get_mand_dists().end()));
+        BOOST_TEST(std::equal(table.get_opt_dists(row).begin(), table.get_opt_dists(row).end(), ass.get_opt_dists().begin(), ass.get_opt_dists().end()));
+        BOOST_TEST(table.get_mand_hyps(row).size() == ass.get_mand_hyps_num());
+        BOOST_TEST(&table.get_comment(row) == &ass.get_comment());
+    }
+    BOOST_TEST(table.size() == valid_num);
+    BOOST_TEST(table.get_row(lib.get_label("wph")) == AssertionTable::npos);
+    const auto row = table.get_row(lib.get_label("ax-1"));
+    BOOST_TEST(table.get_mand_dists(row).size() == 1u);
+    BOOST_TEST(table.has_mand_dist(row, lib.get_symbol("ps"), lib.get_symbol("ph")));
+    BOOST_TEST(table.has_mand_dist(row, lib.get_symbol("ph"), lib.get_symbol("ps")));
+    BOOST_TEST(!table.has_mand_dist(row, lib.get_symbol("ph"), lib.get_symbol("ch")));
+    BOOST_TEST(table.get_ess_hyps(table.get_row(lib.get_label("ax-mp"))).size() == 2u);
+}
+
+BOOST_AUTO_TEST_CASE(test_snapshot_toolbox_cache) {
+    auto filename = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    std::vector< ParsingTree2< SymTok, LabTok > > trees(3);
+    trees[1] = var_parsing_tree(LabTok(1), SymTok(2));
+    trees[2] = ParsingTree2< SymTok, LabTok >{ { { LabTok(3), SymTok(2), 2 }, { LabTok(1), SymTok(2), 0 }, { LabTok(1), SymTok(2), 0 } }, nullptr, 0 };
+    std::vector< std::set< LabTok > > vars = { {}, { LabTok(1) }, { LabTok(1), LabTok(2) } };
+    std::unordered_map< LabTok, std::vector< LabTok > > theses = { { LabTok(3), { LabTok(4), LabTok(5) } } };
+    {
+        SnapshotToolboxCache cache(filename);
+        BOOST_TEST(!cache.load());
+        cache.set_digest("lr");
+        cache.set_sentences_parsing("lib", trees);
+        cache.set_labels_to_theses("lib", theses, {}, {});
+        BOOST_TEST(cache.store());
+    }
+    {
+        // Tables that are not set again are preserved when storing
+        SnapshotToolboxCache cache(filename);
+        BOOST_TEST(cache.load());
+        cache.set_vars("lib", vars, vars, vars);
+        BOOST_TEST(cache.store());
+    }
+    SnapshotToolboxCache cache(filename);
+    BOOST_TEST(cache.load());
+    BOOST_TEST(cache.get_digest() == "lr");
+    std::vector< ParsingTree2< SymTok, LabTok > > trees2;
+    BOOST_TEST(!cache.get_sentences_parsing("other", trees2));
+    BOOST_TEST(cache.get_sentences_parsing("lib", trees2));
+    BOOST_TEST((trees2 == trees));
+    std::vector< std::set< LabTok > > vars1, vars2, vars3;
+    BOOST_TEST(cache.get_vars("lib", vars1, vars2, vars3));
+    BOOST_TEST((vars1 == vars && vars2 == vars && vars3 == vars));
+    std::unordered_map< LabTok, std::vector< LabTok > > theses1, theses2, theses3;
+    BOOST_TEST(cache.get_labels_to_theses("lib", theses1, theses2, theses3));
+    BOOST_TEST((theses1 == theses && theses2.empty() && theses3.empty()));
+    std::vector< RegisteredProverInstanceData > provers;
+    BOOST_TEST(!cache.get_registered_provers("lib", provers));
+    // Loaded trees point inside the old file, which stays mapped when it is replaced
+    BOOST_TEST(cache.store());
+    BOOST_TEST((trees2 == trees));
+    boost::filesystem::remove(filename);
+}
+
+BOOST_AUTO_TEST_CASE(test_toolbox_warm_cache) {
+    LibraryImpl lib = read_test_library(wff_syntax_source + "ax-1 $a |- ( ph -> ( ps -> ph ) ) $.\n");
+    auto filename = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+    LibraryToolbox cold(lib, "|-", std::make_shared< SnapshotToolboxCache >(filename));
+    // The toolbox drops the cache once built, but the trees loaded from it
+    // must remain readable
+    LibraryToolbox warm(lib, "|-", std::make_shared< SnapshotToolboxCache >(filename));
+    boost::filesystem::remove(filename);
+    const LabTok ax1 = lib.get_label("ax-1");
+    BOOST_TEST((warm.get_parsed_sent2(ax1) == cold.get_parsed_sent2(ax1)));
+    BOOST_TEST((warm.get_parsed_sents_arena().expand(warm.get_parsed_sent_id(ax1)) == cold.get_parsed_sent2(ax1)));
+    BOOST_TEST((warm.get_parsed_sent(ax1) == cold.get_parsed_sent(ax1)));
+}
+
 #endif
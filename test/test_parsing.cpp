@@ -4,6 +4,8 @@
 #include "mm/setmm_loader.h"
 #include "parsing/earley.h"
 #include "parsing/lr.h"
+#include "parsing/discr.h"
+#include "parsing/ptarena.h"
 #include "test.h"
 
 #ifdef ENABLE_TEST_CODE
@@ -44,6 +46,16 @@ void test_parsers(const std::vector<SymType> &sent, SymType type, const std::uno
     ParsingTree2< SymType, LabType > pt2_2 = pt_to_pt2(pt);
     BOOST_TEST(pt == lr_pt);
     BOOST_TEST(pt2 == pt2_2);
+    BOOST_TEST(lr_parser.parse2(sent, type) == pt2);
+
+    // Batch parsing, with an empty sentence that cannot be parsed
+    std::vector< typename Parser< SymType, LabType >::ParseRequest > reqs = { std::make_tuple(sent.data(), sent.data() + sent.size(), type), std::make_tuple(sent.data() + sent.size(), sent.data() + sent.size(), type) };
+    for (const Parser< SymType, LabType > *parser : { static_cast< const Parser< SymType, LabType >* >(&earley_parser), static_cast< const Parser< SymType, LabType >* >(&lr_parser) }) {
+        auto pts = parser->parse_many(reqs, 2);
+        BOOST_TEST(pts.size() == 2u);
+        BOOST_TEST(pts[0] == pt2);
+        BOOST_TEST(pts[1].get_nodes_len() == 0u);
+    }
 }
 
 BOOST_AUTO_TEST_CASE(test_parsing1) {
@@ -127,7 +139,7 @@ BOOST_AUTO_TEST_CASE(test_lr_on_setmm) {
     //EarleyParser< SymTok, LabTok > earley_parser(derivations);
     auto &lr_parser = tb.get_parser();
 
-    for (const Assertion &ass : lib.get_assertions()) {
+    for (const Assertion &ass : lib.gen_assertions()) {
         if (!ass.is_valid() || !ass.is_theorem()) {
             continue;
         }
@@ -193,14 +205,30 @@ BOOST_DATA_TEST_CASE(test_setmm_unification, boost::unit_test::data::make(setmm_
         const Assertion &ass = lib.get_assertion(label);
         std::cout << " * " << lib.resolve_label(label) << ":";
         for (auto &hyp : ass.get_ess_hyps()) {
-            auto &hyp_sent = lib.get_sentence(hyp);
+            const auto &hyp_sent = lib.get_sentence(hyp);
             std::cout << " & " << tb.print_sentence(hyp_sent, SentencePrinter::STYLE_ANSI_COLORS_SET_MM);
         }
-        auto &thesis_sent = lib.get_sentence(ass.get_thesis());
+        const auto &thesis_sent = lib.get_sentence(ass.get_thesis());
         std::cout << " => " << tb.print_sentence(thesis_sent, SentencePrinter::STYLE_ANSI_COLORS_SET_MM) << std::endl;
     }*/
 }
 
+BOOST_AUTO_TEST_CASE(test_setmm_unification_batch) {
+    auto &data = get_set_mm();
+    auto &tb = data.tb;
+    std::vector< std::pair< std::vector< Sentence >, Sentence > > queries;
+    for (const auto &sample : setmm_unification_data) {
+        queries.push_back(std::make_pair(std::vector< Sentence >{}, tb.read_sentence(sample.second)));
+    }
+    queries.push_back(std::make_pair(std::vector< Sentence >{ tb.read_sentence("|- ph"), tb.read_sentence("|- ( ph -> ps )") }, tb.read_sentence("|- ps")));
+    queries.push_back(queries.front());
+    auto res = tb.unify_assertion_batch(queries, false, true);
+    BOOST_TEST(res.size() == queries.size());
+    for (size_t i = 0; i < queries.size(); i++) {
+        BOOST_TEST((res[i] == tb.unify_assertion(queries[i].first, queries[i].second, false, true)));
+    }
+}
+
 decltype(auto) get_unification_test_derivation() {
     std::unordered_map<char, std::vector<std::pair< size_t, std::vector<char> > > > derivations;
     derivations['S'].push_back(std::make_pair(100, std::vector< char >({ 'S', '+', 'P' })));
@@ -320,4 +348,133 @@ BOOST_DATA_TEST_CASE(test_unification, boost::unit_test::data::make(unification_
     }
 }
 
+BOOST_AUTO_TEST_CASE(test_lr_table) {
+    auto derivations = get_unification_test_derivation();
+    LRParser< char, size_t > lr(derivations);
+    lr.initialize();
+    const auto &automaton = lr.get_cached_data();
+    LRTable< char, size_t > table(automaton);
+    BOOST_TEST(table.get_states_num() == automaton.size());
+    for (const auto &row : automaton) {
+        for (const auto &shift : row.second.first) {
+            BOOST_TEST(table.get_shift(row.first, table.get_column(shift.first)) == shift.second);
+        }
+        // Shifts that are not in the automaton must not be in the table either
+        for (char sym : std::string("()+-*/0123456789SPFNDxyz")) {
+            if (row.second.first.find(sym) == row.second.first.end()) {
+                BOOST_TEST((table.get_shift(row.first, table.get_column(sym)) == LRTable< char, size_t >::npos));
+            }
+        }
+        BOOST_TEST(static_cast< size_t >(table.reductions_end(row.first) - table.reductions_begin(row.first)) == row.second.second.size());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_lr_update) {
+    auto full_derivations = get_unification_test_derivation();
+    LRParser< char, size_t > full_lr(full_derivations);
+    full_lr.initialize();
+
+    // Start without products and without parentheses, then add them back
+    auto derivations = full_derivations;
+    derivations['P'].erase(derivations['P'].begin(), derivations['P'].begin() + 2);
+    derivations['F'].erase(derivations['F'].begin());
+    LRParser< char, size_t > lr(derivations);
+    lr.initialize(true);
+    BOOST_TEST(lr.parse2(std::vector< char >({ '1', '+', '2' }), 'S').get_nodes_len() != 0u);
+    BOOST_TEST(lr.parse2(std::vector< char >({ '1', '*', '2' }), 'S').get_nodes_len() == 0u);
+    derivations = full_derivations;
+    lr.update();
+    BOOST_TEST((lr.get_cached_data() == full_lr.get_cached_data()));
+    BOOST_TEST(lr.parse2(std::vector< char >({ '(', '1', '*', '2', ')' }), 'S').get_nodes_len() != 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_discrimination_tree) {
+    auto derivations = get_unification_test_derivation();
+    LRParser< char, size_t > lr(derivations);
+    lr.initialize();
+    auto parse = [&lr](const std::string &str) {
+        auto pt = lr.parse(std::vector< char >(str.begin(), str.end()), 'S');
+        BOOST_TEST(pt.label != 0);
+        return pt_to_pt2(pt);
+    };
+    std::function< bool(size_t) > is_var = [](auto x) { return x >= 200; };
+    std::vector< std::string > patterns = { "x+y", "x+y+z", "x+x", "1+2", "x*y+3", "(x)" };
+    // The index keeps its own copy of the predicate, so a temporary is fine
+    DiscriminationTree< char, size_t, size_t > index([](size_t x) { return x >= 200; });
+    for (size_t i = 0; i < patterns.size(); i++) {
+        index.insert(parse(patterns[i]), i);
+    }
+    std::vector< std::pair< std::string, std::set< size_t > > > queries = {
+        { "1+2+3", { 1 } },
+        { "1+2", { 0, 2, 3 } },
+        { "1*2+3", { 4 } },
+        { "(1)", { 5 } },
+        { "12", {} },
+    };
+    for (const auto &query : queries) {
+        auto query_pt = parse(query.first);
+        auto candidates = index.find_candidates(query_pt);
+        BOOST_TEST((std::set< size_t >(candidates.begin(), candidates.end()) == query.second));
+        // Candidates must include all the patterns that actually unify
+        for (size_t i = 0; i < patterns.size(); i++) {
+            UnilateralUnificator< char, size_t > unif(is_var);
+            unif.add_parsing_trees2(parse(patterns[i]), query_pt);
+            if (unif.is_unifiable()) {
+                BOOST_TEST(query.second.count(i) == 1u);
+            }
+        }
+    }
+    // A batch walk finds the same candidates for each query
+    std::vector< ParsingTree2< char, size_t > > query_pts;
+    for (const auto &query : queries) {
+        query_pts.push_back(parse(query.first));
+    }
+    std::vector< const ParsingTree2< char, size_t >* > query_ptrs;
+    for (const auto &pt : query_pts) {
+        query_ptrs.push_back(&pt);
+    }
+    std::vector< std::set< size_t > > batch_candidates(queries.size());
+    index.find_candidates_batch(query_ptrs, [&](size_t i, size_t value) {
+        batch_candidates[i].insert(value);
+    });
+    for (size_t i = 0; i < queries.size(); i++) {
+        BOOST_TEST((batch_candidates[i] == queries[i].second));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_parsing_tree_arena) {
+    auto derivations = get_unification_test_derivation();
+    LRParser< char, size_t > lr(derivations);
+    lr.initialize();
+    auto parse = [&lr](const std::string &str) {
+        auto pt = lr.parse(std::vector< char >(str.begin(), str.end()), 'S');
+        BOOST_TEST(pt.label != 0);
+        return pt_to_pt2(pt);
+    };
+    ParsingTreeArena< char, size_t > arena;
+    auto id1 = arena.intern(parse("(1+2)*(1+2)"));
+    auto size1 = arena.size();
+    auto id2 = arena.intern(parse("(1+2)*(1+2)"));
+    BOOST_TEST(id1 == id2);
+    BOOST_TEST(arena.size() == size1);
+    // Both factors are the same subtree
+    auto prod = id1;
+    while (arena.get_children_num(prod) == 1) {
+        prod = arena.get_child(prod, 0);
+    }
+    BOOST_TEST(arena.get_children_num(prod) == 2u);
+    BOOST_TEST(arena.get_child(prod, 0) == arena.get_child(prod, 1));
+    auto id3 = arena.intern(parse("1+2"));
+    BOOST_TEST(id3 != id1);
+    BOOST_TEST(arena.size() == size1);
+    BOOST_TEST((arena.expand(id1) == parse("(1+2)*(1+2)")));
+    BOOST_TEST((arena.expand(id3) == parse("1+2")));
+    // Equal trees stored whole share their nodes
+    auto id4 = arena.intern_tree(parse("(1+2)*(1+2)"));
+    auto id5 = arena.intern_tree(parse("(1+2)*(1+2)"));
+    BOOST_TEST(id4 == id1);
+    BOOST_TEST(arena.get_tree(id4).get_nodes() == arena.get_tree(id5).get_nodes());
+    BOOST_TEST((arena.get_tree(id4) == parse("(1+2)*(1+2)")));
+}
+
 #endif
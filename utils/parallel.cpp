@@ -0,0 +1,136 @@
+#include "parallel.h"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <limits>
+#include <exception>
+#include <algorithm>
+
+size_t default_jobs_num() noexcept {
+    auto system = std::thread::hardware_concurrency();
+    if (system > 0) {
+        return system;
+    } else {
+        return 1;
+    }
+}
+
+namespace {
+
+struct WorkSlice {
+    std::mutex mutex;
+    size_t begin = 0;
+    size_t end = 0;
+};
+
+}
+
+void parallel_for(size_t num, const std::function<void (size_t)> &body, size_t jobs)
+{
+    if (jobs == 0) {
+        jobs = default_jobs_num();
+    }
+    jobs = std::min(jobs, num);
+    if (jobs <= 1) {
+        for (size_t i = 0; i < num; i++) {
+            body(i);
+        }
+        return;
+    }
+
+    std::vector< WorkSlice > slices(jobs);
+    for (size_t i = 0; i < jobs; i++) {
+        slices[i].begin = num * i / jobs;
+        slices[i].end = num * (i+1) / jobs;
+    }
+
+    std::atomic< size_t > first_failure(std::numeric_limits< size_t >::max());
+    std::mutex exc_mutex;
+    std::exception_ptr exc;
+
+    auto take_own = [&](size_t worker, size_t &idx) {
+        std::unique_lock< std::mutex > lock(slices[worker].mutex);
+        if (slices[worker].begin == slices[worker].end) {
+            return false;
+        }
+        idx = slices[worker].begin++;
+        return true;
+    };
+
+    auto steal = [&](size_t worker) {
+        while (true) {
+            // Look for the victim with the most remaining work; sizes can change
+            // while we scan, so the choice is checked again when taking the lock
+            size_t victim = worker;
+            size_t victim_size = 0;
+            for (size_t i = 0; i < jobs; i++) {
+                if (i == worker) {
+                    continue;
+                }
+                std::unique_lock< std::mutex > lock(slices[i].mutex);
+                size_t size = slices[i].end - slices[i].begin;
+                if (size > victim_size) {
+                    victim = i;
+                    victim_size = size;
+                }
+            }
+            if (victim_size == 0) {
+                return false;
+            }
+            size_t begin, end;
+            {
+                std::unique_lock< std::mutex > lock(slices[victim].mutex);
+                size_t size = slices[victim].end - slices[victim].begin;
+                if (size == 0) {
+                    continue;
+                }
+                begin = slices[victim].begin + size / 2;
+                end = slices[victim].end;
+                slices[victim].end = begin;
+            }
+            std::unique_lock< std::mutex > lock(slices[worker].mutex);
+            slices[worker].begin = begin;
+            slices[worker].end = end;
+            return true;
+        }
+    };
+
+    auto work = [&](size_t worker) {
+        while (true) {
+            size_t idx;
+            if (!take_own(worker, idx)) {
+                if (!steal(worker)) {
+                    return;
+                }
+                continue;
+            }
+            if (idx > first_failure) {
+                continue;
+            }
+            try {
+                body(idx);
+            } catch (...) {
+                std::unique_lock< std::mutex > lock(exc_mutex);
+                if (idx < first_failure) {
+                    first_failure = idx;
+                    exc = std::current_exception();
+                }
+            }
+        }
+    };
+
+    std::vector< std::thread > threads;
+    for (size_t i = 1; i < jobs; i++) {
+        threads.emplace_back(work, i);
+    }
+    work(0);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    if (exc) {
+        std::rethrow_exception(exc);
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <functional>
+#include <cstddef>
+
+/* Number of threads to use when the user does not ask for a specific
+ * value: the number of hardware threads, or one if the system cannot
+ * tell it.
+ */
+size_t default_jobs_num() noexcept;
+
+/* Call body(i) for each i in [0, num), spreading the work across jobs
+ * threads (the calling one included). Each thread begins with a contiguous
+ * slice of the range; when it runs out of work it steals the upper half of
+ * the largest slice still owned by another thread, so that workloads with
+ * very uneven costs (like proofs) remain balanced. If jobs is zero,
+ * default_jobs_num() threads are used; if it is one, the loop is run inline
+ * and in order.
+ *
+ * If some invocations throw, the exception thrown by the smallest index is
+ * rethrown in the calling thread once all threads have stopped. Indices
+ * larger than a failed one are skipped, while all the smaller ones are still
+ * executed, so which exception is reported does not depend on scheduling.
+ */
+void parallel_for(size_t num, const std::function< void(size_t) > &body, size_t jobs = 0);
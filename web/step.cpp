@@ -503,7 +503,8 @@ nlohmann::json Step::answer_api1(HTTPCallback &cb, std::vector< std::string >::c
             auto strong_workset = self->get_workset().lock();
             gio::assert_or_throw< SendError >(static_cast< bool >(strong_workset), 404);
             const LibraryToolbox &toolbox = strong_workset->get_toolbox();
-            CreativeProofEngineImpl< Sentence > engine(toolbox, true);
+            CreativeProofEngineImpl< Sentence > engine(toolbox);
+            engine.set_share_steps(true);
             bool res = self->prove(engine);
             nlohmann::json ret = nlohmann::json::object();
             ret["success"] = res;
@@ -532,13 +533,8 @@ nlohmann::json Step::answer_api1(HTTPCallback &cb, std::vector< std::string >::c
             // Sorting floating hypotheses by their label shoud give the expected order in the Assertion
             std::sort(float_hyps.begin(), float_hyps.end());
             buf << "thesis $p " << toolbox.print_sentence(thesis) << " $=" << std::endl;
-            UncompressedProof uncomp_proof(engine.get_proof_labels());
             Assertion dummy_ass(float_hyps, ess_hyps);
-            auto uncomp_op = uncomp_proof.get_operator(toolbox, dummy_ass);
-            for (const auto &hyp : hyps) {
-                uncomp_op->set_new_hypothesis(hyp.first, hyp.second);
-            }
-            auto comp_proof = uncomp_op->compress(ProofOperator::CS_BACKREFS_ON_IDENTICAL_SENTENCE);
+            auto comp_proof = compress_shared_proof(toolbox, dummy_ass, engine);
             buf << toolbox.print_proof(comp_proof) << std::endl;
             buf << "$." << std::endl;
             ret["proof"] = buf.str();
@@ -6,21 +6,13 @@
 
 #include "libs/json.h"
 
-#include "mm/reader.h"
+#include "utils/parallel.h"
+#include "mm/snapshot.h"
 #include "mm/engine.h"
 #include "mm/proof.h"
 #include "jsonize.h"
 
-static unsigned safe_hardware_concurrency() noexcept {
-    auto system = std::thread::hardware_concurrency();
-    if (system > 0) {
-        return system;
-    } else {
-        return 1;
-    }
-}
-
-Workset::Workset(std::weak_ptr<Session> session) : thread_manager(std::make_unique< CoroutineThreadManager >(safe_hardware_concurrency())) /*, step_backrefs(BackreferenceRegistry< Step, Workset >::create()) */, session(session)
+Workset::Workset(std::weak_ptr<Session> session) : thread_manager(std::make_unique< CoroutineThreadManager >(default_jobs_num())) /*, step_backrefs(BackreferenceRegistry< Step, Workset >::create()) */, session(session)
 {
 }
 
@@ -243,11 +235,10 @@ nlohmann::json Workset::answer_api1(HTTPCallback &cb, std::vector< std::string >
 
 void Workset::load_library(boost::filesystem::path filename, boost::filesystem::path cache_filename, std::string turnstile)
 {
-    FileTokenizer ft(filename);
-    Reader p(ft, false, true);
-    p.run();
-    this->library = std::make_unique< LibraryImpl >(p.get_library());
-    std::shared_ptr< ToolboxCache > cache = std::make_shared< FileToolboxCache >(cache_filename);
+    auto snapshot_filename = filename;
+    snapshot_filename += ".snapshot";
+    this->library = std::make_unique< LibraryImpl >(read_library_with_snapshot(filename, snapshot_filename));
+    std::shared_ptr< ToolboxCache > cache = std::make_shared< SnapshotToolboxCache >(cache_filename);
     this->toolbox = std::make_unique< LibraryToolbox >(*this->library, turnstile, cache);
 }
 